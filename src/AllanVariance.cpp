@@ -0,0 +1,122 @@
+#include "AllanVariance.h"
+
+#include <algorithm>
+
+AllanVariance::AllanVariance()
+{
+  configure(std::vector<long>(), 0);
+}
+
+void AllanVariance::configure(const std::vector<long> &clusterSizes,
+                              const int maxBlockSize)
+{
+  sizes = clusterSizes;
+  sumSquares.assign(sizes.size(), 0);
+  terms.assign(sizes.size(), 0);
+  maxBlock = maxBlockSize;
+  const long maxCluster = sizes.empty() ? 0 : sizes.back();
+  sums.clear();
+  sums.reserve(2 * maxCluster + maxBlock + 1);
+  sums.push_back(0);
+  sumsBegin = 0;
+  blockCount = 0;
+  offset = 0;
+  count = 0;
+  runningMean = 0;
+  m2 = 0;
+}
+
+void AllanVariance::addBlock(const double *samples, const int n)
+{
+  if (count == 0 && n > 0)
+  {
+    double blockMean = 0;
+    for (int i = 0; i < n; ++i)
+    {
+      blockMean += samples[i];
+    }
+    offset = blockMean / n;
+  }
+
+  double theta = sums.back();
+  for (int i = 0; i < n; ++i)
+  {
+    theta += samples[i] - offset;
+    sums.push_back(theta);
+
+    ++count;
+    const double delta = samples[i] - runningMean;
+    runningMean += delta / count;
+    m2 += delta * (samples[i] - runningMean);
+  }
+  blockCount = n;
+}
+
+void AllanVariance::accumulate(const int firstCluster, const int endCluster)
+{
+  const long sumsEnd = sumsBegin + long(sums.size());
+  const long blockBegin = sumsEnd - blockCount;
+  const double *theta = sums.data() - sumsBegin;
+  for (int c = firstCluster; c < endCluster; ++c)
+  {
+    const long m = sizes[c];
+    double s = 0;
+    for (long j = std::max(blockBegin, 2 * m); j < sumsEnd; ++j)
+    {
+      const double d = theta[j] - 2 * theta[j - m] + theta[j - 2 * m];
+      s += d * d;
+    }
+    sumSquares[c] += s;
+    terms[c] += std::max(sumsEnd - std::max(blockBegin, 2 * m), 0L);
+  }
+}
+
+void AllanVariance::endBlock()
+{
+  // The next block's first term reaches back 2 mMax sums from its end
+  const long keep = sizes.empty() ? 1 : 2 * sizes.back();
+  if (long(sums.size()) > keep)
+  {
+    const long drop = long(sums.size()) - keep;
+    sums.erase(sums.begin(), sums.begin() + drop);
+    sumsBegin += drop;
+  }
+  blockCount = 0;
+}
+
+int AllanVariance::numClusters() const
+{
+  return sizes.size();
+}
+
+long AllanVariance::clusterSize(const int cluster) const
+{
+  return sizes[cluster];
+}
+
+long AllanVariance::numTerms(const int cluster) const
+{
+  return terms[cluster];
+}
+
+double AllanVariance::variance(const int cluster) const
+{
+  const double m = sizes[cluster];
+  return terms[cluster] > 0 ?
+      sumSquares[cluster] / (2 * m * m * terms[cluster]) : 0;
+}
+
+long AllanVariance::numSamples() const
+{
+  return count;
+}
+
+double AllanVariance::mean() const
+{
+  return runningMean;
+}
+
+double AllanVariance::sampleVariance() const
+{
+  return count > 1 ? m2 / (count - 1) : 0;
+}
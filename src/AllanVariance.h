@@ -0,0 +1,70 @@
+#ifndef ALLANVARIANCE_H_
+#define ALLANVARIANCE_H_
+
+#include <vector>
+
+/*
+ * Streaming overlapping Allan variance of one uniformly sampled signal, over
+ * a fixed set of cluster sizes m (averaging times tau = m tau0):
+ *
+ *   avar(m) = sum_k (theta_{k+2m} - 2 theta_{k+m} + theta_k)^2
+ *             / (2 m^2 (n - 2m + 1))
+ *
+ * where theta_j is the sum of the first j samples. Only the last 2 mMax
+ * sums are kept, so memory depends on the largest cluster, not on the
+ * length of the signal. The sums are taken of the samples less the mean of
+ * the first block, which keeps them small over hours of data, and the
+ * signal's mean and variance are accumulated alongside with Welford's
+ * method.
+ *
+ * Samples arrive in blocks. addBlock() extends the sums, accumulate() adds
+ * the terms the block completed for a range of clusters, and endBlock()
+ * drops the sums no longer needed. Calls to accumulate() on disjoint
+ * cluster ranges may run concurrently.
+ */
+class AllanVariance
+{
+public:
+  AllanVariance();
+
+  // Cluster sizes in samples, ascending; resets the accumulators.
+  // maxBlockSize bounds the blocks passed to addBlock().
+  void configure(const std::vector<long> &clusterSizes,
+                 const int maxBlockSize);
+
+  void addBlock(const double *samples, const int count);
+  void accumulate(const int firstCluster, const int endCluster);
+  void endBlock();
+
+  int numClusters() const;
+  long clusterSize(const int cluster) const;
+
+  // Terms averaged for a cluster size so far; zero until n >= 2m
+  long numTerms(const int cluster) const;
+
+  // Allan variance of the samples at a cluster size, in squared sample
+  // units; the averaging time is the cluster size times the sample period
+  double variance(const int cluster) const;
+
+  long numSamples() const;
+  double mean() const;
+  double sampleVariance() const;
+
+private:
+  std::vector<long> sizes;
+  std::vector<double> sumSquares;
+  std::vector<long> terms;
+
+  // Running sums theta_j for j in [sumsBegin, sumsBegin + sums.size()),
+  // of which the last blockCount came from the current block
+  std::vector<double> sums;
+  long sumsBegin;
+  int blockCount;
+  int maxBlock;
+  double offset;
+
+  long count;
+  double runningMean, m2;
+};
+
+#endif  // ALLANVARIANCE_H_
@@ -0,0 +1,33 @@
+#ifndef ALLOCATIONCOUNTER_H_
+#define ALLOCATIONCOUNTER_H_
+
+#include <cstddef>
+
+/*
+ * Counts heap allocations by interposing malloc. Eigen allocates through
+ * malloc directly, so this counts at that level rather than in operator new.
+ * The header defines malloc itself, so include it in exactly one translation
+ * unit of a program. allocationCount() returns -1 where the C library offers
+ * no way to interpose.
+ */
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+static long numAllocations = 0;
+extern "C" void *malloc(size_t size)
+{
+  ++numAllocations;
+  return __libc_malloc(size);
+}
+static long allocationCount()
+{
+  return numAllocations;
+}
+#else
+static long allocationCount()
+{
+  return -1;
+}
+#endif
+
+#endif  // ALLOCATIONCOUNTER_H_
@@ -0,0 +1,113 @@
+#ifndef CIRCULARBUFFER_H_
+#define CIRCULARBUFFER_H_
+
+/*
+ * Fixed-capacity ring of elements stored inline, indexed from the oldest
+ * (0) to the newest (size() - 1). Appending to a full buffer overwrites the
+ * oldest element, so memory use is constant and no operation allocates.
+ */
+template<typename T, int Capacity>
+class CircularBuffer
+{
+public:
+  CircularBuffer() :
+      start(0), count(0)
+  {
+  }
+
+  int size() const
+  {
+    return count;
+  }
+
+  bool empty() const
+  {
+    return count == 0;
+  }
+
+  bool full() const
+  {
+    return count == Capacity;
+  }
+
+  static int capacity()
+  {
+    return Capacity;
+  }
+
+  void clear()
+  {
+    start = 0;
+    count = 0;
+  }
+
+  // Appends a slot for the caller to fill in place, evicting the oldest
+  // element when full.
+  T &pushBack()
+  {
+    if (count == Capacity)
+    {
+      start = (start + 1) % Capacity;
+      --count;
+    }
+    ++count;
+    return back();
+  }
+
+  void pushBack(const T &item)
+  {
+    pushBack() = item;
+  }
+
+  void popFront()
+  {
+    start = (start + 1) % Capacity;
+    --count;
+  }
+
+  // Keeps only the n oldest elements
+  void truncate(int n)
+  {
+    if (n < count)
+    {
+      count = n;
+    }
+  }
+
+  T &operator[](int i)
+  {
+    return items[(start + i) % Capacity];
+  }
+
+  const T &operator[](int i) const
+  {
+    return items[(start + i) % Capacity];
+  }
+
+  T &front()
+  {
+    return (*this)[0];
+  }
+
+  const T &front() const
+  {
+    return (*this)[0];
+  }
+
+  T &back()
+  {
+    return (*this)[count - 1];
+  }
+
+  const T &back() const
+  {
+    return (*this)[count - 1];
+  }
+
+private:
+  T items[Capacity];
+  int start;
+  int count;
+};
+
+#endif  // CIRCULARBUFFER_H_
@@ -0,0 +1,160 @@
+#include "FlightSimulator.h"
+
+#include <algorithm>
+#include <cmath>
+
+FlightSimulator::FlightSimulator(const unsigned seed) :
+    random(seed), radius(1), orbitRate(0.5), imuPeriod(0.005),
+    samplesPerPose(10), gyroStd(0), accelStd(0),
+    gyroBias(Eigen::Vector3d::Zero()), accelBias(Eigen::Vector3d::Zero()),
+    positionStd(0.01), attitudeStd(0.01), numSamples(0)
+{
+  setImuNoise(0.005, 0.05);
+  Eigen::Vector3d acceleration;
+  trajectory(0, position, velocity, acceleration);
+  orientation = attitude(0);
+  imu.timeStamp = 0;
+  imu.angularVelocity.setZero();
+  imu.linearAcceleration.setZero();
+  pose.timeStamp = 0;
+  pose.position.setZero();
+  pose.orientation.setIdentity();
+}
+
+void FlightSimulator::setOrbit(const double r, const double rate)
+{
+  radius = r;
+  orbitRate = rate;
+}
+
+void FlightSimulator::setRates(const double imuRate, const double poseRate)
+{
+  const double gyroNoise = gyroStd * std::sqrt(imuPeriod);
+  const double accelNoise = accelStd * std::sqrt(imuPeriod);
+  imuPeriod = 1 / imuRate;
+  samplesPerPose = std::max(1L, std::lround(imuRate / poseRate));
+  setImuNoise(gyroNoise, accelNoise);
+}
+
+// Per-sample standard deviations are the densities times sqrt(rate)
+void FlightSimulator::setImuNoise(const double gyroNoise,
+                                  const double accelNoise)
+{
+  gyroStd = gyroNoise / std::sqrt(imuPeriod);
+  accelStd = accelNoise / std::sqrt(imuPeriod);
+}
+
+void FlightSimulator::setImuBiases(const Eigen::Vector3d &gyro,
+                                   const Eigen::Vector3d &accel)
+{
+  gyroBias = gyro;
+  accelBias = accel;
+}
+
+void FlightSimulator::setPoseNoise(const double posStd, const double attStd)
+{
+  positionStd = posStd;
+  attitudeStd = attStd;
+}
+
+/*
+ * The IMU measures the body rates and the specific force
+ * f = R^T (a + GRAVITY_ACCEL), which is what QuadUkf integrates back into
+ * the inertial acceleration a. The rates come from a central difference of
+ * the attitude, q(t - h)^-1 q(t + h) = [w h, 1] to second order in h.
+ */
+bool FlightSimulator::step()
+{
+  ++numSamples;
+  const double t = numSamples * imuPeriod;
+  Eigen::Vector3d acceleration;
+  trajectory(t, position, velocity, acceleration);
+  orientation = attitude(t);
+
+  const Eigen::Quaterniond dq = attitude(t - RATE_STEP).conjugate()
+      * attitude(t + RATE_STEP);
+  const Eigen::Vector3d angVel = dq.vec() / (dq.w() * RATE_STEP) + gyroBias
+      + noise(gyroStd);
+  const Eigen::Vector3d accel = orientation.toRotationMatrix().transpose()
+      * (acceleration + GRAVITY_ACCEL) + accelBias + noise(accelStd);
+
+  // Filter axes to the IMU's, the inverse of QuadUkf's conversion
+  imu.timeStamp = t;
+  imu.angularVelocity << angVel(0), -angVel(1), angVel(2);
+  imu.linearAcceleration << -accel(0), accel(1), accel(2);
+
+  if (numSamples % samplesPerPose != 0)
+  {
+    return false;
+  }
+
+  // And to the visual tracker's
+  const Eigen::Vector3d p = position + noise(positionStd);
+  const Eigen::Quaterniond q = orientation
+      * QuadUkf::errorQuaternion(noise(attitudeStd));
+  pose.timeStamp = t;
+  pose.position << -p(0), p(1), p(2);
+  pose.orientation.x() = q.w();
+  pose.orientation.y() = q.z();
+  pose.orientation.z() = -q.y();
+  pose.orientation.w() = q.x();
+  return true;
+}
+
+double FlightSimulator::timeStamp() const
+{
+  return numSamples * imuPeriod;
+}
+
+const QuadUkf::ImuSample &FlightSimulator::imuSample() const
+{
+  return imu;
+}
+
+const QuadUkf::PoseSample &FlightSimulator::poseSample() const
+{
+  return pose;
+}
+
+const Eigen::Vector3d &FlightSimulator::truePosition() const
+{
+  return position;
+}
+
+const Eigen::Quaterniond &FlightSimulator::trueOrientation() const
+{
+  return orientation;
+}
+
+const Eigen::Vector3d &FlightSimulator::trueVelocity() const
+{
+  return velocity;
+}
+
+Eigen::Vector3d FlightSimulator::noise(const double std)
+{
+  return std * Eigen::Vector3d(normal(random), normal(random),
+                               normal(random));
+}
+
+// The orbit through (0, 0, 1), with a vertical bob at twice its rate
+void FlightSimulator::trajectory(const double t, Eigen::Vector3d &p,
+                                 Eigen::Vector3d &v, Eigen::Vector3d &a) const
+{
+  const double w = orbitRate, r = radius;
+  const double c = std::cos(w * t), s = std::sin(w * t);
+  const double c2 = std::cos(2 * w * t), s2 = std::sin(2 * w * t);
+  p << r * (c - 1), r * s, 1 + 0.2 * s2;
+  v << -r * w * s, r * w * c, 0.4 * w * c2;
+  a << -r * w * w * c, -r * w * w * s, -0.8 * w * w * s2;
+}
+
+// Yaw turning with the orbit, then pitch and roll rocking by up to 0.1 rad
+Eigen::Quaterniond FlightSimulator::attitude(const double t) const
+{
+  const double w = orbitRate;
+  return Eigen::AngleAxisd(w * t, Eigen::Vector3d::UnitZ())
+      * Eigen::AngleAxisd(0.1 * std::sin(2 * w * t), Eigen::Vector3d::UnitY())
+      * Eigen::AngleAxisd(0.1 * std::sin(3 * w * t),
+                          Eigen::Vector3d::UnitX());
+}
@@ -0,0 +1,83 @@
+#ifndef FLIGHTSIMULATOR_H_
+#define FLIGHTSIMULATOR_H_
+
+#include "QuadUkf.h"
+
+#include <random>
+
+/*
+ * Synthetic quadrotor flight for benchmarks and tests. The vehicle orbits a
+ * horizontal circle that starts at QuadUkf's initial position, bobbing up
+ * and down, turning with the orbit and rocking in roll and pitch. IMU
+ * samples and poses are both taken from that one trajectory: the body rates
+ * and specific force it implies, and its position and attitude, with white
+ * noise and constant IMU biases added, in the sensors' own axis conventions
+ * as QuadUkf reads them. The true state at the current sample is available
+ * to score a filter against.
+ */
+class FlightSimulator
+{
+public:
+  FlightSimulator(const unsigned seed = 1);
+
+  // Orbit radius, m, and angular rate, rad/s
+  void setOrbit(const double radius, const double rate);
+
+  // Sample rates of the IMU and the poses, Hz. The pose rate is rounded to
+  // a whole number of IMU samples per pose.
+  void setRates(const double imuRate, const double poseRate);
+
+  // IMU white noise densities, rad/s/sqrt(Hz) and m/s^2/sqrt(Hz), and
+  // constant biases in filter axes, rad/s and m/s^2
+  void setImuNoise(const double gyroNoise, const double accelNoise);
+  void setImuBiases(const Eigen::Vector3d &gyroBias,
+                    const Eigen::Vector3d &accelBias);
+
+  // Pose noise standard deviations, m and rad
+  void setPoseNoise(const double positionStd, const double attitudeStd);
+
+  // Advances to the next IMU sample. Returns true if a pose is taken at the
+  // same time.
+  bool step();
+
+  double timeStamp() const;
+  const QuadUkf::ImuSample &imuSample() const;
+  const QuadUkf::PoseSample &poseSample() const;
+
+  // True state at the current sample, in filter axes
+  const Eigen::Vector3d &truePosition() const;
+  const Eigen::Quaterniond &trueOrientation() const;
+  const Eigen::Vector3d &trueVelocity() const;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  std::mt19937 random;
+  std::normal_distribution<double> normal;
+
+  double radius, orbitRate;
+  double imuPeriod;
+  int samplesPerPose;
+  double gyroStd, accelStd;
+  Eigen::Vector3d gyroBias, accelBias;
+  double positionStd, attitudeStd;
+
+  long numSamples;
+  Eigen::Vector3d position, velocity;
+  Eigen::Quaterniond orientation;
+  QuadUkf::ImuSample imu;
+  QuadUkf::PoseSample pose;
+
+  // Gravity as QuadUkf models it, in the inertial frame
+  const Eigen::Vector3d GRAVITY_ACCEL {0, 0, -9.81};
+
+  // Time step of the central difference the body rates are taken from, s
+  const double RATE_STEP = 1e-5;
+
+  Eigen::Vector3d noise(const double std);
+  void trajectory(const double t, Eigen::Vector3d &p, Eigen::Vector3d &v,
+                  Eigen::Vector3d &a) const;
+  Eigen::Quaterniond attitude(const double t) const;
+};
+
+#endif  // FLIGHTSIMULATOR_H_
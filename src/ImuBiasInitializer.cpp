@@ -0,0 +1,94 @@
+#include "ImuBiasInitializer.h"
+
+ImuBiasInitializer::ImuBiasInitializer() :
+    windowLength(0.5), maxGyroVar(0.05 * 0.05), maxAccelVar(0.3 * 0.3)
+{
+  reset();
+}
+
+void ImuBiasInitializer::configure(const double window,
+                                   const double maxGyroStd,
+                                   const double maxAccelStd)
+{
+  windowLength = window;
+  maxGyroVar = maxGyroStd * maxGyroStd;
+  maxAccelVar = maxAccelStd * maxAccelStd;
+  reset();
+}
+
+void ImuBiasInitializer::reset()
+{
+  count = 0;
+  firstTimeStamp = 0;
+  lastTimeStamp = 0;
+  gyroMean = Eigen::Vector3d::Zero();
+  accelMean = Eigen::Vector3d::Zero();
+  gyroM2 = Eigen::Vector3d::Zero();
+  accelM2 = Eigen::Vector3d::Zero();
+}
+
+bool ImuBiasInitializer::add(const double timeStamp,
+                             const Eigen::Vector3d &angVel,
+                             const Eigen::Vector3d &accel)
+{
+  accumulate(timeStamp, angVel, accel);
+  if (count >= MIN_SAMPLES
+      && (angularVelocityVariance().maxCoeff() > maxGyroVar
+          || accelerationVariance().maxCoeff() > maxAccelVar))
+  {
+    reset();
+    accumulate(timeStamp, angVel, accel);
+  }
+  return count >= MIN_SAMPLES && duration() >= windowLength;
+}
+
+int ImuBiasInitializer::numSamples() const
+{
+  return count;
+}
+
+double ImuBiasInitializer::duration() const
+{
+  return lastTimeStamp - firstTimeStamp;
+}
+
+const Eigen::Vector3d &ImuBiasInitializer::meanAngularVelocity() const
+{
+  return gyroMean;
+}
+
+const Eigen::Vector3d &ImuBiasInitializer::meanAcceleration() const
+{
+  return accelMean;
+}
+
+Eigen::Vector3d ImuBiasInitializer::angularVelocityVariance() const
+{
+  return count > 1 ? Eigen::Vector3d(gyroM2 / (count - 1)) :
+      Eigen::Vector3d::Zero();
+}
+
+Eigen::Vector3d ImuBiasInitializer::accelerationVariance() const
+{
+  return count > 1 ? Eigen::Vector3d(accelM2 / (count - 1)) :
+      Eigen::Vector3d::Zero();
+}
+
+void ImuBiasInitializer::accumulate(const double timeStamp,
+                                    const Eigen::Vector3d &angVel,
+                                    const Eigen::Vector3d &accel)
+{
+  if (count == 0)
+  {
+    firstTimeStamp = timeStamp;
+  }
+  lastTimeStamp = timeStamp;
+  ++count;
+
+  const Eigen::Vector3d gyroDelta = angVel - gyroMean;
+  gyroMean += gyroDelta / count;
+  gyroM2 += gyroDelta.cwiseProduct(angVel - gyroMean);
+  const Eigen::Vector3d accelDelta = accel - accelMean;
+  accelMean += accelDelta / count;
+  accelM2 += accelDelta.cwiseProduct(accel - accelMean);
+}
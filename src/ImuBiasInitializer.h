@@ -0,0 +1,60 @@
+#ifndef IMUBIASINITIALIZER_H_
+#define IMUBIASINITIALIZER_H_
+
+#include <Eigen/Dense>
+
+/*
+ * Finds the first static window of an IMU stream, from which the filter
+ * takes its initial gyro bias, accelerometer bias or tilt. Samples are
+ * accumulated with running (Welford) means and variances per axis; a sample
+ * that pushes either sensor's spread past its threshold means the vehicle
+ * moved, and the window restarts from that sample. The window is complete
+ * once it spans the requested duration.
+ */
+class ImuBiasInitializer
+{
+public:
+  ImuBiasInitializer();
+
+  // Window length in seconds and the largest per-axis standard deviations,
+  // rad/s and m/s^2, still considered static
+  void configure(const double window, const double maxGyroStd,
+                 const double maxAccelStd);
+
+  void reset();
+
+  // Adds a sample; returns true once the window is complete
+  bool add(const double timeStamp, const Eigen::Vector3d &angVel,
+           const Eigen::Vector3d &accel);
+
+  int numSamples() const;
+  double duration() const;
+  const Eigen::Vector3d &meanAngularVelocity() const;
+  const Eigen::Vector3d &meanAcceleration() const;
+
+  // Sample variances per axis
+  Eigen::Vector3d angularVelocityVariance() const;
+  Eigen::Vector3d accelerationVariance() const;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  double windowLength;
+  double maxGyroVar, maxAccelVar;
+
+  int count;
+  double firstTimeStamp, lastTimeStamp;
+  Eigen::Vector3d gyroMean, accelMean;
+  Eigen::Vector3d gyroM2, accelM2;
+
+  // Fewest samples whose spread is judged against the thresholds
+  enum
+  {
+    MIN_SAMPLES = 10
+  };
+
+  void accumulate(const double timeStamp, const Eigen::Vector3d &angVel,
+                  const Eigen::Vector3d &accel);
+};
+
+#endif  // IMUBIASINITIALIZER_H_
@@ -0,0 +1,191 @@
+#include "ImuPreintegrator.h"
+
+#include <cmath>
+
+ImuPreintegrator::ImuPreintegrator() :
+    gyroNoiseDensity(0), accelNoiseDensity(0)
+{
+  reset();
+}
+
+void ImuPreintegrator::setNoiseDensities(const double gyroNoise,
+                                         const double accelNoise)
+{
+  gyroNoiseDensity = gyroNoise;
+  accelNoiseDensity = accelNoise;
+}
+
+void ImuPreintegrator::reset()
+{
+  count = 0;
+  sumDt = 0;
+  dRot = Eigen::Quaterniond::Identity();
+  dRotMatrix = Eigen::Matrix3d::Identity();
+  dVel = Eigen::Vector3d::Zero();
+  dPos = Eigen::Vector3d::Zero();
+  cov = CovMatrix::Zero();
+  dRotBg = Eigen::Matrix3d::Zero();
+  dVelBg = Eigen::Matrix3d::Zero();
+  dVelBa = Eigen::Matrix3d::Zero();
+  dPosBg = Eigen::Matrix3d::Zero();
+  dPosBa = Eigen::Matrix3d::Zero();
+}
+
+void ImuPreintegrator::integrate(const Eigen::Vector3d &angVel,
+                                 const Eigen::Vector3d &accel,
+                                 const double dt)
+{
+  const double dt2 = dt * dt;
+  const Eigen::Vector3d phi = angVel * dt;
+  const double angle = phi.norm();
+  const Eigen::Matrix3d stepRot = (angle > 0) ?
+      Eigen::AngleAxisd(angle, phi / angle).toRotationMatrix() :
+      Eigen::Matrix3d::Identity();
+  const Eigen::Matrix3d Jr = rightJacobian(phi);
+  const Eigen::Vector3d rotatedAccel = dRotMatrix * accel;
+  const Eigen::Matrix3d rotatedAccelSkew = dRotMatrix * skew(accel);
+
+  // Covariance: Sigma = A Sigma A^T + B_g Qg B_g^T + B_a Qa B_a^T, with
+  // the noise densities converted to discrete variances over dt. A is
+  //   [ E   0     0 ]
+  //   [ M   I     0 ]    E = Exp(w dt)^T, M = -dR [a]x dt
+  //   [ M/2 dt I  I ]
+  // (the M/2 block also carries a factor dt), so the product is expanded
+  // over 3x3 blocks instead of running two dense 9x9 products.
+  const Eigen::Matrix3d M = -rotatedAccelSkew * dt;
+  const Eigen::Matrix3d N = 0.5 * dt * M;
+  CovMatrix AS;
+  for (int j = 0; j < 9; j += 3)
+  {
+    const Eigen::Matrix3d S0 = cov.block<3, 3>(0, j);
+    const Eigen::Matrix3d S1 = cov.block<3, 3>(3, j);
+    AS.block<3, 3>(0, j).noalias() = stepRot.transpose() * S0;
+    AS.block<3, 3>(3, j).noalias() = M * S0;
+    AS.block<3, 3>(3, j) += S1;
+    AS.block<3, 3>(6, j).noalias() = N * S0;
+    AS.block<3, 3>(6, j) += dt * S1 + cov.block<3, 3>(6, j);
+  }
+  for (int i = 0; i < 9; i += 3)
+  {
+    const Eigen::Matrix3d T0 = AS.block<3, 3>(i, 0);
+    const Eigen::Matrix3d T1 = AS.block<3, 3>(i, 3);
+    cov.block<3, 3>(i, 0).noalias() = T0 * stepRot;
+    cov.block<3, 3>(i, 3).noalias() = T0 * M.transpose();
+    cov.block<3, 3>(i, 3) += T1;
+    cov.block<3, 3>(i, 6).noalias() = T0 * N.transpose();
+    cov.block<3, 3>(i, 6) += dt * T1 + AS.block<3, 3>(i, 6);
+  }
+
+  // B_g = [Jr dt; 0; 0] and B_a = [0; dR dt; dR dt^2 / 2], where dR dR^T = I
+  if (dt > 0)
+  {
+    const double gyroVar = gyroNoiseDensity * gyroNoiseDensity / dt;
+    const double accelVar = accelNoiseDensity * accelNoiseDensity / dt;
+    cov.block<3, 3>(0, 0).noalias() += (gyroVar * dt2) * Jr
+        * Jr.transpose();
+    cov.block<3, 3>(3, 3).diagonal().array() += accelVar * dt2;
+    cov.block<3, 3>(3, 6).diagonal().array() += 0.5 * accelVar * dt2 * dt;
+    cov.block<3, 3>(6, 3).diagonal().array() += 0.5 * accelVar * dt2 * dt;
+    cov.block<3, 3>(6, 6).diagonal().array() += 0.25 * accelVar * dt2
+        * dt2;
+  }
+
+  // Bias Jacobians, position and velocity first since they use the rotation
+  // terms from before this step
+  dPosBa += dVelBa * dt - 0.5 * dRotMatrix * dt2;
+  dPosBg += dVelBg * dt - 0.5 * rotatedAccelSkew * dRotBg * dt2;
+  dVelBa -= dRotMatrix * dt;
+  dVelBg -= rotatedAccelSkew * dRotBg * dt;
+  dRotBg = stepRot.transpose() * dRotBg - Jr * dt;
+
+  // Increments
+  dPos += dVel * dt + 0.5 * rotatedAccel * dt2;
+  dVel += rotatedAccel * dt;
+  dRotMatrix = dRotMatrix * stepRot;
+  dRot = Eigen::Quaterniond(dRotMatrix);
+  dRot.normalize();
+
+  sumDt += dt;
+  ++count;
+}
+
+int ImuPreintegrator::numSamples() const
+{
+  return count;
+}
+
+double ImuPreintegrator::deltaTime() const
+{
+  return sumDt;
+}
+
+const Eigen::Quaterniond &ImuPreintegrator::deltaRotation() const
+{
+  return dRot;
+}
+
+const Eigen::Vector3d &ImuPreintegrator::deltaVelocity() const
+{
+  return dVel;
+}
+
+const Eigen::Vector3d &ImuPreintegrator::deltaPosition() const
+{
+  return dPos;
+}
+
+const ImuPreintegrator::CovMatrix &ImuPreintegrator::covariance() const
+{
+  return cov;
+}
+
+const Eigen::Matrix3d &ImuPreintegrator::rotationGyroBiasJacobian() const
+{
+  return dRotBg;
+}
+
+const Eigen::Matrix3d &ImuPreintegrator::velocityGyroBiasJacobian() const
+{
+  return dVelBg;
+}
+
+const Eigen::Matrix3d &ImuPreintegrator::velocityAccelBiasJacobian() const
+{
+  return dVelBa;
+}
+
+const Eigen::Matrix3d &ImuPreintegrator::positionGyroBiasJacobian() const
+{
+  return dPosBg;
+}
+
+const Eigen::Matrix3d &ImuPreintegrator::positionAccelBiasJacobian() const
+{
+  return dPosBa;
+}
+
+Eigen::Matrix3d ImuPreintegrator::skew(const Eigen::Vector3d &v)
+{
+  Eigen::Matrix3d S;
+  S << 0, -v(2), v(1),
+       v(2), 0, -v(0),
+       -v(1), v(0), 0;
+  return S;
+}
+
+/*
+ * Right Jacobian of SO(3), which maps a perturbation of the rotation vector
+ * phi to the body-frame perturbation of Exp(phi).
+ */
+Eigen::Matrix3d ImuPreintegrator::rightJacobian(const Eigen::Vector3d &phi)
+{
+  const double angle = phi.norm();
+  const Eigen::Matrix3d S = skew(phi);
+  if (angle < 1e-6)
+  {
+    return Eigen::Matrix3d::Identity() - 0.5 * S;
+  }
+  const double angle2 = angle * angle;
+  return Eigen::Matrix3d::Identity() - (1 - std::cos(angle)) / angle2 * S
+      + (angle - std::sin(angle)) / (angle2 * angle) * S * S;
+}
@@ -0,0 +1,73 @@
+#ifndef IMUPREINTEGRATOR_H_
+#define IMUPREINTEGRATOR_H_
+
+#include <Eigen/Dense>
+
+/*
+ * Accumulates IMU samples into relative motion increments expressed in the
+ * body frame at the start of the interval (on-manifold preintegration):
+ *
+ *   deltaRotation  R_ij = prod Exp(w_k dt_k)
+ *   deltaVelocity  v_ij = sum R_ik a_k dt_k
+ *   deltaPosition  p_ij = sum v_ik dt_k + 1/2 R_ik a_k dt_k^2
+ *
+ * Gravity is not included; the consumer adds it in the world frame. Along
+ * with the increments it propagates their 9x9 covariance, ordered (rotation,
+ * velocity, position), from the gyro and accelerometer noise densities, and
+ * the first-order Jacobians of the increments with respect to constant gyro
+ * and accelerometer biases.
+ */
+class ImuPreintegrator
+{
+public:
+  typedef Eigen::Matrix<double, 9, 9> CovMatrix;
+
+  ImuPreintegrator();
+
+  // Continuous-time white noise densities, rad/s/sqrt(Hz) and
+  // m/s^2/sqrt(Hz)
+  void setNoiseDensities(const double gyroNoise, const double accelNoise);
+
+  void reset();
+
+  // Integrates one sample held constant over dt
+  void integrate(const Eigen::Vector3d &angVel, const Eigen::Vector3d &accel,
+                 const double dt);
+
+  int numSamples() const;
+  double deltaTime() const;
+  const Eigen::Quaterniond &deltaRotation() const;
+  const Eigen::Vector3d &deltaVelocity() const;
+  const Eigen::Vector3d &deltaPosition() const;
+  const CovMatrix &covariance() const;
+
+  // Bias Jacobians: d(rotation)/d(gyro bias), d(velocity)/d(gyro bias), ...
+  const Eigen::Matrix3d &rotationGyroBiasJacobian() const;
+  const Eigen::Matrix3d &velocityGyroBiasJacobian() const;
+  const Eigen::Matrix3d &velocityAccelBiasJacobian() const;
+  const Eigen::Matrix3d &positionGyroBiasJacobian() const;
+  const Eigen::Matrix3d &positionAccelBiasJacobian() const;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  double gyroNoiseDensity;
+  double accelNoiseDensity;
+
+  int count;
+  double sumDt;
+  Eigen::Quaterniond dRot;
+  Eigen::Matrix3d dRotMatrix;
+  Eigen::Vector3d dVel;
+  Eigen::Vector3d dPos;
+  CovMatrix cov;
+
+  Eigen::Matrix3d dRotBg;
+  Eigen::Matrix3d dVelBg, dVelBa;
+  Eigen::Matrix3d dPosBg, dPosBa;
+
+  static Eigen::Matrix3d skew(const Eigen::Vector3d &v);
+  static Eigen::Matrix3d rightJacobian(const Eigen::Vector3d &phi);
+};
+
+#endif  // IMUPREINTEGRATOR_H_
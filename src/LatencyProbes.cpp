@@ -0,0 +1,140 @@
+#include "LatencyProbes.h"
+
+LatencyHistogram::LatencyHistogram()
+{
+  reset();
+}
+
+void LatencyHistogram::record(const uint64_t ns)
+{
+  counts[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+  total.fetch_add(1, std::memory_order_relaxed);
+  sum.fetch_add(ns, std::memory_order_relaxed);
+  uint64_t seen = max.load(std::memory_order_relaxed);
+  while (ns > seen
+      && !max.compare_exchange_weak(seen, ns, std::memory_order_relaxed))
+  {
+  }
+}
+
+/*
+ * Walks the buckets once, collecting every percentile on the way. Counts
+ * recorded during the walk may or may not be included, so a live summary is
+ * approximate to within the samples in flight.
+ */
+LatencyHistogram::Summary LatencyHistogram::summarize() const
+{
+  Summary s = Summary();
+  s.count = total.load(std::memory_order_relaxed);
+  s.maxNs = max.load(std::memory_order_relaxed);
+  if (s.count == 0)
+  {
+    return s;
+  }
+  s.meanNs = double(sum.load(std::memory_order_relaxed)) / s.count;
+
+  const double fractions[] = {0.5, 0.9, 0.99, 0.999};
+  uint64_t *percentiles[] = {&s.p50Ns, &s.p90Ns, &s.p99Ns, &s.p999Ns};
+  int next = 0;
+  uint64_t seen = 0;
+  for (int b = 0; b < NUM_BUCKETS && next < 4; ++b)
+  {
+    seen += counts[b].load(std::memory_order_relaxed);
+    while (next < 4 && seen >= fractions[next] * s.count)
+    {
+      *percentiles[next++] = bucketUpperBound(b);
+    }
+  }
+
+  // The top bucket's bound can overshoot the largest value recorded
+  for (int i = 0; i < 4; ++i)
+  {
+    if (*percentiles[i] > s.maxNs)
+    {
+      *percentiles[i] = s.maxNs;
+    }
+  }
+  return s;
+}
+
+void LatencyHistogram::reset()
+{
+  for (int b = 0; b < NUM_BUCKETS; ++b)
+  {
+    counts[b].store(0, std::memory_order_relaxed);
+  }
+  total.store(0, std::memory_order_relaxed);
+  sum.store(0, std::memory_order_relaxed);
+  max.store(0, std::memory_order_relaxed);
+}
+
+int LatencyHistogram::bucketOf(const uint64_t ns)
+{
+  if (ns < SUB_BUCKETS)
+  {
+    return ns;
+  }
+  const int msb = 63 - __builtin_clzll(ns);
+  const int shift = msb - SUB_BUCKET_BITS;
+  const int sub = (ns >> shift) & (SUB_BUCKETS - 1);
+  return SUB_BUCKETS + shift * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(const int bucket)
+{
+  if (bucket < SUB_BUCKETS)
+  {
+    return bucket;
+  }
+  const int shift = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+  const uint64_t sub = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+  return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+bool LatencyProbes::enabled()
+{
+#ifdef KALMAN_SENSE_LATENCY_PROBES
+  return true;
+#else
+  return false;
+#endif
+}
+
+LatencyHistogram &LatencyProbes::histogram(const Stage stage)
+{
+  static LatencyHistogram histograms[NUM_STAGES];
+  return histograms[stage];
+}
+
+const char *LatencyProbes::stageName(const Stage stage)
+{
+  static const char *names[NUM_STAGES] = {"queue_wait", "sigma_points",
+                                          "process", "sensor_transform",
+                                          "gain_update", "conversion",
+                                          "publish"};
+  return names[stage];
+}
+
+void LatencyProbes::writeReport(std::FILE *out)
+{
+  std::fprintf(out, "%-16s %10s %9s %9s %9s %9s %9s %9s  (us)\n", "stage",
+               "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+  for (int i = 0; i < NUM_STAGES; ++i)
+  {
+    const Stage stage = Stage(i);
+    const LatencyHistogram::Summary s = histogram(stage).summarize();
+    std::fprintf(out, "%-16s %10llu %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f\n",
+                 stageName(stage), (unsigned long long)s.count,
+                 s.meanNs / 1e3, s.p50Ns / 1e3, s.p90Ns / 1e3, s.p99Ns / 1e3,
+                 s.p999Ns / 1e3, s.maxNs / 1e3);
+  }
+  std::fflush(out);
+}
+
+void LatencyProbes::reset()
+{
+  for (int i = 0; i < NUM_STAGES; ++i)
+  {
+    histogram(Stage(i)).reset();
+  }
+}
@@ -0,0 +1,145 @@
+#ifndef LATENCYPROBES_H_
+#define LATENCYPROBES_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+/*
+ * Latency histogram with HDR-style log-linear buckets: values below 16 ns
+ * get a bucket each, and every power-of-two octave above that is split into
+ * 16 linear sub-buckets, so any value is recorded to within 1/16 of itself
+ * over the whole 64-bit range. record() is a handful of relaxed atomic adds
+ * and may be called from any number of threads while others read.
+ */
+class LatencyHistogram
+{
+public:
+  enum
+  {
+    SUB_BUCKET_BITS = 4,
+    SUB_BUCKETS = 1 << SUB_BUCKET_BITS,
+    NUM_BUCKETS = SUB_BUCKETS + (64 - SUB_BUCKET_BITS) * SUB_BUCKETS
+  };
+
+  // Percentiles are the upper bounds of the buckets they fall in
+  struct Summary
+  {
+    uint64_t count;
+    double meanNs;
+    uint64_t p50Ns, p90Ns, p99Ns, p999Ns, maxNs;
+  };
+
+  LatencyHistogram();
+
+  void record(const uint64_t ns);
+  Summary summarize() const;
+  void reset();
+
+private:
+  std::atomic<uint64_t> counts[NUM_BUCKETS];
+  std::atomic<uint64_t> total, sum, max;
+
+  static int bucketOf(const uint64_t ns);
+  static uint64_t bucketUpperBound(const int bucket);
+};
+
+/*
+ * Per-stage timing of the filter hot path, from a sample entering the node's
+ * queue to its estimate being published. Every stage has one process-wide
+ * histogram.
+ *
+ * The probes only exist when KALMAN_SENSE_LATENCY_PROBES is defined (the
+ * CMake option of the same name). Otherwise LATENCY_SCOPE expands to
+ * nothing, Stamp is empty and now()/recordSince() are empty inlines, so the
+ * hot path compiles exactly as without them.
+ */
+class LatencyProbes
+{
+public:
+  enum Stage
+  {
+    QUEUE_WAIT,        // callback enqueue to filter thread dequeue
+    SIGMA_POINTS,      // covariance factorization and sigma point spread
+    PROCESS,           // process model over all sigma points
+    SENSOR_TRANSFORM,  // observation model and innovation covariance
+    GAIN_UPDATE,       // gain, state and covariance correction
+    CONVERSION,        // message to sample and belief to message
+    PUBLISH,           // ros::Publisher::publish() calls
+    NUM_STAGES
+  };
+
+  typedef std::chrono::steady_clock Clock;
+
+#ifdef KALMAN_SENSE_LATENCY_PROBES
+  struct Stamp
+  {
+    Clock::time_point time;
+  };
+
+  static Stamp now()
+  {
+    Stamp s;
+    s.time = Clock::now();
+    return s;
+  }
+
+  static void recordSince(const Stage stage, const Stamp &start)
+  {
+    histogram(stage).record(std::chrono::duration_cast<
+        std::chrono::nanoseconds>(Clock::now() - start.time).count());
+  }
+
+  // Records the lifetime of the scope it is declared in
+  class Scope
+  {
+  public:
+    explicit Scope(const Stage stage) :
+        stage(stage), start(now())
+    {
+    }
+
+    ~Scope()
+    {
+      recordSince(stage, start);
+    }
+
+  private:
+    const Stage stage;
+    const Stamp start;
+  };
+#else
+  struct Stamp
+  {
+  };
+
+  static Stamp now()
+  {
+    return Stamp();
+  }
+
+  static void recordSince(const Stage, const Stamp &)
+  {
+  }
+#endif
+
+  static bool enabled();
+  static LatencyHistogram &histogram(const Stage stage);
+  static const char *stageName(const Stage stage);
+
+  // One line per stage: count, mean and percentiles in microseconds
+  static void writeReport(std::FILE *out);
+  static void reset();
+};
+
+#ifdef KALMAN_SENSE_LATENCY_PROBES
+#define LATENCY_SCOPE_NAME(line) latencyScope##line
+#define LATENCY_SCOPE_AT(stage, line) \
+  LatencyProbes::Scope LATENCY_SCOPE_NAME(line)(LatencyProbes::stage)
+#define LATENCY_SCOPE(stage) LATENCY_SCOPE_AT(stage, __LINE__)
+#else
+#define LATENCY_SCOPE(stage)
+#endif
+
+#endif  // LATENCYPROBES_H_
@@ -0,0 +1,249 @@
+#include "MappedRecordFile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedRecordFile::MappedRecordFile() :
+    fd(-1), writable(false), header(Header()), fileBytes(0), window(0),
+    windowStart(0), windowBytes(0), lastIndex(-1)
+{
+}
+
+MappedRecordFile::~MappedRecordFile()
+{
+  close();
+}
+
+bool MappedRecordFile::create(const std::string &path, const char magic[8],
+                              const size_t recordSize)
+{
+  close();
+  errorMsg.clear();
+  filePath = path;
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    return fail("cannot create");
+  }
+  writable = true;
+  std::memcpy(header.magic, magic, sizeof(header.magic));
+  header.recordSize = recordSize;
+  header.numRecords = 0;
+  return growTo(HEADER_BYTES);
+}
+
+bool MappedRecordFile::open(const std::string &path, const char magic[8],
+                            const size_t recordSize, const bool writable)
+{
+  close();
+  errorMsg.clear();
+  filePath = path;
+  fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+  if (fd < 0)
+  {
+    return fail("cannot open");
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0
+      || ::pread(fd, &header, sizeof(header), 0) != sizeof(header))
+  {
+    fail("cannot read header of");
+  }
+  else if (std::memcmp(header.magic, magic, sizeof(header.magic)) != 0
+      || header.recordSize != recordSize)
+  {
+    errorMsg = "unexpected record format in " + path;
+  }
+  else if (st.st_size < long(HEADER_BYTES
+      + header.numRecords * recordSize))
+  {
+    errorMsg = path + " is truncated";
+  }
+  else
+  {
+    this->writable = writable;
+    fileBytes = st.st_size;
+    return true;
+  }
+  ::close(fd);
+  fd = -1;
+  return false;
+}
+
+bool MappedRecordFile::close()
+{
+  if (fd < 0)
+  {
+    return true;
+  }
+  unmapWindow();
+  lastIndex = -1;
+  bool ok = true;
+  if (writable)
+  {
+    const long used = HEADER_BYTES + header.numRecords * header.recordSize;
+    ok = sync() && (::ftruncate(fd, used) == 0 || fail("cannot finish"));
+  }
+  ::close(fd);
+  fd = -1;
+  writable = false;
+  fileBytes = 0;
+  return ok;
+}
+
+bool MappedRecordFile::sync()
+{
+  if (fd < 0 || !writable)
+  {
+    return false;
+  }
+  return ::pwrite(fd, &header, sizeof(header), 0) == sizeof(header)
+      || fail("cannot write header of");
+}
+
+bool MappedRecordFile::append(const void *record)
+{
+  const long end = HEADER_BYTES
+      + (header.numRecords + 1) * header.recordSize;
+  if (end > fileBytes && !growTo(std::max(end, fileBytes + WINDOW_BYTES)))
+  {
+    return false;
+  }
+  ++header.numRecords;
+  return write(header.numRecords - 1, record);
+}
+
+bool MappedRecordFile::read(const long index, void *record)
+{
+  if (index < 0 || index >= size())
+  {
+    return false;
+  }
+  const char *src = recordAt(index);
+  if (!src)
+  {
+    return false;
+  }
+  std::memcpy(record, src, header.recordSize);
+  return true;
+}
+
+bool MappedRecordFile::write(const long index, const void *record)
+{
+  if (!writable || index < 0 || index >= size())
+  {
+    return false;
+  }
+  char *dst = recordAt(index);
+  if (!dst)
+  {
+    return false;
+  }
+  std::memcpy(dst, record, header.recordSize);
+  return true;
+}
+
+bool MappedRecordFile::truncate(const long count)
+{
+  if (!writable || count < 0)
+  {
+    return false;
+  }
+  if (count < size())
+  {
+    header.numRecords = count;
+  }
+  return true;
+}
+
+long MappedRecordFile::size() const
+{
+  return fd < 0 ? 0 : long(header.numRecords);
+}
+
+bool MappedRecordFile::isOpen() const
+{
+  return fd >= 0;
+}
+
+const std::string &MappedRecordFile::error() const
+{
+  return errorMsg;
+}
+
+/*
+ * Returns the address of a record, moving the window if it is not mapped.
+ * A window moving backward is placed to end at the record and one moving
+ * forward to start at it, so a sequential pass in either direction remaps
+ * once per window. Windows entered sequentially are read ahead in full,
+ * which the kernel would not do for a backward pass; random access leaves
+ * the read-ahead to the kernel.
+ */
+char *MappedRecordFile::recordAt(const long index)
+{
+  const long offset = HEADER_BYTES + index * header.recordSize;
+  const long end = offset + header.recordSize;
+  const bool sequential = index == lastIndex + 1 || index == lastIndex - 1;
+  lastIndex = index;
+  if (window && offset >= windowStart && end <= windowStart + windowBytes)
+  {
+    return window + (offset - windowStart);
+  }
+
+  const bool backward = window && offset < windowStart;
+  unmapWindow();
+  const long pageBytes = ::sysconf(_SC_PAGESIZE);
+  long start = backward ? std::max(end - long(WINDOW_BYTES), 0L) : offset;
+  start -= start % pageBytes;
+  const long bytes = std::min(std::max(long(WINDOW_BYTES), end - start),
+                              fileBytes - start);
+  void *mapped = ::mmap(0, bytes, PROT_READ | (writable ? PROT_WRITE : 0),
+                        MAP_SHARED, fd, start);
+  if (mapped == MAP_FAILED)
+  {
+    fail("cannot map");
+    return 0;
+  }
+  if (sequential)
+  {
+    ::madvise(mapped, bytes, MADV_WILLNEED);
+  }
+  window = static_cast<char *>(mapped);
+  windowStart = start;
+  windowBytes = bytes;
+  return window + (offset - windowStart);
+}
+
+// Extends the file; the window keeps its extent and is remapped on demand
+bool MappedRecordFile::growTo(const long bytes)
+{
+  if (::ftruncate(fd, bytes) != 0)
+  {
+    return fail("cannot extend");
+  }
+  fileBytes = bytes;
+  return true;
+}
+
+void MappedRecordFile::unmapWindow()
+{
+  if (window)
+  {
+    ::munmap(window, windowBytes);
+    window = 0;
+    windowBytes = 0;
+  }
+}
+
+bool MappedRecordFile::fail(const std::string &what)
+{
+  errorMsg = what + " " + filePath + ": " + std::strerror(errno);
+  return false;
+}
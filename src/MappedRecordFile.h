@@ -0,0 +1,87 @@
+#ifndef MAPPEDRECORDFILE_H_
+#define MAPPEDRECORDFILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * File of fixed-size binary records accessed through a sliding memory
+ * mapping, for record streams too large to hold in memory. The file starts
+ * with a 64-byte header: an 8-byte magic chosen by the caller, the record
+ * size and the record count, in native byte order. Records follow back to
+ * back.
+ *
+ * Only a window of WINDOW_BYTES around the record last accessed is mapped,
+ * so memory use is bounded however long the file grows, and sequential
+ * access in either direction runs at close to disk bandwidth. Records are
+ * copied in and out, so pointers into the mapping never escape. The file
+ * grows in steps of a window while appending and is trimmed to its records
+ * on close(). The record count in the header is only brought up to date by
+ * sync() and close(); a file left unclosed reads back as of the last sync.
+ */
+class MappedRecordFile
+{
+public:
+  enum
+  {
+    HEADER_BYTES = 64,
+    WINDOW_BYTES = 64 << 20
+  };
+
+  MappedRecordFile();
+  ~MappedRecordFile();
+
+  // Creates path, or empties it if it exists, for writing records
+  bool create(const std::string &path, const char magic[8],
+              const size_t recordSize);
+
+  // Opens an existing file, checking its magic and record size
+  bool open(const std::string &path, const char magic[8],
+            const size_t recordSize, const bool writable);
+
+  // Writes the header and trims the file to its records
+  bool close();
+
+  // Writes the header, making the records appended so far readable
+  bool sync();
+
+  bool append(const void *record);
+  bool read(const long index, void *record);
+  bool write(const long index, const void *record);
+
+  // Drops every record after the first count
+  bool truncate(const long count);
+
+  long size() const;
+  bool isOpen() const;
+  const std::string &error() const;
+
+private:
+  struct Header
+  {
+    char magic[8];
+    uint64_t recordSize;
+    uint64_t numRecords;
+  };
+
+  int fd;
+  bool writable;
+  std::string filePath;
+  std::string errorMsg;
+  Header header;
+  long fileBytes;
+
+  // The mapped window, [windowStart, windowStart + windowBytes) of the file
+  char *window;
+  long windowStart;
+  long windowBytes;
+  long lastIndex;
+
+  char *recordAt(const long index);
+  bool growTo(const long bytes);
+  void unmapWindow();
+  bool fail(const std::string &what);
+};
+
+#endif  // MAPPEDRECORDFILE_H_
@@ -0,0 +1,219 @@
+#include "PosePublisher.h"
+
+#include <boost/make_shared.hpp>
+
+PosePublisher::Options::Options() :
+    poseRate(0), poseWithCovRate(0), poseArrayRate(2), poseArrayDecimation(10),
+    sharedMessages(false)
+{
+}
+
+PosePublisher::PosePublisher(ros::Publisher poseStampedPub,
+                             ros::Publisher poseWithCovStampedPub,
+                             ros::Publisher poseArrayPub,
+                             const Options &options) :
+    options(options), dropped(0), beliefsSinceTrajectoryPose(0),
+    poseStampedPublisher(poseStampedPub),
+    poseWithCovStampedPublisher(poseWithCovStampedPub),
+    poseArrayPublisher(poseArrayPub), running(true)
+{
+  // Initialize pose array for visualization in Rviz
+  quadPoseArray.poses.reserve(POSE_ARRAY_SIZE);
+  quadPoseArray.header.frame_id = "map";
+  quadPoseArray.header.stamp = ros::Time();
+
+  publisherThread = std::thread(&PosePublisher::runPublisher, this);
+}
+
+PosePublisher::~PosePublisher()
+{
+  running = false;
+  publisherThread.join();
+}
+
+bool PosePublisher::post(const QuadUkf::QuadBelief &b)
+{
+  Snapshot s;
+  {
+    LATENCY_SCOPE(CONVERSION);
+    s.timeStamp = b.timeStamp;
+    s.position = b.state.position;
+    s.orientation = b.state.quaternion;
+    s.covariance = b.covariance.block<6, 6>(0, 0);
+  }
+  if (!queue.push(s))
+  {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+long PosePublisher::droppedBeliefs() const
+{
+  return dropped.load(std::memory_order_relaxed);
+}
+
+/*
+ * Publisher thread main loop, with the same spin-then-sleep back-off as the
+ * filter thread.
+ */
+void PosePublisher::runPublisher()
+{
+  int idlePolls = 0;
+  while (running.load(std::memory_order_relaxed))
+  {
+    const Snapshot *s = queue.front();
+    if (s)
+    {
+      publishSnapshot(*s);
+      queue.pop();
+      idlePolls = 0;
+    }
+    else if (++idlePolls < 100)
+    {
+      std::this_thread::yield();
+    }
+    else
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  }
+}
+
+void PosePublisher::publishSnapshot(const Snapshot &s)
+{
+  const Clock::time_point now = Clock::now();
+
+  if (rateAllows(options.poseRate, now, lastPoseTime))
+  {
+    {
+      LATENCY_SCOPE(CONVERSION);
+      geometry_msgs::PoseStamped &msg = outgoing(poseStampedMsg,
+                                                 sharedPoseStamped);
+      setStamp(s.timeStamp, msg.header.stamp);
+      snapshotToPose(s, msg.pose);
+    }
+    LATENCY_SCOPE(PUBLISH);
+    send(poseStampedPublisher, poseStampedMsg, sharedPoseStamped);
+  }
+
+  if (rateAllows(options.poseWithCovRate, now, lastPoseWithCovTime))
+  {
+    {
+      LATENCY_SCOPE(CONVERSION);
+      geometry_msgs::PoseWithCovarianceStamped &msg = outgoing(
+          poseWithCovStampedMsg, sharedPoseWithCovStamped);
+      setStamp(s.timeStamp, msg.header.stamp);
+      snapshotToPose(s, msg.pose.pose);
+      for (int i = 0; i < s.covariance.size(); ++i)
+      {
+        msg.pose.covariance[i] = s.covariance(i);
+      }
+    }
+    LATENCY_SCOPE(PUBLISH);
+    send(poseWithCovStampedPublisher, poseWithCovStampedMsg,
+         sharedPoseWithCovStamped);
+  }
+
+  if (options.poseArrayRate < 0)
+  {
+    return;
+  }
+
+  if (++beliefsSinceTrajectoryPose >= options.poseArrayDecimation)
+  {
+    LATENCY_SCOPE(CONVERSION);
+    beliefsSinceTrajectoryPose = 0;
+    snapshotToPose(s, trajectory.pushBack());
+  }
+
+  if (rateAllows(options.poseArrayRate, now, lastPoseArrayTime))
+  {
+    publishTrajectory(s.timeStamp);
+  }
+}
+
+/*
+ * Copies the trajectory ring into quadPoseArray, newest pose first, and
+ * publishes it. The array's storage was reserved up front, so this is a
+ * plain copy; a fresh shared array is sized once per publish.
+ */
+void PosePublisher::publishTrajectory(const double timeStamp)
+{
+  {
+    LATENCY_SCOPE(CONVERSION);
+    geometry_msgs::PoseArray &msg = outgoing(quadPoseArray, sharedPoseArray);
+    const int n = trajectory.size();
+    msg.header.frame_id = quadPoseArray.header.frame_id;
+    msg.poses.resize(n);
+    for (int i = 0; i < n; ++i)
+    {
+      msg.poses[i] = trajectory[n - 1 - i];
+    }
+    setStamp(timeStamp, msg.header.stamp);
+  }
+  LATENCY_SCOPE(PUBLISH);
+  send(poseArrayPublisher, quadPoseArray, sharedPoseArray);
+}
+
+// The message to fill for the next publish on a topic: the reused one, or a
+// newly allocated one held in fresh until send()
+template<typename Msg>
+Msg &PosePublisher::outgoing(Msg &reused, boost::shared_ptr<Msg> &fresh) const
+{
+  if (!options.sharedMessages)
+  {
+    return reused;
+  }
+  fresh = boost::make_shared<Msg>();
+  return *fresh;
+}
+
+// Publishes the message filled through outgoing(). roscpp keeps the shared
+// message, so it is released here and never written again.
+template<typename Msg>
+void PosePublisher::send(ros::Publisher &pub, const Msg &reused,
+                         boost::shared_ptr<Msg> &fresh)
+{
+  if (fresh)
+  {
+    pub.publish(fresh);
+    fresh.reset();
+  }
+  else
+  {
+    pub.publish(reused);
+  }
+}
+
+// Returns true, and restarts the period, if a topic limited to rate may
+// publish at time now
+bool PosePublisher::rateAllows(const double rate,
+                               const Clock::time_point now,
+                               Clock::time_point &last)
+{
+  if (rate > 0 && now - last < std::chrono::duration<double>(1 / rate))
+  {
+    return false;
+  }
+  last = now;
+  return true;
+}
+
+void PosePublisher::snapshotToPose(const Snapshot &s, geometry_msgs::Pose &p)
+{
+  p.position.x = s.position(0);
+  p.position.y = s.position(1);
+  p.position.z = s.position(2);
+  p.orientation.w = s.orientation.w();
+  p.orientation.x = s.orientation.x();
+  p.orientation.y = s.orientation.y();
+  p.orientation.z = s.orientation.z();
+}
+
+void PosePublisher::setStamp(const double timeStamp, ros::Time &stamp)
+{
+  stamp.sec = timeStamp;
+  stamp.nsec = (timeStamp - floor(timeStamp)) * pow(10, 9);
+}
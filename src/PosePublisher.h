@@ -0,0 +1,121 @@
+#ifndef POSEPUBLISHER_H_
+#define POSEPUBLISHER_H_
+
+#include "QuadUkf.h"
+#include "LatencyProbes.h"
+#include "SpscRingBuffer.h"
+#include "CircularBuffer.h"
+
+#include "ros/ros.h"
+#include "geometry_msgs/PoseStamped.h"
+#include "geometry_msgs/PoseWithCovarianceStamped.h"
+#include "geometry_msgs/PoseArray.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+/*
+ * Publishing stage of the node. The filter thread posts a compact snapshot
+ * of each new belief onto a lock-free queue and returns immediately; a
+ * publisher thread converts the snapshots to messages and publishes them,
+ * limiting each topic to its own rate. The trajectory for visualization is
+ * kept in a fixed ring of poses, decimated on insertion, and is only
+ * serialized when its rate limit allows.
+ *
+ * By default each topic reuses one outgoing message. With sharedMessages
+ * every publish allocates a fresh message and hands roscpp the shared
+ * pointer, which intra-process subscribers (in the same nodelet manager)
+ * receive as is, without serialization.
+ */
+class PosePublisher
+{
+public:
+  // Number of poses kept for plotting
+  enum
+  {
+    POSE_ARRAY_SIZE = 10000
+  };
+
+  // Rates are in Hz of wall time; a rate of 0 publishes every belief. A
+  // negative poseArrayRate turns the trajectory off altogether, for nodes
+  // that record a trajectory log instead.
+  struct Options
+  {
+    double poseRate;
+    double poseWithCovRate;
+    double poseArrayRate;
+    int poseArrayDecimation;  // keep every Nth belief in the trajectory
+    bool sharedMessages;      // publish a new shared message every time
+
+    Options();
+  };
+
+  PosePublisher(ros::Publisher poseStampedPub,
+                ros::Publisher poseWithCovStampedPub,
+                ros::Publisher poseArrayPub,
+                const Options &options = Options());
+  ~PosePublisher();
+
+  // Filter thread side. Never blocks; returns false and drops the belief if
+  // the publisher has fallen a whole queue behind.
+  bool post(const QuadUkf::QuadBelief &b);
+
+  long droppedBeliefs() const;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  // The part of a belief that is published
+  struct Snapshot
+  {
+    double timeStamp;
+    Eigen::Vector3d position;
+    Eigen::Quaterniond orientation;
+    Eigen::Matrix<double, 6, 6> covariance;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  typedef std::chrono::steady_clock Clock;
+
+  const Options options;
+
+  SpscRingBuffer<Snapshot, 256> queue;
+  std::atomic<long> dropped;
+
+  CircularBuffer<geometry_msgs::Pose, POSE_ARRAY_SIZE> trajectory;
+  int beliefsSinceTrajectoryPose;
+
+  ros::Publisher poseStampedPublisher;
+  ros::Publisher poseWithCovStampedPublisher;
+  ros::Publisher poseArrayPublisher;
+  Clock::time_point lastPoseTime, lastPoseWithCovTime, lastPoseArrayTime;
+
+  // Caller-owned buffers for outgoing messages, and the fresh messages that
+  // replace them with sharedMessages
+  geometry_msgs::PoseStamped poseStampedMsg;
+  geometry_msgs::PoseWithCovarianceStamped poseWithCovStampedMsg;
+  geometry_msgs::PoseArray quadPoseArray;
+  geometry_msgs::PoseStampedPtr sharedPoseStamped;
+  geometry_msgs::PoseWithCovarianceStampedPtr sharedPoseWithCovStamped;
+  geometry_msgs::PoseArrayPtr sharedPoseArray;
+
+  std::atomic<bool> running;
+  std::thread publisherThread;
+
+  void runPublisher();
+  void publishSnapshot(const Snapshot &s);
+  void publishTrajectory(const double timeStamp);
+  template<typename Msg>
+  Msg &outgoing(Msg &reused, boost::shared_ptr<Msg> &fresh) const;
+  template<typename Msg>
+  static void send(ros::Publisher &pub, const Msg &reused,
+                   boost::shared_ptr<Msg> &fresh);
+  static bool rateAllows(const double rate, const Clock::time_point now,
+                         Clock::time_point &last);
+  static void snapshotToPose(const Snapshot &s, geometry_msgs::Pose &p);
+  static void setStamp(const double timeStamp, ros::Time &stamp);
+};
+
+#endif  // POSEPUBLISHER_H_
@@ -1,310 +1,1101 @@
 #include "QuadUkf.h"
 
-QuadUkf::QuadUkf(ros::Publisher poseStampedPub,
-                 ros::Publisher poseWithCovStampedPub,
-                 ros::Publisher poseArrayPub)
-{
-  poseStampedPublisher = poseStampedPub;
-  poseWithCovStampedPublisher = poseWithCovStampedPub;
-  poseArrayPublisher = poseArrayPub;
-
-  numStates = 16;
-  numSensors = 10;
-  this->UnscentedKf::setWeightsAndCoeffs();
-
-  // Define initial position, quaternion, velocity, angular velocity, and
-  // acceleration.
-  Eigen::Quaterniond initQuat = Eigen::Quaterniond::Identity();
-  Eigen::Vector3d initPosition, initVelocity, initAngVel, initAcceleration;
+#include <cmath>
+#include <limits>
+
+template<typename Scalar, typename PropagationScalar>
+BasicQuadUkf<Scalar, PropagationScalar>::BasicQuadUkf(double initTimeStamp)
+{
+  // Define initial position, quaternion, velocity, angular velocity,
+  // acceleration and biases.
+  Quaternion initQuat = Quaternion::Identity();
+  Vector3 initPosition, initVelocity, initAngVel, initAcceleration;
   initPosition << 0, 0, 1;  // "x = 0, y = 0, z = 1 meter above origin"
-  initVelocity = Eigen::Vector3d::Zero();
-  initAngVel = Eigen::Vector3d::Zero();
-  initAcceleration = Eigen::Vector3d::Zero();
+  initVelocity = Vector3::Zero();
+  initAngVel = Vector3::Zero();
+  initAcceleration = Vector3::Zero();
+  const Vector3 initBias = Vector3::Zero();
 
   // Define initial belief
-  QuadUkf::QuadState initState {initPosition, initQuat, initVelocity,
-                                initAngVel, initAcceleration};
-  Eigen::MatrixXd initCov = Eigen::MatrixXd::Identity(numStates, numStates);
-  initCov = initCov * 0.01;
-  double initTimeStamp = ros::Time::now().toSec();
+  QuadState initState {initPosition, initQuat, initVelocity, initAngVel,
+                       initAcceleration, initBias, initBias};
+  StateVector initStd = StateVector::Constant(0.1);
+  initStd.template segment<3>(GYRO_BIAS_X).setConstant(INIT_GYRO_BIAS_STD);
+  initStd.template segment<3>(ACCEL_BIAS_X).setConstant(INIT_ACCEL_BIAS_STD);
+  StateMatrix initCov = initStd.array().square().matrix().asDiagonal();
+  StateMatrix initSqrtCov = initStd.asDiagonal();
   double init_dt = 0.0001;
-  QuadUkf::QuadBelief initBelief {initTimeStamp, init_dt, initState, initCov};
+  QuadBelief initBelief {initTimeStamp, init_dt, initState, initCov,
+                         initSqrtCov};
   lastBelief = initBelief;
 
-  SensorCovMatrixR = R_SCALING_COEFF
-      * Eigen::MatrixXd::Identity(numSensors, numSensors);
-  ProcessCovMatrixQ = Q_SCALING_COEFF
-      * Eigen::MatrixXd::Identity(numStates, numStates);
+  ProcessCovMatrixQ = scaledProcessCovariance(Q_SCALING_COEFF);
+  gyroBiasRandomWalk = GYRO_BIAS_RANDOM_WALK;
+  accelBiasRandomWalk = ACCEL_BIAS_RANDOM_WALK;
+
+  // Initialize last pose for pseudovelocity corrections
+  lastPoseTimeStamp = initTimeStamp;
+  lastPosePosition = initPosition.template cast<double>();
+
+  historyStats = HistoryStats();
+  poseInnovation.timeStamp = initTimeStamp;
+  poseInnovation.residual.setZero();
+  poseInnovation.nis = 0;
+  historyStats.historyBytes = sizeof(history) + sizeof(replayInputs);
+  lastInputTimeStamp = initTimeStamp;
+
+  preintegrationEnabled = false;
+  preintegrationPeriod = 0;
+  activePreintegration = 0;
+  lastImuAngVel = Eigen::Vector3d::Zero();
+  lastImuAccel = Eigen::Vector3d::Zero();
+  preintegrator.setNoiseDensities(GYRO_NOISE_DENSITY, ACCEL_NOISE_DENSITY);
+
+  transitionObserver = 0;
+  numTransitions = 0;
+
+  staticInitPending = false;
+  staticInitStart = 0;
+  attitudeObserved = false;
+  biasInitializer.configure(0.5, STATIC_GYRO_STD, STATIC_ACCEL_STD);
+
+  // The built-in sensors, in SensorId order
+  numRegisteredSensors = 0;
+  sequentialUpdates = false;
+  const SensorModel *builtIn[] = {&poseModel, &altimeterModel,
+                                  &opticalFlowModel, &positionModel};
+  for (int i = 0; i < 4; ++i)
+  {
+    const int n = builtIn[i]->dimension();
+    addSensor(builtIn[i], R_SCALING_COEFF * PartialSensorMatrix::Identity(n,
+                                                                         n));
+  }
 
-  // Initialize last PTAM message for pseudovelocity corrections
-  lastPoseMsg.header.stamp.sec = initTimeStamp;
-  lastPoseMsg.pose.pose.position.x = initPosition(0);
-  lastPoseMsg.pose.pose.position.y = initPosition(1);
-  lastPoseMsg.pose.pose.position.z = initPosition(2);
+  // correctState() with observationFunc() corrects with the pose sensor's
+  // full measurement, which selects the leading states
+  setSelectionObservation(SelectionVector::LinSpaced(numSensors, 0,
+                                                     numSensors - 1));
+}
 
-  // Initialize pose array for visualization in Rviz
-  quadPoseArray.poses.clear();
-  quadPoseArray.header.frame_id = "map";
-  quadPoseArray.header.stamp = ros::Time();
+template<typename Scalar, typename PropagationScalar>
+BasicQuadUkf<Scalar, PropagationScalar>::~BasicQuadUkf()
+{
 }
 
-QuadUkf::QuadUkf(QuadUkf&& other)
+template<typename Scalar, typename PropagationScalar>
+const typename BasicQuadUkf<Scalar, PropagationScalar>::QuadBelief &
+BasicQuadUkf<Scalar, PropagationScalar>::getBelief() const
 {
-  std::lock_guard<std::timed_mutex> lock(other.mtx);
+  return lastBelief;
+}
 
-  SensorCovMatrixR = std::move(other.SensorCovMatrixR);
-  other.SensorCovMatrixR = Eigen::MatrixXd::Zero(1, 1);
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::setTransitionObserver(
+    TransitionObserver *observer)
+{
+  transitionObserver = observer;
+  numTransitions = 0;
+}
 
-  ros::NodeHandle n;
-  poseStampedPublisher = std::move(other.poseStampedPublisher);
-  poseWithCovStampedPublisher = std::move(other.poseWithCovStampedPublisher);
-  poseArrayPublisher = std::move(other.poseArrayPublisher);
-  ros::Publisher p = n.advertise<std_msgs::Empty>("empty", 1);
-  other.poseWithCovStampedPublisher = p;
-  other.poseArrayPublisher = p;
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::setProcessCovariance(
+    const StateMatrix &Q)
+{
+  ProcessCovMatrixQ = Q;
 }
 
-QuadUkf::~QuadUkf()
+template<typename Scalar, typename PropagationScalar>
+typename BasicQuadUkf<Scalar, PropagationScalar>::StateMatrix
+BasicQuadUkf<Scalar, PropagationScalar>::scaledProcessCovariance(
+    const double scale)
 {
+  StateVector diagonal = StateVector::Constant(scale);
+  diagonal.template tail<6>().setZero();
+  return diagonal.asDiagonal();
 }
 
-void QuadUkf::imuCallback(const sensor_msgs::ImuConstPtr &msg_in)
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::setSensorCovariance(
+    const SensorMatrix &R)
 {
-  mtx.try_lock_for(std::chrono::milliseconds(100));
+  sensors[POSE_SENSOR].covariance = R;
+}
 
-  QuadBelief xHat = lastBelief;
-  xHat.state.angular_velocity(0) = msg_in->angular_velocity.x;
-  xHat.state.angular_velocity(1) = -msg_in->angular_velocity.y;
-  xHat.state.angular_velocity(2) = msg_in->angular_velocity.z;
-  xHat.state.acceleration(0) = -msg_in->linear_acceleration.x;
-  xHat.state.acceleration(1) = msg_in->linear_acceleration.y;
-  xHat.state.acceleration(2) = msg_in->linear_acceleration.z;
-
-  // Remove gravity
-  xHat.state.acceleration = xHat.state.acceleration
-      - xHat.state.quaternion.toRotationMatrix().inverse() * GRAVITY_ACCEL;
+template<typename Scalar, typename PropagationScalar>
+int BasicQuadUkf<Scalar, PropagationScalar>::addSensor(
+    const SensorModel *model, const PartialSensorMatrix &R)
+{
+  const int n = model->dimension();
+  if (numRegisteredSensors >= MAX_SENSORS || n < 1 || n > numSensors
+      || R.rows() != n || R.cols() != n)
+  {
+    return -1;
+  }
+  RegisteredSensor &s = sensors[numRegisteredSensors];
+  s.model = model;
+  s.covariance = R;
+  s.innovation.timeStamp = lastBelief.timeStamp;
+  s.innovation.residual = PartialSensorVector::Zero(n);
+  s.innovation.numComponents = 0;
+  s.innovation.nis = 0;
+  return numRegisteredSensors++;
+}
 
-  // Predict next state and reset lastBelief
-  Eigen::VectorXd x = quadStateToEigen(xHat.state);
-  xHat.dt = msg_in->header.stamp.toSec() - lastBelief.timeStamp;
-  UnscentedKf::Belief b = predictState(x, xHat.covariance, ProcessCovMatrixQ,
-                                       xHat.dt);
-  QuadUkf::QuadBelief qb {msg_in->header.stamp.toSec(), xHat.dt,
-                          eigenToQuadState(b.state), b.covariance};
-  qb.state.quaternion = checkQuatContinuity(lastBelief.state.quaternion,
-                                            qb.state.quaternion);
-  lastBelief = qb;
-
-  publishAllPoseMessages(lastBelief);
-
-  mtx.unlock();
-}
-
-void QuadUkf::poseCallback(
-    const geometry_msgs::PoseWithCovarianceStampedConstPtr &msg_in)
-{
-  mtx.try_lock_for(std::chrono::milliseconds(100));
-
-  Eigen::VectorXd z(numSensors);
-  z(POS_X) = -msg_in->pose.pose.position.x;
-  z(POS_Y) = msg_in->pose.pose.position.y;
-  z(POS_Z) = msg_in->pose.pose.position.z;
-  z(QUAT_X) = msg_in->pose.pose.orientation.w;
-  z(QUAT_Y) = -msg_in->pose.pose.orientation.z;
-  z(QUAT_Z) = msg_in->pose.pose.orientation.y;
-  z(QUAT_W) = msg_in->pose.pose.orientation.x;
-
-  // Pseudovelocity correction
-  double dtPose = msg_in->header.stamp.toSec()
-      - lastPoseMsg.header.stamp.toSec();
-  z(VEL_X) = (z(POS_X) - lastPoseMsg.pose.pose.position.x) / dtPose;
-  z(VEL_Y) = (z(POS_Y) - lastPoseMsg.pose.pose.position.y) / dtPose;
-  z(VEL_Z) = (z(POS_Z) - lastPoseMsg.pose.pose.position.z) / dtPose;
-
-  // Update lastPoseMsg
-  lastPoseMsg.header = msg_in->header;
-  lastPoseMsg.pose.pose.position.x = z(POS_X);
-  lastPoseMsg.pose.pose.position.y = z(POS_Y);
-  lastPoseMsg.pose.pose.position.z = z(POS_Z);
-
-  // Check incoming quaternion for rotational continuity and replace if not
-  // continuous.
-  Eigen::Quaterniond inQuat;
-  inQuat.x() = z(QUAT_X);
-  inQuat.y() = z(QUAT_Y);
-  inQuat.z() = z(QUAT_Z);
-  inQuat.w() = z(QUAT_W);
-  Eigen::Vector4d chosenQuat = checkQuatContinuity(lastBelief.state.quaternion,
-                                                   inQuat).coeffs();
-  z.block<4, 1>(3, 0) = chosenQuat;
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::setSensorCovariance(
+    const int sensor, const PartialSensorMatrix &R)
+{
+  if (sensor >= 0 && sensor < numRegisteredSensors
+      && R.rows() == sensors[sensor].covariance.rows()
+      && R.cols() == sensors[sensor].covariance.cols())
+  {
+    sensors[sensor].covariance = R;
+  }
+}
 
-  // Set time step "dt".
-  double dt = msg_in->header.stamp.toSec() - lastBelief.timeStamp;
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::setSequentialUpdates(
+    const bool enable)
+{
+  sequentialUpdates = enable;
+}
 
-  QuadUkf::QuadBelief xHat = lastBelief;
-  xHat.state.velocity = lastBelief.state.velocity
-      + lastBelief.state.acceleration * dt;
-  xHat.state.position = (xHat.state.velocity + lastBelief.state.velocity) / 2.0
-      * dt + lastBelief.state.position;
-  Eigen::MatrixXd Theta = quatIntegrationMatrix(
-      lastBelief.state.angular_velocity);
-  xHat.state.quaternion.coeffs() = lastBelief.state.quaternion.coeffs()
-      + 0.5 * Theta * lastBelief.state.quaternion.coeffs() * dt;
-  xHat.state.quaternion.normalize();
-  Eigen::VectorXd xPred = quadStateToEigen(xHat.state);
-  Eigen::MatrixXd P = lastBelief.covariance;
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::setImuPreintegration(
+    const bool enable, const double outputPeriod)
+{
+  flushPreintegration();
+  preintegrationEnabled = enable;
+  preintegrationPeriod = outputPeriod;
+}
 
-  UnscentedKf::Belief currStateAndCov = correctState(xPred, P, z,
-                                                     SensorCovMatrixR);
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::setImuNoiseDensities(
+    const double gyroNoise, const double accelNoise)
+{
+  preintegrator.setNoiseDensities(gyroNoise, accelNoise);
+}
 
-  // Update lastBelief.
-  lastBelief.dt = dt;
-  lastBelief.state = eigenToQuadState(currStateAndCov.state);
-  lastBelief.covariance = currStateAndCov.covariance;
-  lastBelief.timeStamp = msg_in->header.stamp.toSec();
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::setImuBiasRandomWalks(
+    const double gyroWalk, const double accelWalk)
+{
+  gyroBiasRandomWalk = gyroWalk;
+  accelBiasRandomWalk = accelWalk;
+}
 
-  publishAllPoseMessages(lastBelief);
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::setStaticInitialization(
+    const bool enable, const double window)
+{
+  staticInitPending = enable;
+  staticInitStart = std::numeric_limits<double>::quiet_NaN();
+  biasInitializer.configure(window, STATIC_GYRO_STD, STATIC_ACCEL_STD);
+  poseAttitudes.reset();
+}
+
+template<typename Scalar, typename PropagationScalar>
+bool BasicQuadUkf<Scalar, PropagationScalar>::isInitialized() const
+{
+  return !staticInitPending;
+}
 
-  mtx.unlock();
+template<typename Scalar, typename PropagationScalar>
+const typename BasicQuadUkf<Scalar, PropagationScalar>::PoseInnovation &
+BasicQuadUkf<Scalar, PropagationScalar>::getPoseInnovation() const
+{
+  return poseInnovation;
 }
 
-void QuadUkf::publishAllPoseMessages(const QuadUkf::QuadBelief b)
+template<typename Scalar, typename PropagationScalar>
+const typename BasicQuadUkf<Scalar, PropagationScalar>::SensorInnovation &
+BasicQuadUkf<Scalar, PropagationScalar>::getSensorInnovation(
+    const int sensor) const
 {
-  const geometry_msgs::PoseWithCovarianceStamped pwcs =
-      quadBeliefToPoseWithCovStamped(b);
-  poseWithCovStampedPublisher.publish(pwcs);
-  updatePoseArray(pwcs);
-  const geometry_msgs::PoseStamped ps = quadBeliefToPoseStamped(b);
-  poseStampedPublisher.publish(ps);
+  return sensors[sensor].innovation;
+}
+
+template<typename Scalar, typename PropagationScalar>
+typename BasicQuadUkf<Scalar, PropagationScalar>::HistoryStats
+BasicQuadUkf<Scalar, PropagationScalar>::getHistoryStats() const
+{
+  HistoryStats stats = historyStats;
+  stats.historyDepth = history.size();
+  return stats;
+}
+
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::imuUpdate(const ImuSample &imu)
+{
+  Measurement m;
+  m.type = Measurement::IMU;
+  m.imu = imu;
+  fuseMeasurement(m, imu.timeStamp);
+}
+
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::poseUpdate(const PoseSample &pose)
+{
+  Measurement m;
+  m.type = Measurement::POSE;
+  m.pose = pose;
+  fuseMeasurement(m, pose.timeStamp);
+}
+
+// Samples of unregistered sensors are ignored
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::sensorUpdate(
+    const SensorSample &sample)
+{
+  if (sample.sensor < 0 || sample.sensor >= numRegisteredSensors)
+  {
+    return;
+  }
+  Measurement m;
+  m.type = Measurement::SENSOR;
+  m.sensor = sample;
+  fuseMeasurement(m, sample.timeStamp);
 }
 
 /*
- * Puts a given pose into the first position of quadPoseArray. Once
- * quadPoseArray reaches POSE_ARRAY_SIZE, the last pose is popped on each call.
- * After these operations are performed, this function publishes
- * quadPoseArray.
+ * Applies a measurement at its own time stamp. In-order measurements are
+ * applied directly. A late one rewinds the filter to the newest history entry
+ * at or before its time stamp, is applied there, and every input recorded
+ * after that entry is replayed on top of it.
  */
-void QuadUkf::updatePoseArray(const geometry_msgs::PoseWithCovarianceStamped p)
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::fuseMeasurement(
+    const Measurement &m, const double timeStamp)
+{
+  if (history.empty() || timeStamp >= lastInputTimeStamp)
+  {
+    applyMeasurement(m);
+    return;
+  }
+
+  int rewindTo = history.size() - 1;
+  while (rewindTo >= 0 && history[rewindTo].timeStamp > timeStamp)
+  {
+    --rewindTo;
+  }
+  if (rewindTo < 0)
+  {
+    ++historyStats.discarded;
+    return;
+  }
+
+  // Set aside the inputs to replay, then restore the state they started from
+  replayInputs.clear();
+  for (int i = rewindTo + 1; i < history.size(); ++i)
+  {
+    replayInputs.pushBack(history[i].input);
+  }
+  history.truncate(rewindTo + 1);
+  const HistoryEntry &base = history.back();
+  lastInputTimeStamp = base.timeStamp;
+  lastBelief = base.belief;
+  lastPoseTimeStamp = base.lastPoseTimeStamp;
+  lastPosePosition = base.lastPosePosition;
+  preintegrator = base.preintegrator;
+  lastImuAngVel = base.lastImuAngVel;
+  lastImuAccel = base.lastImuAccel;
+  staticInitPending = base.staticInitPending;
+  staticInitStart = base.staticInitStart;
+  attitudeObserved = base.attitudeObserved;
+  biasInitializer = base.biasInitializer;
+  poseAttitudes = base.poseAttitudes;
+  if (transitionObserver && numTransitions != base.numTransitions)
+  {
+    numTransitions = base.numTransitions;
+    transitionObserver->rewind(numTransitions);
+  }
+
+  applyMeasurement(m);
+  for (int i = 0; i < replayInputs.size(); ++i)
+  {
+    applyMeasurement(replayInputs[i]);
+  }
+
+  ++historyStats.outOfSequence;
+  historyStats.replayedSamples += replayInputs.size();
+  if (replayInputs.size() > historyStats.maxReplayDepth)
+  {
+    historyStats.maxReplayDepth = replayInputs.size();
+  }
+}
+
+// Runs one filter step and records it in the history
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::applyMeasurement(
+    const Measurement &m)
 {
-  quadPoseArray.poses.insert(quadPoseArray.poses.begin(), 1, p.pose.pose);
-  if (quadPoseArray.poses.size() > POSE_ARRAY_SIZE)
+  if (m.type == Measurement::IMU)
+  {
+    lastInputTimeStamp = m.imu.timeStamp;
+    applyImu(m.imu);
+  }
+  else if (m.type == Measurement::POSE)
   {
-    quadPoseArray.poses.pop_back();
+    lastInputTimeStamp = m.pose.timeStamp;
+    applyPose(m.pose);
+  }
+  else
+  {
+    lastInputTimeStamp = m.sensor.timeStamp;
+    correctSensor(m.sensor.sensor, m.sensor.values, m.sensor.timeStamp);
+  }
+
+  HistoryEntry &entry = history.pushBack();
+  entry.input = m;
+  entry.timeStamp = lastInputTimeStamp;
+  entry.belief = lastBelief;
+  entry.lastPoseTimeStamp = lastPoseTimeStamp;
+  entry.lastPosePosition = lastPosePosition;
+  entry.preintegrator = preintegrator;
+  entry.lastImuAngVel = lastImuAngVel;
+  entry.lastImuAccel = lastImuAccel;
+  entry.numTransitions = numTransitions;
+  entry.staticInitPending = staticInitPending;
+  entry.staticInitStart = staticInitStart;
+  entry.attitudeObserved = attitudeObserved;
+  entry.biasInitializer = biasInitializer;
+  entry.poseAttitudes = poseAttitudes;
+}
+
+// IMU rates in filter axes
+template<typename Scalar, typename PropagationScalar>
+Eigen::Vector3d BasicQuadUkf<Scalar, PropagationScalar>::imuAngularVelocity(
+    const ImuSample &imu)
+{
+  return Eigen::Vector3d(imu.angularVelocity(0), -imu.angularVelocity(1),
+                         imu.angularVelocity(2));
+}
+
+// IMU specific force in filter axes
+template<typename Scalar, typename PropagationScalar>
+Eigen::Vector3d BasicQuadUkf<Scalar, PropagationScalar>::imuAcceleration(
+    const ImuSample &imu)
+{
+  return Eigen::Vector3d(-imu.linearAcceleration(0),
+                         imu.linearAcceleration(1),
+                         imu.linearAcceleration(2));
+}
+
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::applyImu(const ImuSample &imu)
+{
+  if (staticInitPending)
+  {
+    accumulateStatic(imu);
+    return;
+  }
+  if (preintegrationEnabled)
+  {
+    preintegrateImu(imu);
+    return;
+  }
+
+  // Remove the biases, and gravity
+  QuadBelief xHat = lastBelief;
+  xHat.state.angular_velocity = imuAngularVelocity(imu).template cast<
+      Scalar>() - xHat.state.gyro_bias;
+  xHat.state.acceleration = imuAcceleration(imu).template cast<Scalar>()
+      - xHat.state.accel_bias
+      - xHat.state.quaternion.toRotationMatrix().inverse() * GRAVITY_ACCEL;
+
+  // Predict the error around xHat, then fold its mean into the propagated
+  // nominal state
+  linearizationPoint = xHat.state;
+  stepBelief.state.setZero();
+  stepBelief.covariance = xHat.covariance;
+  stepBelief.sqrtCovariance = xHat.sqrtCovariance;
+  xHat.dt = imu.timeStamp - lastBelief.timeStamp;
+  stepQ = ProcessCovMatrixQ;
+  addBiasRandomWalks(xHat.dt, stepQ);
+  propagateState(linearizationPoint, xHat.dt, propagatedPoint);
+  predictState(stepBelief, stepQ, xHat.dt, stepBelief);
+  lastBelief.timeStamp = imu.timeStamp;
+  lastBelief.dt = xHat.dt;
+  applyError(propagatedPoint, stepBelief.state, lastBelief.state);
+  lastBelief.covariance = stepBelief.covariance;
+  lastBelief.sqrtCovariance = stepBelief.sqrtCovariance;
+  if (transitionObserver)
+  {
+    recordPrediction(xHat.state, xHat.covariance, xHat.timeStamp);
+  }
+}
+
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::preintegrateImu(
+    const ImuSample &imu)
+{
+  const Eigen::Vector3d angVel = imuAngularVelocity(imu);
+  const Eigen::Vector3d accel = imuAcceleration(imu);
+  const QuadState &x = lastBelief.state;
+
+  // Each sample is held over the interval that ends at its time stamp. The
+  // belief, and with it the bias the increments are taken at, stays put
+  // until the next flush.
+  const double intervalStart = lastBelief.timeStamp
+      + preintegrator.deltaTime();
+  preintegrator.integrate(angVel - x.gyro_bias.template cast<double>(),
+                          accel - x.accel_bias.template cast<double>(),
+                          imu.timeStamp - intervalStart);
+  lastImuAngVel = angVel;
+  lastImuAccel = accel;
+
+  if (preintegrationPeriod > 0
+      && preintegrator.deltaTime() >= preintegrationPeriod)
+  {
+    flushPreintegration();
   }
-  poseArrayPublisher.publish(quadPoseArray);
 }
 
 /*
- * Ensures rotational continuity by checking for sign-flipping in the
- * orientation quaternion.
+ * Runs one sigma point prediction over the preintegrated IMU increments and
+ * starts a new preintegration interval.
  */
-Eigen::Quaterniond QuadUkf::checkQuatContinuity(
-    const Eigen::Quaterniond lastQuat, const Eigen::Quaterniond nextQuat) const
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::flushPreintegration()
 {
-  Eigen::Vector4d lastVec, nextVec;
-  lastVec = lastQuat.normalized().coeffs();
-  nextVec = nextQuat.normalized().coeffs();
+  if (preintegrator.numSamples() == 0)
+  {
+    return;
+  }
+  const double dt = preintegrator.deltaTime();
+
+  // Process noise: the per-sample Q for every integrated sample, plus the
+  // increments' own covariance mapped into error coordinates at the mean.
+  // The rotation increment's error is already a body-frame attitude error;
+  // the velocity and position increments are rotated into the inertial
+  // frame.
+  const Matrix3 R = lastBelief.state.quaternion.toRotationMatrix();
+  Eigen::Matrix<Scalar, ERROR_SIZE, 9> noiseMap =
+      Eigen::Matrix<Scalar, ERROR_SIZE, 9>::Zero();
+  noiseMap.template block<3, 3>(ATT_X, 0).setIdentity();
+  noiseMap.template block<3, 3>(VEL_X, 3) = R;
+  noiseMap.template block<3, 3>(POS_X, 6) = R;
+  preintegratedQ = preintegrator.numSamples() * ProcessCovMatrixQ;
+  preintegratedQ.noalias() += noiseMap
+      * preintegrator.covariance().template cast<Scalar>()
+      * noiseMap.transpose();
+  addBiasRandomWalks(dt, preintegratedQ);
+
+  linearizationPoint = lastBelief.state;
+  stepBelief.state.setZero();
+  stepBelief.covariance = lastBelief.covariance;
+  stepBelief.sqrtCovariance = lastBelief.sqrtCovariance;
+  activePreintegration = &preintegrator;
+  propagateState(linearizationPoint, dt, propagatedPoint);
+  predictState(stepBelief, preintegratedQ, dt, stepBelief);
+  activePreintegration = 0;
+
+  if (transitionObserver)
+  {
+    transitionRecord.priorCov = lastBelief.covariance;
+  }
+  const double priorTimeStamp = lastBelief.timeStamp;
+  lastBelief.timeStamp += dt;
+  lastBelief.dt = dt;
+  applyError(propagatedPoint, stepBelief.state, lastBelief.state);
+  lastBelief.covariance = stepBelief.covariance;
+  lastBelief.sqrtCovariance = stepBelief.sqrtCovariance;
+  if (transitionObserver)
+  {
+    recordPrediction(linearizationPoint, transitionRecord.priorCov,
+                     priorTimeStamp);
+  }
+
+  // Rates of the newest sample, and its acceleration in the inertial frame
+  // with gravity removed, as a per-sample prediction would leave them
+  const QuadState &x = lastBelief.state;
+  lastBelief.state.angular_velocity = lastImuAngVel.template cast<Scalar>()
+      - x.gyro_bias;
+  lastBelief.state.acceleration = x.quaternion.toRotationMatrix()
+      * (lastImuAccel.template cast<Scalar>() - x.accel_bias) - GRAVITY_ACCEL;
 
-  double sum = (lastVec + nextVec).norm();
-  double diff = (lastVec - nextVec).norm();
+  preintegrator.reset();
+}
+
+/*
+ * Feeds an IMU sample to the static initializer while the belief holds
+ * still, and initializes from the window once it is complete.
+ */
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::accumulateStatic(
+    const ImuSample &imu)
+{
+  if (std::isnan(staticInitStart))
+  {
+    staticInitStart = imu.timeStamp;
+  }
+  lastBelief.dt = imu.timeStamp - lastBelief.timeStamp;
+  lastBelief.timeStamp = imu.timeStamp;
+  const bool complete = biasInitializer.add(imu.timeStamp,
+                                            imuAngularVelocity(imu),
+                                            imuAcceleration(imu));
+  if (biasInitializer.numSamples() == 1)
+  {
+    // The window (re)starts here, and so do the poses averaged over it
+    poseAttitudes.reset();
+  }
+  if (complete)
+  {
+    initializeFromStatic();
+  }
+  else if (imu.timeStamp - staticInitStart >= STATIC_INIT_TIMEOUT)
+  {
+    // Never held still: start from the default biases
+    staticInitPending = false;
+  }
+}
 
-  Eigen::Quaterniond out;
-  if (sum > diff)
+/*
+ * Takes the initial biases, or tilt, from a complete static window. The
+ * window's mean is the bias plus gravity; which of the two the
+ * accelerometer's share goes to depends on whether a pose correction has
+ * already fixed the attitude. The bias variances are the window's sample
+ * variances over its length, with their correlations to the rest of the
+ * state dropped.
+ */
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::initializeFromStatic()
+{
+  const int n = biasInitializer.numSamples();
+  QuadState &x = lastBelief.state;
+  const Vector3 meanAccel = biasInitializer.meanAcceleration().template cast<
+      Scalar>();
+  x.gyro_bias = biasInitializer.meanAngularVelocity().template cast<Scalar>();
+  Vector3 gyroBiasVar = biasInitializer.angularVelocityVariance().template cast<
+      Scalar>() / n;
+  Vector3 accelBiasVar = Vector3::Constant(
+      INIT_ACCEL_BIAS_STD * INIT_ACCEL_BIAS_STD);
+  if (attitudeObserved)
   {
-    out.coeffs() = nextVec;
+    // Gravity at the attitude measured over the window, if poses arrived
+    // in it, and at the corrected one otherwise
+    const Quaternion attitude = poseAttitudes.numSamples() > 0 ?
+        poseAttitudes.mean().template cast<Scalar>() : x.quaternion;
+    x.accel_bias = meanAccel - attitude.toRotationMatrix().transpose()
+        * GRAVITY_ACCEL;
+    accelBiasVar = biasInitializer.accelerationVariance().template cast<
+        Scalar>() / n;
   }
   else
   {
-    out.coeffs() = -nextVec;
+    // Smallest rotation of the body that brings gravity onto the mean
+    const Vector3 gravityInBody = x.quaternion.toRotationMatrix()
+        .transpose() * GRAVITY_ACCEL;
+    x.quaternion = x.quaternion
+        * Quaternion::FromTwoVectors(meanAccel, gravityInBody);
+    x.quaternion.normalize();
   }
-  return out;
+  x.velocity.setZero();
+  x.angular_velocity.setZero();
+  x.acceleration.setZero();
+
+  const Scalar minVar = MIN_INIT_BIAS_STD * MIN_INIT_BIAS_STD;
+  StateMatrix &P = lastBelief.covariance;
+  P.template middleRows<6>(GYRO_BIAS_X).setZero();
+  P.template middleCols<6>(GYRO_BIAS_X).setZero();
+  P.diagonal().template segment<3>(GYRO_BIAS_X) =
+      gyroBiasVar.array().max(minVar);
+  P.diagonal().template segment<3>(ACCEL_BIAS_X) =
+      accelBiasVar.array().max(minVar);
+  lastBelief.sqrtCovariance = P.llt().matrixL();
+  staticInitPending = false;
+}
+
+// Adds the bias random walks accumulated over dt to a process covariance
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::addBiasRandomWalks(
+    const double dt, StateMatrix &Q) const
+{
+  Q.diagonal().template segment<3>(GYRO_BIAS_X).array() +=
+      gyroBiasRandomWalk * gyroBiasRandomWalk * dt;
+  Q.diagonal().template segment<3>(ACCEL_BIAS_X).array() +=
+      accelBiasRandomWalk * accelBiasRandomWalk * dt;
 }
 
-geometry_msgs::PoseStamped QuadUkf::quadBeliefToPoseStamped(
-    const QuadUkf::QuadBelief b) const
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::applyPose(const PoseSample &pose)
 {
-  geometry_msgs::PoseStamped p;
-  p.header.stamp.sec = b.timeStamp;
-  p.header.stamp.nsec = (b.timeStamp - floor(b.timeStamp)) * pow(10, 9);
-  p.pose.position.x = b.state.position(0);
-  p.pose.position.y = b.state.position(1);
-  p.pose.position.z = b.state.position(2);
-  p.pose.orientation.w = b.state.quaternion.w();
-  p.pose.orientation.x = b.state.quaternion.x();
-  p.pose.orientation.y = b.state.quaternion.y();
-  p.pose.orientation.z = b.state.quaternion.z();
+  // Pose in filter axes
+  const Eigen::Vector3d position(-pose.position(0), pose.position(1),
+                                 pose.position(2));
+  Eigen::Quaterniond orientation;
+  orientation.x() = pose.orientation.w();
+  orientation.y() = -pose.orientation.z();
+  orientation.z() = pose.orientation.y();
+  orientation.w() = pose.orientation.x();
+  const bool havePosition = position.allFinite();
+  const bool haveAttitude = orientation.coeffs().allFinite();
+  if (haveAttitude)
+  {
+    attitudeObserved = true;
+    if (staticInitPending)
+    {
+      poseAttitudes.add(orientation);
+    }
+  }
+
+  // Pseudovelocity correction, between poses with a position
+  SensorValues values;
+  values.template segment<3>(0) = position;
+  values.template segment<4>(3) = orientation.coeffs();
+  values.template segment<3>(7).setConstant(
+      std::numeric_limits<double>::quiet_NaN());
+  if (havePosition)
+  {
+    double dtPose = pose.timeStamp - lastPoseTimeStamp;
+    values.template segment<3>(7) = (position - lastPosePosition) / dtPose;
+
+    // Update last pose
+    lastPoseTimeStamp = pose.timeStamp;
+    lastPosePosition = position;
+  }
+
+  correctSensor(POSE_SENSOR, values, pose.timeStamp);
 
-  return p;
+  const SensorInnovation &inn = sensors[POSE_SENSOR].innovation;
+  poseInnovation.timeStamp = inn.timeStamp;
+  poseInnovation.residual = inn.residual;
+  poseInnovation.nis = inn.nis;
 }
 
-geometry_msgs::PoseWithCovarianceStamped QuadUkf::quadBeliefToPoseWithCovStamped(
-    const QuadUkf::QuadBelief b) const
+/*
+ * Dead-reckons the belief to timeStamp, without propagating its covariance,
+ * and corrects it with the components of a sensor's measurement that are
+ * present. The model is linearized at the dead-reckoned state, and the
+ * correction runs on the error around it.
+ */
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::correctSensor(
+    const int sensor, const SensorValues &values, const double timeStamp)
 {
-  geometry_msgs::PoseWithCovarianceStamped p;
-  p.header.stamp.sec = b.timeStamp;
-  p.header.stamp.nsec = (b.timeStamp - floor(b.timeStamp)) * pow(10, 9);
-  p.pose.pose.position.x = b.state.position(0);
-  p.pose.pose.position.y = b.state.position(1);
-  p.pose.pose.position.z = b.state.position(2);
-  p.pose.pose.orientation.w = b.state.quaternion.w();
-  p.pose.pose.orientation.x = b.state.quaternion.x();
-  p.pose.pose.orientation.y = b.state.quaternion.y();
-  p.pose.pose.orientation.z = b.state.quaternion.z();
+  // Bring the belief up to the newest IMU sample first
+  flushPreintegration();
+
+  // Set time step "dt".
+  double dt = timeStamp - lastBelief.timeStamp;
 
-  // Copy covariance matrix from b into the covariance array in p
-  Eigen::MatrixXd covMat = b.covariance.block<6, 6>(0, 0);
-  for (int i = 0; i < covMat.rows() * covMat.cols(); ++i)
+  QuadBelief xHat = lastBelief;
+  xHat.state.velocity = lastBelief.state.velocity
+      + lastBelief.state.acceleration * dt;
+  xHat.state.position = (xHat.state.velocity + lastBelief.state.velocity) / 2.0
+      * dt + lastBelief.state.position;
+  const Matrix4 Theta = quatIntegrationMatrix(
+      lastBelief.state.angular_velocity);
+  xHat.state.quaternion.coeffs() = lastBelief.state.quaternion.coeffs()
+      + 0.5 * Theta * lastBelief.state.quaternion.coeffs() * dt;
+  xHat.state.quaternion.normalize();
+
+  // Keep the rows of the components present
+  RegisteredSensor &s = sensors[sensor];
+  PartialSensorVector residual;
+  PartialObservationMatrix H;
+  s.model->linearize(xHat.state, values, residual, H);
+  SelectionVector present;
+  int m = 0;
+  for (int i = 0; i < residual.rows(); ++i)
+  {
+    if (std::isnan(residual(i)))
+    {
+      residual(i) = 0;
+    }
+    else
+    {
+      present(m++) = i;
+    }
+  }
+  if (m == 0)
+  {
+    return;
+  }
+  PartialSensorVector z(m);
+  PartialObservationMatrix Hm(m, numStates);
+  PartialSensorMatrix R(m, m);
+  for (int i = 0; i < m; ++i)
+  {
+    z(i) = residual(present(i));
+    Hm.row(i) = H.row(present(i));
+    for (int j = 0; j < m; ++j)
+    {
+      R(i, j) = s.covariance(present(i), present(j));
+    }
+  }
+
+  if (transitionObserver)
   {
-    p.pose.covariance[i] = covMat(i);
+    recordDeadReckoning(xHat.state, timeStamp);
   }
 
-  return p;
+  stepBelief.state.setZero();
+  stepBelief.covariance = lastBelief.covariance;
+  stepBelief.sqrtCovariance = lastBelief.sqrtCovariance;
+
+  // The predicted error is zero, so the residual is the innovation
+  s.innovation.timeStamp = timeStamp;
+  s.innovation.residual = residual;
+  s.innovation.numComponents = m;
+  s.innovation.nis = correctLinearState(stepBelief, z, Hm, R,
+                                        sequentialUpdates, stepBelief);
+
+  // Update lastBelief.
+  lastBelief.dt = dt;
+  applyError(xHat.state, stepBelief.state, lastBelief.state);
+  lastBelief.covariance = stepBelief.covariance;
+  lastBelief.sqrtCovariance = stepBelief.sqrtCovariance;
+  lastBelief.timeStamp = timeStamp;
 }
 
-Eigen::VectorXd QuadUkf::processFunc(const Eigen::VectorXd x, const double dt)
+/*
+ * Streams the prediction that just moved lastBelief on from prior: the
+ * predicted belief is the new lastBelief, and the cross-covariance comes
+ * from the sigma points around the prior's zero error.
+ */
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::recordPrediction(
+    const QuadState &prior, const StateMatrix &priorCov,
+    const double priorTimeStamp)
 {
-  QuadUkf::QuadState prevState = eigenToQuadState(x);
-  prevState.quaternion.normalize();
-  QuadUkf::QuadState currState;
+  Transition &t = transitionRecord;
+  t.priorTimeStamp = priorTimeStamp;
+  t.timeStamp = lastBelief.timeStamp;
+  t.prior = prior;
+  t.priorCov = priorCov;
+  t.predicted = lastBelief.state;
+  t.predictedCov = lastBelief.covariance;
+  predictionCrossCovariance(StateVector::Zero(), t.crossCov);
+  ++numTransitions;
+  transitionObserver->transition(t);
+}
 
-  // Compute current orientation via quaternion integration.
-  Eigen::MatrixXd Theta = quatIntegrationMatrix(prevState.angular_velocity);
-  currState.quaternion.coeffs() = prevState.quaternion.coeffs()
-      + 0.5 * Theta * prevState.quaternion.coeffs() * dt;
-  currState.quaternion.normalize();
+// Streams the dead reckoning of lastBelief to predicted ahead of a pose
+// correction, which leaves the covariance as it is
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::recordDeadReckoning(
+    const QuadState &predicted, const double timeStamp)
+{
+  Transition &t = transitionRecord;
+  t.priorTimeStamp = lastBelief.timeStamp;
+  t.timeStamp = timeStamp;
+  t.prior = lastBelief.state;
+  t.priorCov = lastBelief.covariance;
+  t.predicted = predicted;
+  t.predictedCov = lastBelief.covariance;
+  t.crossCov = lastBelief.covariance;
+  ++numTransitions;
+  transitionObserver->transition(t);
+}
 
-  // Rotate current and previous accelerations into inertial frame, then
-  // average them.
-  currState.acceleration = prevState.quaternion.toRotationMatrix()
-      * prevState.acceleration;
+/*
+ * Retracts the error sigma point onto the linearization point, propagates
+ * it, and returns its error around the propagated center point.
+ */
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::processFunc(
+    const ConstStateRef &x, const Scalar dt, StateRef out)
+{
+  QuadState prevState, currState;
+  applyError(linearizationPoint, x, prevState);
+  propagateState(prevState, dt, currState);
+  computeError(propagatedPoint, currState, out);
+}
 
-  // Compute current velocity by integrating current acceleration.
-  currState.velocity = prevState.velocity
-      + 0.5 * (lastBelief.state.acceleration + currState.acceleration) * dt;
+// The pose sensor's full measurement, kept in step with the selection
+// declared in the constructor
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::observationFunc(
+    const ConstStateRef &stateVec, SensorRef out)
+{
+  out = stateVec.head(numSensors);
+}
 
-  // Compute current position by integrating current velocity.
-  currState.position = prevState.position
-      + 0.5 * (currState.velocity + prevState.velocity) * dt;
+/*
+ * Same model as processFunc(), evaluated for all sigma points at once. The
+ * points are retracted into a row-major buffer of nominal states so every
+ * state variable is a contiguous array, and the quaternion integration,
+ * rotation and trapezoidal integration are written out as element-wise array
+ * operations that the compiler can vectorize across sigma points.
+ */
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::processBatch(
+    const StateSigmaMatrix &sigmaPts, const Scalar dt, StateSigmaMatrix &out)
+{
+  retractBatch(sigmaPts);
+  if (activePreintegration)
+  {
+    processPreintegratedBatch(dt);
+    localizeBatch(out);
+    return;
+  }
+
+  const SoaNominalMatrix &in = soaNominal;
+  SoaNominalMatrix &next = soaPropagated;
+  const QuadState &x0 = linearizationPoint;
+
+  // The retracted quaternions are already unit length
+  const auto qx = in.row(NOMINAL_QUAT_X).array();
+  const auto qy = in.row(NOMINAL_QUAT_Y).array();
+  const auto qz = in.row(NOMINAL_QUAT_Z).array();
+  const auto qw = in.row(NOMINAL_QUAT_W).array();
+
+  // Rates with each sigma point's own bias error taken out
+  const int BG = NOMINAL_GYRO_BIAS_X, BA = NOMINAL_ACCEL_BIAS_X;
+  const SigmaRow wx = in.row(NOMINAL_ANGVEL_X).array()
+      - (in.row(BG).array() - x0.gyro_bias(0));
+  const SigmaRow wy = in.row(NOMINAL_ANGVEL_X + 1).array()
+      - (in.row(BG + 1).array() - x0.gyro_bias(1));
+  const SigmaRow wz = in.row(NOMINAL_ANGVEL_X + 2).array()
+      - (in.row(BG + 2).array() - x0.gyro_bias(2));
+
+  // q + 0.5 * Theta(w) * q * dt, expanded row by row
+  const PropagationScalar halfDt = 0.5 * dt;
+  SigmaRow nx = qx + halfDt * (wz * qy - wy * qz + wx * qw);
+  SigmaRow ny = qy + halfDt * (wx * qz - wz * qx + wy * qw);
+  SigmaRow nz = qz + halfDt * (wy * qx - wx * qy + wz * qw);
+  SigmaRow nw = qw - halfDt * (wx * qx + wy * qy + wz * qz);
+  const SigmaRow invNextNorm = (nx.square() + ny.square() + nz.square()
+      + nw.square()).rsqrt();
+  next.row(NOMINAL_QUAT_X) = nx * invNextNorm;
+  next.row(NOMINAL_QUAT_Y) = ny * invNextNorm;
+  next.row(NOMINAL_QUAT_Z) = nz * invNextNorm;
+  next.row(NOMINAL_QUAT_W) = nw * invNextNorm;
+
+  // Rotate the body-frame acceleration into the inertial frame with the
+  // previous orientation
+  const SigmaRow ax = in.row(NOMINAL_ACCEL_X).array()
+      - (in.row(BA).array() - x0.accel_bias(0));
+  const SigmaRow ay = in.row(NOMINAL_ACCEL_X + 1).array()
+      - (in.row(BA + 1).array() - x0.accel_bias(1));
+  const SigmaRow az = in.row(NOMINAL_ACCEL_X + 2).array()
+      - (in.row(BA + 2).array() - x0.accel_bias(2));
+  next.row(NOMINAL_ACCEL_X) = (1 - 2 * (qy * qy + qz * qz)) * ax
+      + 2 * (qx * qy - qz * qw) * ay + 2 * (qx * qz + qy * qw) * az;
+  next.row(NOMINAL_ACCEL_X + 1) = 2 * (qx * qy + qz * qw) * ax
+      + (1 - 2 * (qx * qx + qz * qz)) * ay + 2 * (qy * qz - qx * qw) * az;
+  next.row(NOMINAL_ACCEL_X + 2) = 2 * (qx * qz - qy * qw) * ax
+      + 2 * (qy * qz + qx * qw) * ay + (1 - 2 * (qx * qx + qy * qy)) * az;
+
+  // Trapezoidal integration of velocity and position
+  const Vector3 &lastAccel = lastBelief.state.acceleration;
+  for (int i = 0; i < 3; ++i)
+  {
+    next.row(NOMINAL_VEL_X + i) = in.row(NOMINAL_VEL_X + i).array()
+        + halfDt * (lastAccel(i) + next.row(NOMINAL_ACCEL_X + i).array());
+    next.row(NOMINAL_POS_X + i) = in.row(NOMINAL_POS_X + i).array()
+        + halfDt * (next.row(NOMINAL_VEL_X + i).array()
+        + in.row(NOMINAL_VEL_X + i).array());
+  }
+
+  // Angular velocity is assumed to be correct as measured, less the bias.
+  next.row(NOMINAL_ANGVEL_X) = wx;
+  next.row(NOMINAL_ANGVEL_X + 1) = wy;
+  next.row(NOMINAL_ANGVEL_X + 2) = wz;
+  next.template middleRows<6>(BG) = in.template middleRows<6>(BG);
+
+  localizeBatch(out);
+}
+
+/*
+ * processFunc()'s preintegrated branch for all retracted sigma points at
+ * once: q' = q * dq_i, v' = v + R(q) dv_i - g dt,
+ * p' = p + v dt + R(q) dp_i - g dt^2 / 2, with each sigma point's
+ * increments corrected to first order for its bias error.
+ */
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::processPreintegratedBatch(
+    const PropagationScalar dt)
+{
+  const SoaNominalMatrix &in = soaNominal;
+  SoaNominalMatrix &next = soaPropagated;
+  const ImuPreintegrator &imu = *activePreintegration;
+  const QuadState &x0 = linearizationPoint;
+
+  const auto qx = in.row(NOMINAL_QUAT_X).array();
+  const auto qy = in.row(NOMINAL_QUAT_Y).array();
+  const auto qz = in.row(NOMINAL_QUAT_Z).array();
+  const auto qw = in.row(NOMINAL_QUAT_W).array();
+
+  // Bias errors around the biases the increments were integrated with
+  const SoaVectorMatrix dbg = in.template middleRows<3>(NOMINAL_GYRO_BIAS_X)
+      .colwise() - x0.gyro_bias.template cast<PropagationScalar>();
+  const SoaVectorMatrix dba = in.template middleRows<3>(NOMINAL_ACCEL_BIAS_X)
+      .colwise() - x0.accel_bias.template cast<PropagationScalar>();
+
+  // dq_i = dq * [J_rg dbg / 2, 1] / |[J_rg dbg / 2, 1]|
+  const SoaVectorMatrix dtheta = imu.rotationGyroBiasJacobian().template cast<
+      PropagationScalar>() * dbg;
+  const SigmaRow ex = 0.5 * dtheta.row(0).array();
+  const SigmaRow ey = 0.5 * dtheta.row(1).array();
+  const SigmaRow ez = 0.5 * dtheta.row(2).array();
+  const SigmaRow ew = (1 + ex.square() + ey.square() + ez.square()).rsqrt();
+  const Eigen::Quaternion<PropagationScalar> dq =
+      imu.deltaRotation().template cast<PropagationScalar>();
+  const PropagationScalar dx = dq.x(), dy = dq.y(), dz = dq.z(), dw = dq.w();
+  const SigmaRow bx = (dw * ex + dx + dy * ez - dz * ey) * ew;
+  const SigmaRow by = (dw * ey - dx * ez + dy + dz * ex) * ew;
+  const SigmaRow bz = (dw * ez + dx * ey - dy * ex + dz) * ew;
+  const SigmaRow bw = (dw - dx * ex - dy * ey - dz * ez) * ew;
+
+  // Hamilton product q * dq_i of unit quaternions
+  next.row(NOMINAL_QUAT_X) = qw * bx + qx * bw + qy * bz - qz * by;
+  next.row(NOMINAL_QUAT_Y) = qw * by - qx * bz + qy * bw + qz * bx;
+  next.row(NOMINAL_QUAT_Z) = qw * bz + qx * by - qy * bx + qz * bw;
+  next.row(NOMINAL_QUAT_W) = qw * bw - qx * bx - qy * by - qz * bz;
+
+  // Rotate the velocity and position increments into the inertial frame
+  // with the starting orientation
+  SoaVectorMatrix dvi = imu.velocityAccelBiasJacobian().template cast<
+      PropagationScalar>() * dba;
+  dvi.noalias() += imu.velocityGyroBiasJacobian().template cast<
+      PropagationScalar>() * dbg;
+  dvi.colwise() += imu.deltaVelocity().template cast<PropagationScalar>();
+  SoaVectorMatrix dpi = imu.positionAccelBiasJacobian().template cast<
+      PropagationScalar>() * dba;
+  dpi.noalias() += imu.positionGyroBiasJacobian().template cast<
+      PropagationScalar>() * dbg;
+  dpi.colwise() += imu.deltaPosition().template cast<PropagationScalar>();
+  const auto dv0 = dvi.row(0).array(), dv1 = dvi.row(1).array();
+  const auto dv2 = dvi.row(2).array();
+  const auto dp0 = dpi.row(0).array(), dp1 = dpi.row(1).array();
+  const auto dp2 = dpi.row(2).array();
+  const SigmaRow r00 = 1 - 2 * (qy * qy + qz * qz);
+  const SigmaRow r01 = 2 * (qx * qy - qz * qw);
+  const SigmaRow r02 = 2 * (qx * qz + qy * qw);
+  const SigmaRow r10 = 2 * (qx * qy + qz * qw);
+  const SigmaRow r11 = 1 - 2 * (qx * qx + qz * qz);
+  const SigmaRow r12 = 2 * (qy * qz - qx * qw);
+  const SigmaRow r20 = 2 * (qx * qz - qy * qw);
+  const SigmaRow r21 = 2 * (qy * qz + qx * qw);
+  const SigmaRow r22 = 1 - 2 * (qx * qx + qy * qy);
+  const PropagationScalar halfDt2 = 0.5 * dt * dt;
+  const int V = NOMINAL_VEL_X, P = NOMINAL_POS_X;
+  next.row(V) = in.row(V).array() + r00 * dv0 + r01 * dv1 + r02 * dv2
+      - GRAVITY_ACCEL(0) * dt;
+  next.row(V + 1) = in.row(V + 1).array() + r10 * dv0 + r11 * dv1
+      + r12 * dv2 - GRAVITY_ACCEL(1) * dt;
+  next.row(V + 2) = in.row(V + 2).array() + r20 * dv0 + r21 * dv1
+      + r22 * dv2 - GRAVITY_ACCEL(2) * dt;
+  next.row(P) = in.row(P).array() + in.row(V).array() * dt
+      + r00 * dp0 + r01 * dp1 + r02 * dp2 - GRAVITY_ACCEL(0) * halfDt2;
+  next.row(P + 1) = in.row(P + 1).array() + in.row(V + 1).array() * dt
+      + r10 * dp0 + r11 * dp1 + r12 * dp2 - GRAVITY_ACCEL(1) * halfDt2;
+  next.row(P + 2) = in.row(P + 2).array() + in.row(V + 2).array() * dt
+      + r20 * dp0 + r21 * dp1 + r22 * dp2 - GRAVITY_ACCEL(2) * halfDt2;
+
+  // Rates and acceleration are replaced from the newest IMU sample; the
+  // biases are carried over
+  next.template middleRows<12>(NOMINAL_ANGVEL_X) =
+      in.template middleRows<12>(NOMINAL_ANGVEL_X);
+}
 
-  // Angular velocity is assumed to be correct as measured.
-  currState.angular_velocity = prevState.angular_velocity;
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::observationBatch(
+    const StateSigmaMatrix &sigmaPts, SensorSigmaMatrix &out)
+{
+  out = sigmaPts.topRows(numSensors);
+}
+
+/*
+ * applyError() for all sigma points at once: fills soaNominal with the
+ * error sigma points composed onto linearizationPoint.
+ */
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::retractBatch(
+    const StateSigmaMatrix &sigmaPts)
+{
+  const QuadState &x0 = linearizationPoint;
+  soaNominal.resize(NOMINAL_SIZE, sigmaPts.cols());
+  soaPropagated.resize(NOMINAL_SIZE, sigmaPts.cols());
+  for (int i = 0; i < 3; ++i)
+  {
+    soaNominal.row(NOMINAL_POS_X + i) = (sigmaPts.row(POS_X + i).array()
+        + x0.position(i)).template cast<PropagationScalar>();
+    soaNominal.row(NOMINAL_VEL_X + i) = (sigmaPts.row(VEL_X + i).array()
+        + x0.velocity(i)).template cast<PropagationScalar>();
+    soaNominal.row(NOMINAL_ANGVEL_X + i) = (sigmaPts.row(ANGVEL_X + i)
+        .array() + x0.angular_velocity(i)).template cast<PropagationScalar>();
+    soaNominal.row(NOMINAL_ACCEL_X + i) = (sigmaPts.row(ACCEL_X + i).array()
+        + x0.acceleration(i)).template cast<PropagationScalar>();
+    soaNominal.row(NOMINAL_GYRO_BIAS_X + i) = (sigmaPts.row(GYRO_BIAS_X + i)
+        .array() + x0.gyro_bias(i)).template cast<PropagationScalar>();
+    soaNominal.row(NOMINAL_ACCEL_BIAS_X + i) = (sigmaPts.row(ACCEL_BIAS_X + i)
+        .array() + x0.accel_bias(i)).template cast<PropagationScalar>();
+  }
 
-  return quadStateToEigen(currState);
+  // Error quaternions [dtheta / 2, 1] / |[dtheta / 2, 1]|
+  const SigmaRow ex = 0.5 * sigmaPts.row(ATT_X).array().template cast<
+      PropagationScalar>();
+  const SigmaRow ey = 0.5 * sigmaPts.row(ATT_Y).array().template cast<
+      PropagationScalar>();
+  const SigmaRow ez = 0.5 * sigmaPts.row(ATT_Z).array().template cast<
+      PropagationScalar>();
+  const SigmaRow ew = (1 + ex.square() + ey.square() + ez.square()).rsqrt();
+
+  // Hamilton product q0 * dq, with dq scaled to unit length at the end
+  const PropagationScalar ax = x0.quaternion.x(), ay = x0.quaternion.y();
+  const PropagationScalar az = x0.quaternion.z(), aw = x0.quaternion.w();
+  soaNominal.row(NOMINAL_QUAT_X) = (aw * ex + ax + ay * ez - az * ey) * ew;
+  soaNominal.row(NOMINAL_QUAT_Y) = (aw * ey - ax * ez + ay + az * ex) * ew;
+  soaNominal.row(NOMINAL_QUAT_Z) = (aw * ez + ax * ey - ay * ex + az) * ew;
+  soaNominal.row(NOMINAL_QUAT_W) = (aw - ax * ex - ay * ey - az * ez) * ew;
 }
 
-Eigen::VectorXd QuadUkf::observationFunc(const Eigen::VectorXd stateVec)
+/*
+ * computeError() for all sigma points at once: writes the errors of the
+ * propagated states in soaPropagated around propagatedPoint into out.
+ */
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::localizeBatch(
+    StateSigmaMatrix &out)
 {
-  return stateVec.head(numSensors);
+  const QuadState &x0 = propagatedPoint;
+  const SoaNominalMatrix &next = soaPropagated;
+  out.resize(numStates, next.cols());
+  for (int i = 0; i < 3; ++i)
+  {
+    out.row(POS_X + i) = next.row(NOMINAL_POS_X + i).array().template cast<
+        Scalar>() - x0.position(i);
+    out.row(VEL_X + i) = next.row(NOMINAL_VEL_X + i).array().template cast<
+        Scalar>() - x0.velocity(i);
+    out.row(ANGVEL_X + i) = next.row(NOMINAL_ANGVEL_X + i).array()
+        .template cast<Scalar>() - x0.angular_velocity(i);
+    out.row(ACCEL_X + i) = next.row(NOMINAL_ACCEL_X + i).array()
+        .template cast<Scalar>() - x0.acceleration(i);
+    out.row(GYRO_BIAS_X + i) = next.row(NOMINAL_GYRO_BIAS_X + i).array()
+        .template cast<Scalar>() - x0.gyro_bias(i);
+    out.row(ACCEL_BIAS_X + i) = next.row(NOMINAL_ACCEL_BIAS_X + i).array()
+        .template cast<Scalar>() - x0.accel_bias(i);
+  }
+
+  // Hamilton product conj(q0) * q, then dtheta = 2 * vec / w
+  const PropagationScalar cx = -x0.quaternion.x(), cy = -x0.quaternion.y();
+  const PropagationScalar cz = -x0.quaternion.z(), cw = x0.quaternion.w();
+  const auto qx = next.row(NOMINAL_QUAT_X).array();
+  const auto qy = next.row(NOMINAL_QUAT_Y).array();
+  const auto qz = next.row(NOMINAL_QUAT_Z).array();
+  const auto qw = next.row(NOMINAL_QUAT_W).array();
+  const SigmaRow twoOverW = 2 / (cw * qw - cx * qx - cy * qy - cz * qz);
+  out.row(ATT_X) = ((cw * qx + cx * qw + cy * qz - cz * qy) * twoOverW)
+      .template cast<Scalar>();
+  out.row(ATT_Y) = ((cw * qy - cx * qz + cy * qw + cz * qx) * twoOverW)
+      .template cast<Scalar>();
+  out.row(ATT_Z) = ((cw * qz + cx * qy - cy * qx + cz * qw) * twoOverW)
+      .template cast<Scalar>();
 }
 
 /*
  * Given a vector of angular velocities in radians per second, returns the
  * 4-by-4 angular rate integration matrix.
  */
-Eigen::MatrixXd QuadUkf::quatIntegrationMatrix(
-    const Eigen::Vector3d angVel) const
+template<typename Scalar, typename PropagationScalar>
+typename BasicQuadUkf<Scalar, PropagationScalar>::Matrix4
+BasicQuadUkf<Scalar, PropagationScalar>::quatIntegrationMatrix(
+    const Vector3 &angVel) const
 {
-  Eigen::MatrixXd Theta(4, 4);
+  Matrix4 Theta;
 
   // Upper left 3-by-3 block: negative skew-symmetric matrix of vector w
   Theta(0, 0) = 0;
@@ -320,10 +1111,10 @@ Eigen::MatrixXd QuadUkf::quatIntegrationMatrix(
   Theta(2, 2) = 0;
 
   // Bottom left 1-by-3 block: negative transpose of vector w
-  Theta.block<1, 3>(3, 0) = -angVel.transpose();
+  Theta.template block<1, 3>(3, 0) = -angVel.transpose();
 
   // Upper right 3-by-1 block: w
-  Theta.block<3, 1>(0, 3) = angVel;
+  Theta.template block<3, 1>(0, 3) = angVel;
 
   // Bottom right 1-by-1 block: 0
   Theta(3, 3) = 0;
@@ -331,58 +1122,214 @@ Eigen::MatrixXd QuadUkf::quatIntegrationMatrix(
   return Theta;
 }
 
-Eigen::VectorXd QuadUkf::quadStateToEigen(const QuadUkf::QuadState qs) const
+/*
+ * Propagates a nominal state over dt, either by integrating its rates or, in
+ * a preintegrated prediction, by applying the IMU increments. The rates, or
+ * increments, were taken with linearizationPoint's biases, and are corrected
+ * for prev's departure from them.
+ */
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::propagateState(
+    const QuadState &prev, const Scalar dt, QuadState &next) const
 {
-  Eigen::VectorXd x(numStates);
+  const Vector3 dbg = prev.gyro_bias - linearizationPoint.gyro_bias;
+  const Vector3 dba = prev.accel_bias - linearizationPoint.accel_bias;
+  next.gyro_bias = prev.gyro_bias;
+  next.accel_bias = prev.accel_bias;
+  if (activePreintegration)
+  {
+    // Apply the preintegrated increments, which are held in double, adding
+    // gravity in the inertial frame
+    const ImuPreintegrator &imu = *activePreintegration;
+    const Eigen::Vector3d bg = dbg.template cast<double>();
+    const Eigen::Vector3d ba = dba.template cast<double>();
+    const Vector3 dv = (imu.deltaVelocity()
+        + imu.velocityGyroBiasJacobian() * bg
+        + imu.velocityAccelBiasJacobian() * ba).template cast<Scalar>();
+    const Vector3 dp = (imu.deltaPosition()
+        + imu.positionGyroBiasJacobian() * bg
+        + imu.positionAccelBiasJacobian() * ba).template cast<Scalar>();
+    const Matrix3 R = prev.quaternion.toRotationMatrix();
+    next.quaternion = prev.quaternion
+        * imu.deltaRotation().template cast<Scalar>()
+        * errorQuaternion((imu.rotationGyroBiasJacobian() * bg).template cast<
+        Scalar>());
+    next.velocity = prev.velocity + R * dv - GRAVITY_ACCEL * dt;
+    next.position = prev.position + prev.velocity * dt + R * dp
+        - 0.5 * GRAVITY_ACCEL * dt * dt;
+    next.angular_velocity = prev.angular_velocity;
+    next.acceleration = prev.acceleration;
+    return;
+  }
 
-  x(POS_X) = qs.position(0);
-  x(POS_Y) = qs.position(1);
-  x(POS_Z) = qs.position(2);
+  // Compute current orientation via quaternion integration.
+  const Vector3 angVel = prev.angular_velocity - dbg;
+  const Matrix4 Theta = quatIntegrationMatrix(angVel);
+  next.quaternion.coeffs() = prev.quaternion.coeffs()
+      + 0.5 * Theta * prev.quaternion.coeffs() * dt;
+  next.quaternion.normalize();
 
-  x(QUAT_X) = qs.quaternion.x();
-  x(QUAT_Y) = qs.quaternion.y();
-  x(QUAT_Z) = qs.quaternion.z();
-  x(QUAT_W) = qs.quaternion.w();
+  // Rotate the body-frame acceleration into the inertial frame.
+  next.acceleration = prev.quaternion.toRotationMatrix()
+      * (prev.acceleration - dba);
 
-  x(VEL_X) = qs.velocity(0);
-  x(VEL_Y) = qs.velocity(1);
-  x(VEL_Z) = qs.velocity(2);
+  // Compute current velocity by integrating current acceleration.
+  next.velocity = prev.velocity
+      + 0.5 * (lastBelief.state.acceleration + next.acceleration) * dt;
 
-  x(ANGVEL_X) = qs.angular_velocity(0);
-  x(ANGVEL_Y) = qs.angular_velocity(1);
-  x(ANGVEL_Z) = qs.angular_velocity(2);
+  // Compute current position by integrating current velocity.
+  next.position = prev.position + 0.5 * (next.velocity + prev.velocity) * dt;
 
-  x(ACCEL_X) = qs.acceleration(0);
-  x(ACCEL_Y) = qs.acceleration(1);
-  x(ACCEL_Z) = qs.acceleration(2);
+  // Angular velocity is assumed to be correct as measured, less the bias.
+  next.angular_velocity = angVel;
+}
 
-  return x;
+// Composes an error state onto a nominal state
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::applyError(
+    const QuadState &nominal, const ConstStateRef &dx, QuadState &out)
+{
+  out.position = nominal.position + dx.template segment<3>(POS_X);
+  out.quaternion = nominal.quaternion
+      * errorQuaternion(dx.template segment<3>(ATT_X));
+  out.velocity = nominal.velocity + dx.template segment<3>(VEL_X);
+  out.angular_velocity = nominal.angular_velocity
+      + dx.template segment<3>(ANGVEL_X);
+  out.acceleration = nominal.acceleration + dx.template segment<3>(ACCEL_X);
+  out.gyro_bias = nominal.gyro_bias + dx.template segment<3>(GYRO_BIAS_X);
+  out.accel_bias = nominal.accel_bias + dx.template segment<3>(ACCEL_BIAS_X);
 }
 
-QuadUkf::QuadState QuadUkf::eigenToQuadState(const Eigen::VectorXd x) const
+// Inverse of applyError(): the error that takes nominal to qs
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::computeError(
+    const QuadState &nominal, const QuadState &qs, StateRef dx)
 {
-  QuadUkf::QuadState qs;
+  dx.template segment<3>(POS_X) = qs.position - nominal.position;
+  dx.template segment<3>(ATT_X) = errorAngle(nominal.quaternion.conjugate()
+      * qs.quaternion);
+  dx.template segment<3>(VEL_X) = qs.velocity - nominal.velocity;
+  dx.template segment<3>(ANGVEL_X) = qs.angular_velocity
+      - nominal.angular_velocity;
+  dx.template segment<3>(ACCEL_X) = qs.acceleration - nominal.acceleration;
+  dx.template segment<3>(GYRO_BIAS_X) = qs.gyro_bias - nominal.gyro_bias;
+  dx.template segment<3>(ACCEL_BIAS_X) = qs.accel_bias - nominal.accel_bias;
+}
 
-  qs.position(0) = x(POS_X);
-  qs.position(1) = x(POS_Y);
-  qs.position(2) = x(POS_Z);
+// Unit quaternion of a body-frame attitude error in the Rodrigues chart
+template<typename Scalar, typename PropagationScalar>
+typename BasicQuadUkf<Scalar, PropagationScalar>::Quaternion
+BasicQuadUkf<Scalar, PropagationScalar>::errorQuaternion(
+    const Vector3 &dtheta)
+{
+  Quaternion dq(1, 0.5 * dtheta(0), 0.5 * dtheta(1),
+                        0.5 * dtheta(2));
+  dq.normalize();
+  return dq;
+}
 
-  qs.quaternion.x() = x(QUAT_X);
-  qs.quaternion.y() = x(QUAT_Y);
-  qs.quaternion.z() = x(QUAT_Z);
-  qs.quaternion.w() = x(QUAT_W);
+// Inverse of errorQuaternion(). Does not depend on the sign of dq.
+template<typename Scalar, typename PropagationScalar>
+typename BasicQuadUkf<Scalar, PropagationScalar>::Vector3
+BasicQuadUkf<Scalar, PropagationScalar>::errorAngle(
+    const Quaternion &dq)
+{
+  return 2 * dq.vec() / dq.w();
+}
 
-  qs.velocity(0) = x(VEL_X);
-  qs.velocity(1) = x(VEL_Y);
-  qs.velocity(2) = x(VEL_Z);
+template<typename Scalar, typename PropagationScalar>
+int BasicQuadUkf<Scalar, PropagationScalar>::PoseModel::dimension() const
+{
+  return 9;
+}
 
-  qs.angular_velocity(0) = x(ANGVEL_X);
-  qs.angular_velocity(1) = x(ANGVEL_Y);
-  qs.angular_velocity(2) = x(ANGVEL_Z);
+/*
+ * The attitude residual does not depend on the sign of either quaternion,
+ * so no continuity fix is needed.
+ */
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::PoseModel::linearize(
+    const QuadState &nominal, const SensorValues &values,
+    PartialSensorVector &residual, PartialObservationMatrix &H) const
+{
+  const Eigen::Matrix<Scalar, MAX_SENSOR_VALUES, 1> z =
+      values.template cast<Scalar>();
+  const Quaternion orientation(z.template segment<4>(3));
+  residual.resize(9);
+  residual.template segment<3>(POS_X) = z.template head<3>()
+      - nominal.position;
+  residual.template segment<3>(ATT_X) = errorAngle(
+      nominal.quaternion.conjugate() * orientation.normalized());
+  residual.template segment<3>(VEL_X) = z.template segment<3>(7)
+      - nominal.velocity;
+  H = PartialObservationMatrix::Identity(9, ERROR_SIZE);
+}
 
-  qs.acceleration(0) = x(ACCEL_X);
-  qs.acceleration(1) = x(ACCEL_Y);
-  qs.acceleration(2) = x(ACCEL_Z);
+template<typename Scalar, typename PropagationScalar>
+int BasicQuadUkf<Scalar, PropagationScalar>::AltimeterModel::dimension() const
+{
+  return 1;
+}
 
-  return qs;
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::AltimeterModel::linearize(
+    const QuadState &nominal, const SensorValues &values,
+    PartialSensorVector &residual, PartialObservationMatrix &H) const
+{
+  residual.resize(1);
+  residual(0) = values(0) - nominal.position(2);
+  H = PartialObservationMatrix::Zero(1, ERROR_SIZE);
+  H(0, POS_Z) = 1;
 }
+
+template<typename Scalar, typename PropagationScalar>
+int BasicQuadUkf<Scalar, PropagationScalar>::OpticalFlowModel::dimension() const
+{
+  return 2;
+}
+
+/*
+ * h = (R^T v)_xy. With R = R0 Exp(dtheta) and v = v0 + dv, to first order
+ * R^T v = R0^T v0 + [R0^T v0]x dtheta + R0^T dv.
+ */
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::OpticalFlowModel::linearize(
+    const QuadState &nominal, const SensorValues &values,
+    PartialSensorVector &residual, PartialObservationMatrix &H) const
+{
+  const Matrix3 Rt = nominal.quaternion.toRotationMatrix()
+      .transpose();
+  const Vector3 bodyVelocity = Rt * nominal.velocity;
+  Matrix3 skew;
+  skew << 0, -bodyVelocity(2), bodyVelocity(1),
+      bodyVelocity(2), 0, -bodyVelocity(0),
+      -bodyVelocity(1), bodyVelocity(0), 0;
+  residual.resize(2);
+  residual = values.template head<2>().template cast<Scalar>()
+      - bodyVelocity.template head<2>();
+  H = PartialObservationMatrix::Zero(2, ERROR_SIZE);
+  H.template block<2, 3>(0, ATT_X) = skew.template topRows<2>();
+  H.template block<2, 3>(0, VEL_X) = Rt.template topRows<2>();
+}
+
+template<typename Scalar, typename PropagationScalar>
+int BasicQuadUkf<Scalar, PropagationScalar>::PositionModel::dimension() const
+{
+  return 3;
+}
+
+template<typename Scalar, typename PropagationScalar>
+void BasicQuadUkf<Scalar, PropagationScalar>::PositionModel::linearize(
+    const QuadState &nominal, const SensorValues &values,
+    PartialSensorVector &residual, PartialObservationMatrix &H) const
+{
+  residual.resize(3);
+  residual = values.template head<3>().template cast<Scalar>()
+      - nominal.position;
+  H = PartialObservationMatrix::Zero(3, ERROR_SIZE);
+  H.template block<3, 3>(0, POS_X).setIdentity();
+}
+
+template class BasicQuadUkf<double>;
+template class BasicQuadUkf<float>;
+template class BasicQuadUkf<double, float>;
@@ -2,89 +2,573 @@
 #define QUADUKF_H_
 
 #include "UnscentedKf.h"
+#include "CircularBuffer.h"
+#include "ImuPreintegrator.h"
+#include "ImuBiasInitializer.h"
+#include "QuaternionAverager.h"
 
-#include "ros/ros.h"
-#include "geometry_msgs/PoseStamped.h"
-#include "geometry_msgs/PoseWithCovarianceStamped.h"
-#include "geometry_msgs/PoseArray.h"
-#include "sensor_msgs/Imu.h"
-#include "std_msgs/Empty.h"
-
-#include <mutex>
-
-class QuadUkf : public UnscentedKf
+/*
+ * Quadrotor UKF driven by IMU predictions and visual pose corrections. This
+ * class has no ROS dependency; QuadUkfNode adapts it to ROS topics and
+ * kalman_replay drives it from recorded logs.
+ *
+ * The filter is error-state (multiplicative): the belief holds a nominal
+ * QuadState with a unit quaternion, and the UKF runs on the 21-element error
+ * around it, with attitude error as a 3-vector dtheta in the body frame,
+ *   q = q_nominal * [dtheta / 2, 1] / |[dtheta / 2, 1]|
+ * (the Rodrigues chart, valid for rotation errors below 180 degrees). Sigma
+ * points are mapped onto the nominal state by quaternion composition,
+ * propagated, and mapped back into errors around the propagated center
+ * point; the mean error is then folded into the nominal state and reset to
+ * zero. The covariance is 21x21, ordered position, attitude, velocity,
+ * angular velocity, acceleration, gyro bias, accelerometer bias.
+ *
+ * The IMU biases are estimated states. Rates and accelerations enter the
+ * state with the nominal biases subtracted, and each sigma point's bias
+ * error shifts the rates it is propagated with, so pose corrections observe
+ * the biases through the attitude, velocity and position they integrate
+ * into. The biases follow random walks.
+ *
+ * Corrections come from a registry of sensor models. Each declares its own
+ * number of components, its observation of the nominal state and its noise
+ * covariance, and each measurement is applied with only the components it
+ * carries, so a sensor costs in proportion to what it measured and adding
+ * one does not slow the others down. The visual pose is the built-in
+ * POSE_SENSOR; an altimeter, optical flow and a position fix are built in
+ * as well, and further models can be added.
+ *
+ * The filter runs in Scalar precision. The sigma points are propagated by
+ * processBatch() in PropagationScalar, which can be narrower, so that the
+ * bulk of each prediction runs at single precision while the covariance is
+ * still accumulated and factorized in double. Inputs, time stamps and the
+ * IMU preintegration stay in double either way. QuadUkf.cpp instantiates the
+ * double, float and mixed filters typedef'd below.
+ */
+template<typename Scalar, typename PropagationScalar = Scalar>
+class BasicQuadUkf : public UnscentedKf<Scalar, 21, 9>
 {
 public:
-  QuadUkf(ros::Publisher poseStampedPub, ros::Publisher poseWithCovStampedPub,
-          ros::Publisher poseArrayPub);
-  QuadUkf(QuadUkf&& other);
-  ~QuadUkf();
+  typedef UnscentedKf<Scalar, 21, 9> Base;
+  using typename Base::StateVector;
+  using typename Base::StateMatrix;
+  using typename Base::SensorVector;
+  using typename Base::SensorMatrix;
+  using typename Base::StateSigmaMatrix;
+  using typename Base::SensorSigmaMatrix;
+  using typename Base::SelectionVector;
+  using typename Base::PartialSensorVector;
+  using typename Base::PartialSensorMatrix;
+  using typename Base::PartialObservationMatrix;
+  using typename Base::ConstStateRef;
+  using typename Base::StateRef;
+  using typename Base::SensorRef;
+  using typename Base::Belief;
+  using Base::numStates;
+  using Base::numSensors;
 
-  void imuCallback(const sensor_msgs::ImuConstPtr &msg_in);
-  void poseCallback(
-      const geometry_msgs::PoseWithCovarianceStampedConstPtr &msg_in);
+  typedef Eigen::Matrix<Scalar, 3, 1> Vector3;
+  typedef Eigen::Matrix<Scalar, 3, 3> Matrix3;
+  typedef Eigen::Matrix<Scalar, 4, 4> Matrix4;
+  typedef Eigen::Quaternion<Scalar> Quaternion;
 
-  Eigen::VectorXd processFunc(const Eigen::VectorXd stateVec, const double dt);
-  Eigen::VectorXd observationFunc(const Eigen::VectorXd stateVec);
+  // IMU sample in the IMU's own axis convention, as published by the driver
+  struct ImuSample
+  {
+    double timeStamp;
+    Eigen::Vector3d angularVelocity;
+    Eigen::Vector3d linearAcceleration;
+  };
 
-private:
-  struct QuadState
+  // Pose sample in the visual tracker's (PTAM's) axis convention
+  struct PoseSample
   {
+    double timeStamp;
     Eigen::Vector3d position;
-    Eigen::Quaterniond quaternion;
-    Eigen::Vector3d velocity;
-    Eigen::Vector3d angular_velocity;
-    Eigen::Vector3d acceleration;
+    Eigen::Quaterniond orientation;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  struct QuadState
+  {
+    Vector3 position;
+    Quaternion quaternion;
+    Vector3 velocity;
+    Vector3 angular_velocity;
+    Vector3 acceleration;
+    Vector3 gyro_bias;   // in filter axes
+    Vector3 accel_bias;
   };
 
   struct QuadBelief
   {
     double timeStamp;
     double dt;
-    QuadUkf::QuadState state;
-    Eigen::MatrixXd covariance;
-  } lastBelief;
+    QuadState state;
+    StateMatrix covariance;
+    StateMatrix sqrtCovariance;  // maintained by the square-root engine
+  };
+
+  // Sensor registry limits: models registered at once, and values per sample
+  enum
+  {
+    MAX_SENSORS = 8, MAX_SENSOR_VALUES = 10
+  };
+
+  // Ids of the built-in sensor models
+  enum SensorId
+  {
+    POSE_SENSOR = 0, ALTIMETER_SENSOR = 1, OPTICAL_FLOW_SENSOR = 2,
+    POSITION_SENSOR = 3
+  };
+
+  typedef Eigen::Matrix<double, MAX_SENSOR_VALUES, 1> SensorValues;
+
+  /*
+   * Measurement of a registered sensor, with values as its model reads them.
+   * Components the sensor did not deliver are NaN.
+   */
+  struct SensorSample
+  {
+    double timeStamp;
+    int sensor;
+    SensorValues values;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  /*
+   * Observation model of a sensor with dimension() components, at most
+   * NSensors. linearize() writes the residual z - h(nominal) of a sample's
+   * values and the Jacobian of h with respect to the error state at nominal,
+   * one row per component. A component whose residual is NaN, as it is
+   * whenever a value it depends on is NaN, is left out of the correction.
+   */
+  class SensorModel
+  {
+  public:
+    virtual ~SensorModel()
+    {
+    }
+    virtual int dimension() const = 0;
+    virtual void linearize(const QuadState &nominal,
+                           const SensorValues &values,
+                           PartialSensorVector &residual,
+                           PartialObservationMatrix &H) const = 0;
+  };
+
+  // Visual pose in filter axes: position, quaternion (x y z w) and the
+  // pseudovelocity between poses, observed as position, attitude and
+  // velocity errors
+  class PoseModel : public SensorModel
+  {
+  public:
+    int dimension() const;
+    void linearize(const QuadState &nominal, const SensorValues &values,
+                   PartialSensorVector &residual,
+                   PartialObservationMatrix &H) const;
+  };
+
+  // Height above the origin, m
+  class AltimeterModel : public SensorModel
+  {
+  public:
+    int dimension() const;
+    void linearize(const QuadState &nominal, const SensorValues &values,
+                   PartialSensorVector &residual,
+                   PartialObservationMatrix &H) const;
+  };
+
+  // Horizontal velocity in body axes, m/s, as a downward flow sensor
+  // reports it once scaled by height
+  class OpticalFlowModel : public SensorModel
+  {
+  public:
+    int dimension() const;
+    void linearize(const QuadState &nominal, const SensorValues &values,
+                   PartialSensorVector &residual,
+                   PartialObservationMatrix &H) const;
+  };
+
+  // Position fix in filter axes, m, standing in for GPS
+  class PositionModel : public SensorModel
+  {
+  public:
+    int dimension() const;
+    void linearize(const QuadState &nominal, const SensorValues &values,
+                   PartialSensorVector &residual,
+                   PartialObservationMatrix &H) const;
+  };
+
+  /*
+   * Latest correction of a sensor: the residual in its model's components,
+   * zero where absent, the number of components applied and the normalized
+   * innovation squared, chi-squared with that many degrees of freedom for a
+   * consistent filter.
+   */
+  struct SensorInnovation
+  {
+    double timeStamp;
+    PartialSensorVector residual;
+    int numComponents;
+    double nis;
+  };
+
+  /*
+   * Cost of out-of-sequence fusion. A late sample is fused at its own time
+   * stamp by rewinding to the newest history entry before it and replaying
+   * the inputs recorded since, so each one costs at most HISTORY_SIZE filter
+   * steps. Samples older than the whole history are discarded.
+   */
+  struct HistoryStats
+  {
+    long outOfSequence;     // late samples fused by replay
+    long discarded;         // samples older than the history window
+    long replayedSamples;   // filter steps re-run for late samples
+    int maxReplayDepth;     // most steps re-run for a single late sample
+    int historyDepth;       // entries currently held
+    long historyBytes;      // fixed memory held by the history
+  };
+
+  /*
+   * Innovation of the latest pose correction, in error coordinates around
+   * the prediction: position, attitude (rad) and pseudovelocity residuals,
+   * zero where the pose lacked them, and the normalized innovation squared
+   * z^T S^-1 z, which is chi-squared with as many degrees of freedom as
+   * components were applied for a consistent filter.
+   */
+  struct PoseInnovation
+  {
+    double timeStamp;
+    SensorVector residual;
+    double nis;
+  };
+
+  /*
+   * One filter transition from belief k to belief k + 1, for smoothing: the
+   * belief going into the prediction, the predicted belief, and the
+   * cross-covariance between their errors, each error around its own
+   * nominal state. The prior of an IMU prediction carries the sample's rates
+   * in place of the belief's. A pose correction first dead-reckons the
+   * belief without propagating its covariance, which is recorded as a
+   * transition with priorCov = predictedCov = crossCov; the correction
+   * itself shows up as the prior of the next transition.
+   */
+  struct Transition
+  {
+    double priorTimeStamp;
+    double timeStamp;
+    QuadState prior;
+    StateMatrix priorCov;
+    QuadState predicted;
+    StateMatrix predictedCov;
+    StateMatrix crossCov;
+  };
+
+  /*
+   * Receives every transition as it is applied. A late sample rewinds the
+   * filter, and with it the transitions: rewind(count) drops all but the
+   * first count received so far, and the replayed ones follow.
+   */
+  class TransitionObserver
+  {
+  public:
+    virtual ~TransitionObserver()
+    {
+    }
+    virtual void transition(const Transition &t) = 0;
+    virtual void rewind(long count) = 0;
+  };
+
+  // Number of past inputs and beliefs kept for out-of-sequence fusion
+  enum
+  {
+    HISTORY_SIZE = 128
+  };
+
+  BasicQuadUkf(double initTimeStamp = 0);
+  ~BasicQuadUkf();
+
+  void imuUpdate(const ImuSample &imu);
+  // A pose whose position or orientation is NaN corrects only the rest
+  void poseUpdate(const PoseSample &pose);
+  void sensorUpdate(const SensorSample &sample);
+
+  /*
+   * Registers a caller-owned model with noise covariance R, returning its id
+   * for sensorUpdate(), or -1 if the registry is full or R does not match
+   * the model's dimension.
+   */
+  int addSensor(const SensorModel *model, const PartialSensorMatrix &R);
+  void setSensorCovariance(const int sensor, const PartialSensorMatrix &R);
+
+  /*
+   * Applies the components of each measurement one at a time as scalar
+   * updates, which avoids factorizing its innovation covariance. Cheaper
+   * for large measurements with diagonal noise.
+   */
+  void setSequentialUpdates(const bool enable);
+
+  HistoryStats getHistoryStats() const;
+  const PoseInnovation &getPoseInnovation() const;
+  const SensorInnovation &getSensorInnovation(const int sensor) const;
 
+  /*
+   * In preintegration mode IMU samples are accumulated into relative motion
+   * increments instead of each running a sigma point prediction. A single
+   * prediction over the increments runs before every pose correction and,
+   * if outputPeriod > 0, whenever outputPeriod seconds of IMU data have been
+   * accumulated. The belief only advances at those points.
+   */
+  void setImuPreintegration(const bool enable, const double outputPeriod = 0);
+  void setImuNoiseDensities(const double gyroNoise, const double accelNoise);
+
+  // Bias random walk densities, rad/s^2/sqrt(Hz) and m/s^3/sqrt(Hz), added
+  // to the bias block of the process noise in proportion to each step
+  void setImuBiasRandomWalks(const double gyroWalk, const double accelWalk);
+
+  /*
+   * With static initialization, IMU samples do not drive predictions until
+   * the vehicle has held still for window seconds, or STATIC_INIT_TIMEOUT
+   * seconds have passed. The still window's mean rate is taken as the gyro
+   * bias. If pose corrections have fixed the attitude by then, the mean
+   * acceleration's departure from gravity at the poses' mean attitude over
+   * the window is taken as the accelerometer bias; otherwise it levels the
+   * attitude. The belief holds still
+   * meanwhile, and pose corrections are applied as usual.
+   */
+  void setStaticInitialization(const bool enable, const double window = 0.5);
+  bool isInitialized() const;
+
+  const QuadBelief &getBelief() const;
+
+  // Streams the filter's transitions to observer, or stops if it is null.
+  // Set it before the first sample; while it is set, every prediction costs
+  // an extra product for the cross-covariance.
+  void setTransitionObserver(TransitionObserver *observer);
+
+  // Per-step process noise; the bias random walks are added on top
+  void setProcessCovariance(const StateMatrix &Q);
+
+  // scale * I on the motion states and zero on the biases, which take their
+  // process noise from the random walks
+  static StateMatrix scaledProcessCovariance(const double scale);
+
+  // Noise covariance of the pose sensor
+  void setSensorCovariance(const SensorMatrix &R);
+
+  void processFunc(const ConstStateRef &stateVec, const Scalar dt,
+                   StateRef out);
+  void observationFunc(const ConstStateRef &stateVec, SensorRef out);
+  void processBatch(const StateSigmaMatrix &sigmaPts, const Scalar dt,
+                    StateSigmaMatrix &out);
+  void observationBatch(const StateSigmaMatrix &sigmaPts,
+                        SensorSigmaMatrix &out);
+
+  // Error-state algebra, shared with the smoother
+  static void applyError(const QuadState &nominal, const ConstStateRef &dx,
+                         QuadState &out);
+  static void computeError(const QuadState &nominal, const QuadState &qs,
+                           StateRef dx);
+  static Quaternion errorQuaternion(const Vector3 &dtheta);
+  static Vector3 errorAngle(const Quaternion &dq);
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+protected:
+  using Base::workspace;
+
+private:
+  using Base::predictState;
+  using Base::correctLinearState;
+  using Base::predictionCrossCovariance;
+  using Base::setSelectionObservation;
+
+  QuadBelief lastBelief;
+  PoseInnovation poseInnovation;
+
+  // Error state variables. The pose sensor measures the first nine.
   enum stateVars
   {
-    POS_X = 0, POS_Y = 1, POS_Z = 2, QUAT_X = 3, QUAT_Y = 4, QUAT_Z = 5,
-    QUAT_W = 6, VEL_X = 7, VEL_Y = 8, VEL_Z = 9, ANGVEL_X = 10, ANGVEL_Y = 11,
-    ANGVEL_Z = 12, ACCEL_X = 13, ACCEL_Y = 14, ACCEL_Z = 15
+    POS_X = 0, POS_Y = 1, POS_Z = 2, ATT_X = 3, ATT_Y = 4, ATT_Z = 5,
+    VEL_X = 6, VEL_Y = 7, VEL_Z = 8, ANGVEL_X = 9, ANGVEL_Y = 10,
+    ANGVEL_Z = 11, ACCEL_X = 12, ACCEL_Y = 13, ACCEL_Z = 14, GYRO_BIAS_X = 15,
+    GYRO_BIAS_Y = 16, GYRO_BIAS_Z = 17, ACCEL_BIAS_X = 18, ACCEL_BIAS_Y = 19,
+    ACCEL_BIAS_Z = 20, ERROR_SIZE = 21
   };
 
-  Eigen::MatrixXd ProcessCovMatrixQ;
-  Eigen::MatrixXd SensorCovMatrixR;
+  // Rows of the nominal states that the batch process models map sigma
+  // points onto
+  enum nominalVars
+  {
+    NOMINAL_POS_X = 0, NOMINAL_QUAT_X = 3, NOMINAL_QUAT_Y = 4,
+    NOMINAL_QUAT_Z = 5, NOMINAL_QUAT_W = 6, NOMINAL_VEL_X = 7,
+    NOMINAL_ANGVEL_X = 10, NOMINAL_ACCEL_X = 13, NOMINAL_GYRO_BIAS_X = 16,
+    NOMINAL_ACCEL_BIAS_X = 19, NOMINAL_SIZE = 22
+  };
+
+  StateMatrix ProcessCovMatrixQ;
   const double Q_SCALING_COEFF = 0.01;
   const double R_SCALING_COEFF = 0.01;
 
-  geometry_msgs::PoseWithCovarianceStamped lastPoseMsg;
-  geometry_msgs::PoseArray quadPoseArray;
-  const int POSE_ARRAY_SIZE = 10000;  // number of poses to keep for plotting
+  // Registered sensors, the first few of them built in
+  struct RegisteredSensor
+  {
+    const SensorModel *model;
+    PartialSensorMatrix covariance;
+    SensorInnovation innovation;
+  };
+  RegisteredSensor sensors[MAX_SENSORS];
+  int numRegisteredSensors;
+  bool sequentialUpdates;
+  PoseModel poseModel;
+  AltimeterModel altimeterModel;
+  OpticalFlowModel opticalFlowModel;
+  PositionModel positionModel;
 
-  const Eigen::Vector3d GRAVITY_ACCEL {0, 0, -9.81};
+  // Last pose measurement in filter axes, for pseudovelocity corrections
+  double lastPoseTimeStamp;
+  Eigen::Vector3d lastPosePosition;
 
-  std::timed_mutex mtx;
+  const Vector3 GRAVITY_ACCEL {0, 0, Scalar(-9.81)};
+
+  // Default IMU noise densities for preintegration, rad/s/sqrt(Hz) and
+  // m/s^2/sqrt(Hz)
+  const double GYRO_NOISE_DENSITY = 0.005;
+  const double ACCEL_NOISE_DENSITY = 0.05;
+
+  // Default bias random walks, rad/s^2/sqrt(Hz) and m/s^3/sqrt(Hz), and the
+  // initial bias standard deviations, rad/s and m/s^2
+  const double GYRO_BIAS_RANDOM_WALK = 1e-4;
+  const double ACCEL_BIAS_RANDOM_WALK = 1e-3;
+  const double INIT_GYRO_BIAS_STD = 0.02;
+  const double INIT_ACCEL_BIAS_STD = 0.2;
+  double gyroBiasRandomWalk, accelBiasRandomWalk;
+
+  // Static initialization: the largest per-axis spreads of a still window,
+  // rad/s and m/s^2, the longest wait for one, in seconds, and the smallest
+  // bias standard deviations it may leave
+  const double STATIC_GYRO_STD = 0.05;
+  const double STATIC_ACCEL_STD = 0.3;
+  const double STATIC_INIT_TIMEOUT = 5.0;
+  const double MIN_INIT_BIAS_STD = 1e-3;
+  bool staticInitPending;
+  double staticInitStart;
+  bool attitudeObserved;
+  ImuBiasInitializer biasInitializer;
+  QuaternionAverager poseAttitudes;
 
   //Eigen::MatrixXd ProcessCovMatrixQ(const double dt) const;
 
-  ros::Publisher poseStampedPublisher;
-  ros::Publisher poseWithCovStampedPublisher;
-  ros::Publisher poseArrayPublisher;
+  // Caller-owned buffer for the filter steps. Its state is the error, which
+  // is zero going into every step.
+  Belief stepBelief;
+
+  // Nominal state the sigma points of a prediction are spread around, and
+  // the propagated center point that the predicted error is relative to
+  QuadState linearizationPoint;
+  QuadState propagatedPoint;
+
+  // Time stamp of the newest input applied, which the belief lags while IMU
+  // samples are being preintegrated
+  double lastInputTimeStamp;
+
+  // IMU preintegration mode. While a preintegrated prediction runs,
+  // activePreintegration points at the increments and the process model
+  // applies them instead of integrating the state's rates.
+  bool preintegrationEnabled;
+  double preintegrationPeriod;
+  ImuPreintegrator preintegrator;
+  Eigen::Vector3d lastImuAngVel, lastImuAccel;
+  const ImuPreintegrator *activePreintegration;
+  StateMatrix preintegratedQ;
+  StateMatrix stepQ;
 
-  geometry_msgs::PoseStamped quadBeliefToPoseStamped(const QuadBelief qb) const;
-  geometry_msgs::PoseWithCovarianceStamped quadBeliefToPoseWithCovStamped(
-      const QuadBelief qb) const;
-  void publishAllPoseMessages(const QuadBelief qb);
-  void updatePoseArray(const geometry_msgs::PoseWithCovarianceStamped p);
+  // Transitions streamed so far, and the buffer they are assembled in
+  TransitionObserver *transitionObserver;
+  long numTransitions;
+  Transition transitionRecord;
 
-  Eigen::Quaterniond checkQuatContinuity(
-      const Eigen::Quaterniond lastQuat,
-      const Eigen::Quaterniond nextQuat) const;
-  Eigen::MatrixXd quatIntegrationMatrix(const Eigen::Vector3d angVel) const;
+  struct Measurement
+  {
+    enum Type
+    {
+      IMU, POSE, SENSOR
+    } type;
+    ImuSample imu;
+    PoseSample pose;
+    SensorSample sensor;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
 
-  Eigen::VectorXd quadStateToEigen(const QuadUkf::QuadState qs) const;
-  QuadUkf::QuadState eigenToQuadState(const Eigen::VectorXd x) const;
+  // An input and the filter state right after applying it
+  struct HistoryEntry
+  {
+    Measurement input;
+    double timeStamp;
+    QuadBelief belief;
+    double lastPoseTimeStamp;
+    Eigen::Vector3d lastPosePosition;
+    ImuPreintegrator preintegrator;
+    Eigen::Vector3d lastImuAngVel, lastImuAccel;
+    long numTransitions;
+    bool staticInitPending;
+    double staticInitStart;
+    bool attitudeObserved;
+    ImuBiasInitializer biasInitializer;
+    QuaternionAverager poseAttitudes;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  CircularBuffer<HistoryEntry, HISTORY_SIZE> history;
+  CircularBuffer<Measurement, HISTORY_SIZE> replayInputs;
+  HistoryStats historyStats;
+
+  // Row-major nominal states of the sigma points for processBatch(), so
+  // that each state variable is a contiguous array across all sigma points.
+  // Both hold as many columns as the selected sigma point set.
+  typedef Eigen::Matrix<PropagationScalar, NOMINAL_SIZE, Eigen::Dynamic,
+      Eigen::RowMajor, NOMINAL_SIZE, Base::NSigma> SoaNominalMatrix;
+  typedef Eigen::Array<PropagationScalar, 1, Eigen::Dynamic, Eigen::RowMajor,
+      1, Base::NSigma> SigmaRow;
+  typedef Eigen::Matrix<PropagationScalar, 3, Eigen::Dynamic, Eigen::RowMajor,
+      3, Base::NSigma> SoaVectorMatrix;
+  SoaNominalMatrix soaNominal, soaPropagated;
+
+  void applyImu(const ImuSample &imu);
+  void accumulateStatic(const ImuSample &imu);
+  void initializeFromStatic();
+  void addBiasRandomWalks(const double dt, StateMatrix &Q) const;
+  static Eigen::Vector3d imuAngularVelocity(const ImuSample &imu);
+  static Eigen::Vector3d imuAcceleration(const ImuSample &imu);
+  void preintegrateImu(const ImuSample &imu);
+  void flushPreintegration();
+  void processPreintegratedBatch(const PropagationScalar dt);
+  void applyPose(const PoseSample &pose);
+  void correctSensor(const int sensor, const SensorValues &values,
+                     const double timeStamp);
+  void recordPrediction(const QuadState &prior, const StateMatrix &priorCov,
+                        const double priorTimeStamp);
+  void recordDeadReckoning(const QuadState &predicted, const double timeStamp);
+  void applyMeasurement(const Measurement &m);
+  void fuseMeasurement(const Measurement &m, const double timeStamp);
+
+  Matrix4 quatIntegrationMatrix(const Vector3 &angVel) const;
+
+  void propagateState(const QuadState &prev, const Scalar dt,
+                      QuadState &next) const;
+  void retractBatch(const StateSigmaMatrix &sigmaPts);
+  void localizeBatch(StateSigmaMatrix &out);
 };
 
+// The filter in double precision, which the tools and the ROS node run, in
+// single precision, and in double precision with single precision sigma
+// point propagation
+typedef BasicQuadUkf<double> QuadUkf;
+typedef BasicQuadUkf<float> QuadUkfFloat;
+typedef BasicQuadUkf<double, float> QuadUkfMixed;
+
 #endif  // QUADUKF_H_
 
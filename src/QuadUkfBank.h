@@ -0,0 +1,612 @@
+#ifndef QUADUKFBANK_H_
+#define QUADUKFBANK_H_
+
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+// Number of filters processed per SIMD instruction: one double per lane of
+// the widest vector unit the build targets.
+#ifndef KALMAN_SENSE_SIMD_LANES
+#if defined(__AVX512F__)
+#define KALMAN_SENSE_SIMD_LANES 8
+#elif defined(__AVX__)
+#define KALMAN_SENSE_SIMD_LANES 4
+#else
+#define KALMAN_SENSE_SIMD_LANES 2
+#endif
+#endif
+
+/*
+ * Bank of independent QuadUkf filters that are stepped in lockstep.
+ *
+ * Filters are grouped into blocks of W lanes. Within a block every state
+ * element, covariance entry and sigma point coordinate is stored as W
+ * consecutive doubles, one per filter, held in an Eigen::Array so that each
+ * scalar operation of the UKF becomes a single AVX2 (W = 4) or AVX-512
+ * (W = 8) packet instruction. Blocks are independent and are spread over
+ * numThreads worker threads.
+ *
+ * The weights and update equations are those of QuadUkf with the standard
+ * engine. The model is QuadUkf's before it moved to an error state: the
+ * 16-element additive state, with the quaternion filtered componentwise and
+ * normalized in the process model.
+ */
+template<int W = KALMAN_SENSE_SIMD_LANES>
+class QuadUkfBank
+{
+public:
+  enum
+  {
+    LANES = W, NUM_STATES = 16, NUM_SENSORS = 10,
+    NUM_SIGMA = 2 * NUM_STATES + 1
+  };
+
+  typedef Eigen::Matrix<double, NUM_STATES, 1> StateVector;
+  typedef Eigen::Matrix<double, NUM_STATES, NUM_STATES> StateMatrix;
+  typedef Eigen::Matrix<double, NUM_SENSORS, 1> SensorVector;
+  typedef Eigen::Matrix<double, NUM_SENSORS, NUM_SENSORS> SensorMatrix;
+
+  QuadUkfBank(int numFilters, int numThreads = 1);
+
+  int size() const;
+
+  void setBelief(int filter, const StateVector &x, const StateMatrix &P);
+  void getBelief(int filter, StateVector &x, StateMatrix &P) const;
+  void setProcessCovariance(const StateMatrix &Q);
+  void setSensorCovariance(const SensorMatrix &R);
+
+  /*
+   * Loads an IMU sample into a filter's state the way QuadUkf::imuUpdate()
+   * does: the angular velocity and gravity-compensated acceleration replace
+   * the state's, and the previous acceleration is kept for the trapezoidal
+   * velocity integration of the next prediction.
+   */
+  void setImu(int filter, const Eigen::Vector3d &angVel,
+              const Eigen::Vector3d &linearAccel);
+
+  // Predicts every filter forward by its own dt (size() entries).
+  void predictState(const double *dt);
+
+  // Corrects every filter with its own measurement, stored as size()
+  // consecutive NUM_SENSORS-vectors. Filters whose mask entry is zero are
+  // left untouched; a null mask corrects all of them.
+  void correctState(const double *z, const unsigned char *mask = 0);
+
+private:
+  typedef Eigen::Array<double, W, 1> Lanes;
+
+  struct Block
+  {
+    Lanes state[NUM_STATES];
+    Lanes covariance[NUM_STATES][NUM_STATES];
+    Lanes lastAccel[3];
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  // Per-thread scratch space, laid out like Block
+  struct Scratch
+  {
+    Lanes sqrtCov[NUM_STATES][NUM_STATES];
+    Lanes sigmaPts[NUM_SIGMA][NUM_STATES];
+    Lanes propagated[NUM_SIGMA][NUM_STATES];
+    Lanes sensorPts[NUM_SIGMA][NUM_SENSORS];
+    Lanes sensorMean[NUM_SENSORS];
+    Lanes sensorCov[NUM_SENSORS][NUM_SENSORS];
+    Lanes sqrtSensorCov[NUM_SENSORS][NUM_SENSORS];
+    Lanes crossCov[NUM_STATES][NUM_SENSORS];
+    Lanes gain[NUM_STATES][NUM_SENSORS];
+    Lanes innovation[NUM_SENSORS];
+    Lanes dt;
+    Lanes active;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  int numFilters;
+  int numThreads;
+  std::vector<Block, Eigen::aligned_allocator<Block> > blocks;
+  std::vector<Scratch, Eigen::aligned_allocator<Scratch> > scratch;
+
+  double meanWeights[NUM_SIGMA];
+  double covarianceWeights[NUM_SIGMA];
+  double sigmaPointScalingCoeff;
+  double processCov[NUM_STATES][NUM_STATES];
+  double sensorCov[NUM_SENSORS][NUM_SENSORS];
+
+  const Eigen::Vector3d GRAVITY_ACCEL {0, 0, -9.81};
+
+  template<typename Func>
+  void forEachBlock(Func func);
+
+  void predictBlock(Block &b, Scratch &s) const;
+  void correctBlock(Block &b, Scratch &s) const;
+  void computeSigmaPoints(const Block &b, Scratch &s) const;
+  static void processPoint(const Lanes *x, const Lanes *lastAccel,
+                           const Lanes &dt, Lanes *out);
+
+  template<int N>
+  static void cholesky(const Lanes (*A)[N], Lanes (*L)[N]);
+};
+
+template<int W>
+QuadUkfBank<W>::QuadUkfBank(int nFilters, int nThreads) :
+    numFilters(nFilters), numThreads(nThreads < 1 ? 1 : nThreads)
+{
+  blocks.resize((numFilters + W - 1) / W);
+  scratch.resize(numThreads);
+
+  // Same scaled sigma point set as UnscentedKf
+  const double ALPHA = 0.75, BETA = 2, KAPPA = 0;
+  const int n = NUM_STATES;
+  const double lambda = ALPHA * ALPHA * (n + KAPPA) - n;
+  sigmaPointScalingCoeff = std::sqrt(n + lambda);
+  meanWeights[0] = lambda / (n + lambda);
+  for (int i = 1; i < NUM_SIGMA; ++i)
+  {
+    meanWeights[i] = 1 / (2 * (n + lambda));
+  }
+  for (int i = 0; i < NUM_SIGMA; ++i)
+  {
+    covarianceWeights[i] = meanWeights[i];
+  }
+  covarianceWeights[0] += 1 - ALPHA * ALPHA + BETA;
+
+  setProcessCovariance(0.01 * StateMatrix::Identity());
+  setSensorCovariance(0.01 * SensorMatrix::Identity());
+
+  // Every lane, including the padding of the last block, starts from the
+  // same well-conditioned belief as QuadUkf.
+  StateVector x0 = StateVector::Zero();
+  x0(2) = 1;
+  x0(6) = 1;
+  for (size_t k = 0; k < blocks.size(); ++k)
+  {
+    for (int i = 0; i < NUM_STATES; ++i)
+    {
+      blocks[k].state[i].setConstant(x0(i));
+      for (int j = 0; j < NUM_STATES; ++j)
+      {
+        blocks[k].covariance[i][j].setConstant((i == j) ? 0.01 : 0);
+      }
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+      blocks[k].lastAccel[i].setZero();
+    }
+  }
+}
+
+template<int W>
+int QuadUkfBank<W>::size() const
+{
+  return numFilters;
+}
+
+template<int W>
+void QuadUkfBank<W>::setBelief(int filter, const StateVector &x,
+                               const StateMatrix &P)
+{
+  Block &b = blocks[filter / W];
+  const int l = filter % W;
+  for (int i = 0; i < NUM_STATES; ++i)
+  {
+    b.state[i](l) = x(i);
+    for (int j = 0; j < NUM_STATES; ++j)
+    {
+      b.covariance[i][j](l) = P(i, j);
+    }
+  }
+}
+
+template<int W>
+void QuadUkfBank<W>::getBelief(int filter, StateVector &x,
+                               StateMatrix &P) const
+{
+  const Block &b = blocks[filter / W];
+  const int l = filter % W;
+  for (int i = 0; i < NUM_STATES; ++i)
+  {
+    x(i) = b.state[i](l);
+    for (int j = 0; j < NUM_STATES; ++j)
+    {
+      P(i, j) = b.covariance[i][j](l);
+    }
+  }
+}
+
+template<int W>
+void QuadUkfBank<W>::setProcessCovariance(const StateMatrix &Q)
+{
+  for (int i = 0; i < NUM_STATES; ++i)
+  {
+    for (int j = 0; j < NUM_STATES; ++j)
+    {
+      processCov[i][j] = Q(i, j);
+    }
+  }
+}
+
+template<int W>
+void QuadUkfBank<W>::setSensorCovariance(const SensorMatrix &R)
+{
+  for (int i = 0; i < NUM_SENSORS; ++i)
+  {
+    for (int j = 0; j < NUM_SENSORS; ++j)
+    {
+      sensorCov[i][j] = R(i, j);
+    }
+  }
+}
+
+template<int W>
+void QuadUkfBank<W>::setImu(int filter, const Eigen::Vector3d &angVel,
+                            const Eigen::Vector3d &linearAccel)
+{
+  Block &b = blocks[filter / W];
+  const int l = filter % W;
+  Eigen::Quaterniond q(b.state[6](l), b.state[3](l), b.state[4](l),
+                       b.state[5](l));
+  const Eigen::Vector3d accel = linearAccel
+      - q.toRotationMatrix().inverse() * GRAVITY_ACCEL;
+  for (int i = 0; i < 3; ++i)
+  {
+    b.lastAccel[i](l) = b.state[13 + i](l);
+    b.state[10 + i](l) = angVel(i);
+    b.state[13 + i](l) = accel(i);
+  }
+}
+
+template<int W>
+void QuadUkfBank<W>::predictState(const double *dt)
+{
+  forEachBlock([this, dt](int k, Block &b, Scratch &s)
+  {
+    for (int l = 0; l < W; ++l)
+    {
+      const int f = k * W + l;
+      s.dt(l) = (f < numFilters) ? dt[f] : 0;
+    }
+    predictBlock(b, s);
+  });
+}
+
+template<int W>
+void QuadUkfBank<W>::correctState(const double *z, const unsigned char *mask)
+{
+  forEachBlock([this, z, mask](int k, Block &b, Scratch &s)
+  {
+    for (int l = 0; l < W; ++l)
+    {
+      const int f = k * W + l;
+      const bool valid = f < numFilters && (!mask || mask[f]);
+      s.active(l) = valid ? 1 : 0;
+      for (int i = 0; i < NUM_SENSORS; ++i)
+      {
+        // Inactive lanes get their own state as a dummy measurement
+        s.innovation[i](l) = valid ? z[f * NUM_SENSORS + i] : b.state[i](l);
+      }
+    }
+    correctBlock(b, s);
+  });
+}
+
+template<int W>
+template<typename Func>
+void QuadUkfBank<W>::forEachBlock(Func func)
+{
+  const int numBlocks = blocks.size();
+  const int numWorkers = std::min(numThreads, numBlocks);
+  auto work = [this, &func, numBlocks, numWorkers](int t)
+  {
+    for (int k = t; k < numBlocks; k += numWorkers)
+    {
+      func(k, blocks[k], scratch[t]);
+    }
+  };
+
+  if (numWorkers <= 1)
+  {
+    work(0);
+    return;
+  }
+  std::vector<std::thread> workers;
+  for (int t = 1; t < numWorkers; ++t)
+  {
+    workers.push_back(std::thread(work, t));
+  }
+  work(0);
+  for (size_t t = 0; t < workers.size(); ++t)
+  {
+    workers[t].join();
+  }
+}
+
+template<int W>
+void QuadUkfBank<W>::predictBlock(Block &b, Scratch &s) const
+{
+  computeSigmaPoints(b, s);
+  for (int p = 0; p < NUM_SIGMA; ++p)
+  {
+    processPoint(s.sigmaPts[p], b.lastAccel, s.dt, s.propagated[p]);
+  }
+
+  // Weighted mean, then deviations in place
+  for (int i = 0; i < NUM_STATES; ++i)
+  {
+    b.state[i] = meanWeights[0] * s.propagated[0][i];
+  }
+  for (int p = 1; p < NUM_SIGMA; ++p)
+  {
+    for (int i = 0; i < NUM_STATES; ++i)
+    {
+      b.state[i] += meanWeights[p] * s.propagated[p][i];
+    }
+  }
+  for (int p = 0; p < NUM_SIGMA; ++p)
+  {
+    for (int i = 0; i < NUM_STATES; ++i)
+    {
+      s.propagated[p][i] -= b.state[i];
+    }
+  }
+
+  // Covariance, accumulated one sigma point at a time so the 136 entries of
+  // the lower triangle form independent FMA chains, then mirrored.
+  for (int i = 0; i < NUM_STATES; ++i)
+  {
+    for (int j = 0; j <= i; ++j)
+    {
+      b.covariance[i][j].setConstant(processCov[i][j]);
+    }
+  }
+  for (int p = 0; p < NUM_SIGMA; ++p)
+  {
+    const Lanes *d = s.propagated[p];
+    for (int i = 0; i < NUM_STATES; ++i)
+    {
+      const Lanes wd = covarianceWeights[p] * d[i];
+      for (int j = 0; j <= i; ++j)
+      {
+        b.covariance[i][j] += wd * d[j];
+      }
+    }
+  }
+  for (int i = 0; i < NUM_STATES; ++i)
+  {
+    for (int j = 0; j < i; ++j)
+    {
+      b.covariance[j][i] = b.covariance[i][j];
+    }
+  }
+}
+
+template<int W>
+void QuadUkfBank<W>::correctBlock(Block &b, Scratch &s) const
+{
+  computeSigmaPoints(b, s);
+
+  // The observation selects the leading NUM_SENSORS states. Deviations of the
+  // sensor points and of the state points are formed in place.
+  for (int i = 0; i < NUM_SENSORS; ++i)
+  {
+    s.sensorMean[i] = meanWeights[0] * s.sigmaPts[0][i];
+  }
+  for (int p = 1; p < NUM_SIGMA; ++p)
+  {
+    for (int i = 0; i < NUM_SENSORS; ++i)
+    {
+      s.sensorMean[i] += meanWeights[p] * s.sigmaPts[p][i];
+    }
+  }
+  for (int p = 0; p < NUM_SIGMA; ++p)
+  {
+    for (int i = 0; i < NUM_SENSORS; ++i)
+    {
+      s.sensorPts[p][i] = s.sigmaPts[p][i] - s.sensorMean[i];
+    }
+    for (int i = 0; i < NUM_STATES; ++i)
+    {
+      s.sigmaPts[p][i] -= b.state[i];
+    }
+  }
+
+  // Sensor covariance P_zz (lower triangle) and cross-covariance P_xz
+  for (int i = 0; i < NUM_SENSORS; ++i)
+  {
+    for (int j = 0; j <= i; ++j)
+    {
+      s.sensorCov[i][j].setConstant(sensorCov[i][j]);
+    }
+  }
+  for (int i = 0; i < NUM_STATES; ++i)
+  {
+    for (int j = 0; j < NUM_SENSORS; ++j)
+    {
+      s.crossCov[i][j].setZero();
+    }
+  }
+  for (int p = 0; p < NUM_SIGMA; ++p)
+  {
+    const Lanes *dz = s.sensorPts[p];
+    const Lanes *dx = s.sigmaPts[p];
+    for (int i = 0; i < NUM_SENSORS; ++i)
+    {
+      const Lanes wd = covarianceWeights[p] * dz[i];
+      for (int j = 0; j <= i; ++j)
+      {
+        s.sensorCov[i][j] += wd * dz[j];
+      }
+    }
+    for (int i = 0; i < NUM_STATES; ++i)
+    {
+      const Lanes wd = covarianceWeights[p] * dx[i];
+      for (int j = 0; j < NUM_SENSORS; ++j)
+      {
+        s.crossCov[i][j] += wd * dz[j];
+      }
+    }
+  }
+
+  // Gain from K P_zz = P_xz: each row of K is a forward and a back
+  // substitution against the Cholesky factor of P_zz.
+  cholesky<NUM_SENSORS>(s.sensorCov, s.sqrtSensorCov);
+  Lanes invDiag[NUM_SENSORS];
+  for (int i = 0; i < NUM_SENSORS; ++i)
+  {
+    invDiag[i] = s.sqrtSensorCov[i][i].inverse();
+  }
+  for (int r = 0; r < NUM_STATES; ++r)
+  {
+    Lanes *k = s.gain[r];
+    for (int i = 0; i < NUM_SENSORS; ++i)
+    {
+      Lanes acc = s.crossCov[r][i];
+      for (int m = 0; m < i; ++m)
+      {
+        acc -= s.sqrtSensorCov[i][m] * k[m];
+      }
+      k[i] = acc * invDiag[i];
+    }
+    for (int i = NUM_SENSORS - 1; i >= 0; --i)
+    {
+      Lanes acc = k[i];
+      for (int m = i + 1; m < NUM_SENSORS; ++m)
+      {
+        acc -= s.sqrtSensorCov[m][i] * k[m];
+      }
+      k[i] = acc * invDiag[i];
+    }
+  }
+
+  // x += K (z - z_pred), P -= K P_xz^T on the active lanes
+  for (int i = 0; i < NUM_SENSORS; ++i)
+  {
+    s.innovation[i] = s.active * (s.innovation[i] - s.sensorMean[i]);
+  }
+  for (int i = 0; i < NUM_STATES; ++i)
+  {
+    for (int j = 0; j < NUM_SENSORS; ++j)
+    {
+      b.state[i] += s.gain[i][j] * s.innovation[j];
+    }
+  }
+  for (int i = 0; i < NUM_STATES; ++i)
+  {
+    for (int j = 0; j < NUM_STATES; ++j)
+    {
+      Lanes acc = s.gain[i][0] * s.crossCov[j][0];
+      for (int m = 1; m < NUM_SENSORS; ++m)
+      {
+        acc += s.gain[i][m] * s.crossCov[j][m];
+      }
+      b.covariance[i][j] -= s.active * acc;
+    }
+  }
+}
+
+template<int W>
+void QuadUkfBank<W>::computeSigmaPoints(const Block &b, Scratch &s) const
+{
+  cholesky<NUM_STATES>(b.covariance, s.sqrtCov);
+
+  // [x, x + c L, x - c L]
+  const double c = sigmaPointScalingCoeff;
+  for (int i = 0; i < NUM_STATES; ++i)
+  {
+    s.sigmaPts[0][i] = b.state[i];
+  }
+  for (int j = 0; j < NUM_STATES; ++j)
+  {
+    for (int i = 0; i < j; ++i)
+    {
+      s.sigmaPts[1 + j][i] = b.state[i];
+      s.sigmaPts[1 + NUM_STATES + j][i] = b.state[i];
+    }
+    for (int i = j; i < NUM_STATES; ++i)
+    {
+      s.sigmaPts[1 + j][i] = b.state[i] + c * s.sqrtCov[i][j];
+      s.sigmaPts[1 + NUM_STATES + j][i] = b.state[i] - c * s.sqrtCov[i][j];
+    }
+  }
+}
+
+/*
+ * The additive quad process model for one sigma point of W filters. State
+ * indices are position 0-2, quaternion 3-6, velocity 7-9, angular velocity
+ * 10-12 and acceleration 13-15.
+ */
+template<int W>
+void QuadUkfBank<W>::processPoint(const Lanes *x, const Lanes *lastAccel,
+                                  const Lanes &dt, Lanes *out)
+{
+  const Lanes halfDt = 0.5 * dt;
+  const Lanes invNorm = (x[3].square() + x[4].square() + x[5].square()
+      + x[6].square()).rsqrt();
+  const Lanes qx = x[3] * invNorm, qy = x[4] * invNorm;
+  const Lanes qz = x[5] * invNorm, qw = x[6] * invNorm;
+  const Lanes &wx = x[10], &wy = x[11], &wz = x[12];
+
+  const Lanes nx = qx + halfDt * (wz * qy - wy * qz + wx * qw);
+  const Lanes ny = qy + halfDt * (wx * qz - wz * qx + wy * qw);
+  const Lanes nz = qz + halfDt * (wy * qx - wx * qy + wz * qw);
+  const Lanes nw = qw - halfDt * (wx * qx + wy * qy + wz * qz);
+  const Lanes invNextNorm = (nx.square() + ny.square() + nz.square()
+      + nw.square()).rsqrt();
+  out[3] = nx * invNextNorm;
+  out[4] = ny * invNextNorm;
+  out[5] = nz * invNextNorm;
+  out[6] = nw * invNextNorm;
+
+  const Lanes &ax = x[13], &ay = x[14], &az = x[15];
+  out[13] = (1 - 2 * (qy * qy + qz * qz)) * ax + 2 * (qx * qy - qz * qw) * ay
+      + 2 * (qx * qz + qy * qw) * az;
+  out[14] = 2 * (qx * qy + qz * qw) * ax + (1 - 2 * (qx * qx + qz * qz)) * ay
+      + 2 * (qy * qz - qx * qw) * az;
+  out[15] = 2 * (qx * qz - qy * qw) * ax + 2 * (qy * qz + qx * qw) * ay
+      + (1 - 2 * (qx * qx + qy * qy)) * az;
+
+  for (int i = 0; i < 3; ++i)
+  {
+    out[7 + i] = x[7 + i] + halfDt * (lastAccel[i] + out[13 + i]);
+    out[i] = x[i] + halfDt * (out[7 + i] + x[7 + i]);
+    out[10 + i] = x[10 + i];
+  }
+}
+
+/*
+ * Lane-wise Cholesky factorization A = L L^T. Only the lower triangle of L is
+ * written.
+ */
+template<int W>
+template<int N>
+void QuadUkfBank<W>::cholesky(const Lanes (*A)[N], Lanes (*L)[N])
+{
+  for (int j = 0; j < N; ++j)
+  {
+    Lanes diag = A[j][j];
+    for (int k = 0; k < j; ++k)
+    {
+      diag -= L[j][k].square();
+    }
+    L[j][j] = diag.sqrt();
+    const Lanes invDiag = L[j][j].inverse();
+
+    for (int i = j + 1; i < N; ++i)
+    {
+      Lanes acc = A[i][j];
+      for (int k = 0; k < j; ++k)
+      {
+        acc -= L[i][k] * L[j][k];
+      }
+      L[i][j] = acc * invDiag;
+    }
+  }
+}
+
+#endif  // QUADUKFBANK_H_
@@ -0,0 +1,184 @@
+#include "QuadUkfNode.h"
+
+#include <chrono>
+
+namespace
+{
+
+// Raises a high-water mark to depth
+void updateMax(std::atomic<long> &maxDepth, long depth)
+{
+  long seen = maxDepth.load(std::memory_order_relaxed);
+  while (depth > seen
+      && !maxDepth.compare_exchange_weak(seen, depth,
+                                         std::memory_order_relaxed))
+  {
+  }
+}
+
+}
+
+QuadUkfNode::QuadUkfNode(ros::Publisher poseStampedPub,
+                         ros::Publisher poseWithCovStampedPub,
+                         ros::Publisher poseArrayPub,
+                         const PosePublisher::Options &publishOptions) :
+    ukf(ros::Time::now().toSec()),
+    publisher(poseStampedPub, poseWithCovStampedPub, poseArrayPub,
+              publishOptions), imuReceived(0), imuDropped(0),
+    poseReceived(0), poseDropped(0), maxImuQueueDepth(0),
+    maxPoseQueueDepth(0), lastPublishedTimeStamp(-1), running(true)
+{
+  filterThread = std::thread(&QuadUkfNode::runFilter, this);
+}
+
+QuadUkfNode::~QuadUkfNode()
+{
+  running = false;
+  filterThread.join();
+  trajectoryLog.close();
+}
+
+QuadUkf &QuadUkfNode::filter()
+{
+  return ukf;
+}
+
+bool QuadUkfNode::openTrajectoryLog(const std::string &path)
+{
+  return trajectoryLog.open(path);
+}
+
+const std::string &QuadUkfNode::trajectoryLogError() const
+{
+  return trajectoryLog.error();
+}
+
+QuadUkfNode::IngestStats QuadUkfNode::getIngestStats() const
+{
+  IngestStats stats;
+  stats.imuReceived = imuReceived;
+  stats.imuDropped = imuDropped;
+  stats.poseReceived = poseReceived;
+  stats.poseDropped = poseDropped;
+  stats.imuQueueDepth = imuQueue.size();
+  stats.poseQueueDepth = poseQueue.size();
+  stats.maxImuQueueDepth = maxImuQueueDepth;
+  stats.maxPoseQueueDepth = maxPoseQueueDepth;
+  stats.beliefsDropped = publisher.droppedBeliefs();
+  stats.beliefsLogged = trajectoryLog.writtenBeliefs();
+  stats.beliefsNotLogged = trajectoryLog.droppedBeliefs();
+  return stats;
+}
+
+void QuadUkfNode::imuCallback(const sensor_msgs::ImuConstPtr &msg_in)
+{
+  QueuedImu queued;
+  {
+    LATENCY_SCOPE(CONVERSION);
+    QuadUkf::ImuSample &imu = queued.sample;
+    imu.timeStamp = msg_in->header.stamp.toSec();
+    imu.angularVelocity << msg_in->angular_velocity.x,
+        msg_in->angular_velocity.y, msg_in->angular_velocity.z;
+    imu.linearAcceleration << msg_in->linear_acceleration.x,
+        msg_in->linear_acceleration.y, msg_in->linear_acceleration.z;
+  }
+
+  imuReceived.fetch_add(1, std::memory_order_relaxed);
+  queued.enqueued = LatencyProbes::now();
+  if (!imuQueue.push(queued))
+  {
+    imuDropped.fetch_add(1, std::memory_order_relaxed);
+  }
+  updateMax(maxImuQueueDepth, imuQueue.size());
+}
+
+void QuadUkfNode::poseCallback(
+    const geometry_msgs::PoseWithCovarianceStampedConstPtr &msg_in)
+{
+  QueuedPose queued;
+  {
+    LATENCY_SCOPE(CONVERSION);
+    QuadUkf::PoseSample &pose = queued.sample;
+    pose.timeStamp = msg_in->header.stamp.toSec();
+    pose.position << msg_in->pose.pose.position.x,
+        msg_in->pose.pose.position.y, msg_in->pose.pose.position.z;
+    pose.orientation.x() = msg_in->pose.pose.orientation.x;
+    pose.orientation.y() = msg_in->pose.pose.orientation.y;
+    pose.orientation.z() = msg_in->pose.pose.orientation.z;
+    pose.orientation.w() = msg_in->pose.pose.orientation.w;
+  }
+
+  poseReceived.fetch_add(1, std::memory_order_relaxed);
+  queued.enqueued = LatencyProbes::now();
+  if (!poseQueue.push(queued))
+  {
+    poseDropped.fetch_add(1, std::memory_order_relaxed);
+  }
+  updateMax(maxPoseQueueDepth, poseQueue.size());
+}
+
+/*
+ * Filter thread main loop. Spins briefly when the queues run dry, then backs
+ * off to short sleeps so an idle node does not burn a core.
+ */
+void QuadUkfNode::runFilter()
+{
+  int idlePolls = 0;
+  while (running.load(std::memory_order_relaxed))
+  {
+    if (processNextSample())
+    {
+      idlePolls = 0;
+    }
+    else if (++idlePolls < 100)
+    {
+      std::this_thread::yield();
+    }
+    else
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  }
+}
+
+/*
+ * Applies the oldest queued sample across both queues to the filter and
+ * posts the new belief for publishing. Returns false if both queues are empty.
+ */
+bool QuadUkfNode::processNextSample()
+{
+  const QueuedImu *imu = imuQueue.front();
+  const QueuedPose *pose = poseQueue.front();
+  bool isPose = false;
+  if (imu && (!pose || imu->sample.timeStamp <= pose->sample.timeStamp))
+  {
+    LatencyProbes::recordSince(LatencyProbes::QUEUE_WAIT, imu->enqueued);
+    ukf.imuUpdate(imu->sample);
+    imuQueue.pop();
+  }
+  else if (pose)
+  {
+    LatencyProbes::recordSince(LatencyProbes::QUEUE_WAIT, pose->enqueued);
+    ukf.poseUpdate(pose->sample);
+    poseQueue.pop();
+    isPose = true;
+  }
+  else
+  {
+    return false;
+  }
+
+  // With IMU preintegration the belief only advances at pose corrections and
+  // output periods, so unchanged beliefs are not republished
+  const QuadUkf::QuadBelief &belief = ukf.getBelief();
+  if (isPose || belief.timeStamp != lastPublishedTimeStamp)
+  {
+    lastPublishedTimeStamp = belief.timeStamp;
+    publisher.post(belief);
+    if (trajectoryLog.isOpen())
+    {
+      trajectoryLog.post(belief);
+    }
+  }
+  return true;
+}
@@ -0,0 +1,104 @@
+#ifndef QUADUKFNODE_H_
+#define QUADUKFNODE_H_
+
+#include "QuadUkf.h"
+#include "LatencyProbes.h"
+#include "PosePublisher.h"
+#include "SpscRingBuffer.h"
+#include "TrajectoryLog.h"
+
+#include "ros/ros.h"
+#include "geometry_msgs/PoseWithCovarianceStamped.h"
+#include "sensor_msgs/Imu.h"
+
+#include <atomic>
+#include <thread>
+
+/*
+ * ROS adapter around QuadUkf. The subscriber callbacks only convert each
+ * message into a filter sample and push it onto a lock-free queue; a
+ * dedicated filter thread drains both queues in time stamp order, runs the
+ * filter and hands each new belief to a PosePublisher, which publishes from
+ * its own thread, and optionally to a TrajectoryLogWriter, which records it
+ * from another. Each queue has a single
+ * producer because roscpp never runs one subscription's callback
+ * concurrently with itself.
+ */
+class QuadUkfNode
+{
+public:
+  // Ingestion counters, readable from any thread
+  struct IngestStats
+  {
+    long imuReceived;
+    long imuDropped;
+    long poseReceived;
+    long poseDropped;
+    long imuQueueDepth;
+    long poseQueueDepth;
+    long maxImuQueueDepth;
+    long maxPoseQueueDepth;
+    long beliefsDropped;  // beliefs the publisher had no room for
+    long beliefsLogged;   // beliefs written to the trajectory log
+    long beliefsNotLogged;  // beliefs the trajectory log had no room for
+  };
+
+  QuadUkfNode(ros::Publisher poseStampedPub,
+              ros::Publisher poseWithCovStampedPub,
+              ros::Publisher poseArrayPub,
+              const PosePublisher::Options &publishOptions =
+                  PosePublisher::Options());
+  ~QuadUkfNode();
+
+  void imuCallback(const sensor_msgs::ImuConstPtr &msg_in);
+  void poseCallback(
+      const geometry_msgs::PoseWithCovarianceStampedConstPtr &msg_in);
+
+  // Configure the filter before the first message arrives; afterwards it is
+  // owned by the filter thread.
+  QuadUkf &filter();
+
+  // Records every belief to a binary trajectory log at path. Like filter(),
+  // call it before the first message arrives.
+  bool openTrajectoryLog(const std::string &path);
+  const std::string &trajectoryLogError() const;
+
+  IngestStats getIngestStats() const;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  QuadUkf ukf;
+  PosePublisher publisher;
+  TrajectoryLogWriter trajectoryLog;
+
+  // Queued samples, stamped on entry for the queue wait probe
+  struct QueuedImu
+  {
+    QuadUkf::ImuSample sample;
+    LatencyProbes::Stamp enqueued;
+  };
+  struct QueuedPose
+  {
+    QuadUkf::PoseSample sample;
+    LatencyProbes::Stamp enqueued;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  // Measurement queues, filled by the callbacks and drained by filterThread
+  SpscRingBuffer<QueuedImu, 1024> imuQueue;
+  SpscRingBuffer<QueuedPose, 128> poseQueue;
+  std::atomic<long> imuReceived, imuDropped, poseReceived, poseDropped;
+  std::atomic<long> maxImuQueueDepth, maxPoseQueueDepth;
+
+  double lastPublishedTimeStamp;
+
+  std::atomic<bool> running;
+  std::thread filterThread;
+
+  void runFilter();
+  bool processNextSample();
+};
+
+#endif  // QUADUKFNODE_H_
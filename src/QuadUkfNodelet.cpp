@@ -0,0 +1,28 @@
+#include "QuadUkfRunner.h"
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include <boost/scoped_ptr.hpp>
+
+/*
+ * QuadUkf as a nodelet. Loaded into the same manager as the IMU driver, the
+ * VSLAM node and the controller, its subscriptions receive the publishers'
+ * message pointers and its estimates reach the controller the same way, with
+ * no serialization or TCPROS hop in between. It publishes a fresh shared
+ * message for every estimate by default, since roscpp only passes a message
+ * by pointer if the publisher never touches it again.
+ */
+class QuadUkfNodelet : public nodelet::Nodelet
+{
+private:
+  boost::scoped_ptr<QuadUkfRunner> runner;
+
+  virtual void onInit()
+  {
+    runner.reset(new QuadUkfRunner(getNodeHandle(), getPrivateNodeHandle(),
+                                   true));
+  }
+};
+
+PLUGINLIB_EXPORT_CLASS(QuadUkfNodelet, nodelet::Nodelet)
@@ -0,0 +1,215 @@
+#include "QuadUkfRunner.h"
+
+#include <csignal>
+#include <cstdio>
+
+namespace
+{
+
+// Set by SIGUSR1 and polled from a timer, which prints the latency report
+volatile std::sig_atomic_t latencyReportRequested = 0;
+
+void requestLatencyReport(int)
+{
+  latencyReportRequested = 1;
+}
+
+}
+
+QuadUkfRunner::QuadUkfRunner(ros::NodeHandle nh, ros::NodeHandle privateNh,
+                             const bool zeroCopyDefault) :
+    nh(nh), quadNode(0)
+{
+  poseStampedPub = nh.advertise<geometry_msgs::PoseStamped>("pose", 1000);
+  poseWithCovStampedPub = nh.advertise<
+      geometry_msgs::PoseWithCovarianceStamped>("poseWithCov", 1000);
+  poseArrayPub = nh.advertise<geometry_msgs::PoseArray>("poseHistory", 1);
+
+  quadNode = new QuadUkfNode(poseStampedPub, poseWithCovStampedPub,
+                             poseArrayPub,
+                             loadPublishOptions(privateNh, zeroCopyDefault));
+  configureFilter(privateNh);
+
+  // Deep subscriber queues so bursts are buffered by roscpp rather than
+  // dropped; the callbacks themselves only enqueue.
+  int imuQueueSize, poseQueueSize;
+  privateNh.param("imu_queue_size", imuQueueSize, 1000);
+  privateNh.param("pose_queue_size", poseQueueSize, 100);
+  imuSub = nh.subscribe("/imu/data_raw", imuQueueSize,
+                        &QuadUkfNode::imuCallback, quadNode,
+                        ros::TransportHints().tcpNoDelay());
+  poseSub = nh.subscribe("/vslam/pose", poseQueueSize,
+                         &QuadUkfNode::poseCallback, quadNode,
+                         ros::TransportHints().tcpNoDelay());
+
+  // Report ingestion health
+  statsTimer = nh.createWallTimer(ros::WallDuration(10.0),
+                                  &QuadUkfRunner::reportIngestStats, this);
+
+  if (LatencyProbes::enabled())
+  {
+    startLatencyReports(privateNh);
+  }
+}
+
+QuadUkfRunner::~QuadUkfRunner()
+{
+  // Stop callbacks into the node before it goes away
+  imuSub.shutdown();
+  poseSub.shutdown();
+  statsTimer.stop();
+  diagnosticsTimer.stop();
+  latencyReportTimer.stop();
+  delete quadNode;
+}
+
+QuadUkfNode &QuadUkfRunner::node()
+{
+  return *quadNode;
+}
+
+// Per-topic publishing rates in Hz (0: every belief) and trajectory
+// decimation for the pose history
+PosePublisher::Options QuadUkfRunner::loadPublishOptions(
+    ros::NodeHandle &privateNh, const bool zeroCopyDefault)
+{
+  PosePublisher::Options options;
+  privateNh.param("pose_rate", options.poseRate, options.poseRate);
+  privateNh.param("pose_with_cov_rate", options.poseWithCovRate,
+                  options.poseWithCovRate);
+  privateNh.param("pose_history_rate", options.poseArrayRate,
+                  options.poseArrayRate);
+  privateNh.param("pose_history_decimation", options.poseArrayDecimation,
+                  options.poseArrayDecimation);
+  privateNh.param("zero_copy_publish", options.sharedMessages,
+                  zeroCopyDefault);
+  return options;
+}
+
+void QuadUkfRunner::configureFilter(ros::NodeHandle &privateNh)
+{
+  // Select the covariance propagation engine
+  bool useSquareRootUkf;
+  privateNh.param("square_root_ukf", useSquareRootUkf, false);
+  if (useSquareRootUkf)
+  {
+    quadNode->filter().setEngine(QuadUkf::SQUARE_ROOT_UKF);
+  }
+
+  // Preintegrate IMU samples between pose corrections; a negative period
+  // keeps one prediction per IMU sample
+  double preintegrationPeriod;
+  privateNh.param("imu_preintegration_period", preintegrationPeriod, -1.0);
+  if (preintegrationPeriod >= 0)
+  {
+    quadNode->filter().setImuPreintegration(true, preintegrationPeriod);
+  }
+
+  // IMU noise characterized offline by kalman_imu_noise
+  double gyroValue, accelValue;
+  if (privateNh.getParam("gyro_noise_density", gyroValue)
+      && privateNh.getParam("accel_noise_density", accelValue))
+  {
+    quadNode->filter().setImuNoiseDensities(gyroValue, accelValue);
+  }
+  if (privateNh.getParam("gyro_bias_random_walk", gyroValue)
+      && privateNh.getParam("accel_bias_random_walk", accelValue))
+  {
+    quadNode->filter().setImuBiasRandomWalks(gyroValue, accelValue);
+  }
+
+  // Take the initial IMU biases from the first still window, in place of a
+  // separate calibration run
+  double staticInitWindow;
+  privateNh.param("static_init_window", staticInitWindow, 0.5);
+  if (staticInitWindow >= 0)
+  {
+    quadNode->filter().setStaticInitialization(true, staticInitWindow);
+  }
+
+  // Full-rate record of the estimates, read back with kalman_trajectory
+  std::string trajectoryLogPath;
+  privateNh.param("trajectory_log", trajectoryLogPath, std::string());
+  if (!trajectoryLogPath.empty()
+      && !quadNode->openTrajectoryLog(trajectoryLogPath))
+  {
+    ROS_ERROR("trajectory log: %s",
+              quadNode->trajectoryLogError().c_str());
+  }
+}
+
+/*
+ * Hot path latency, when built with KALMAN_SENSE_LATENCY_PROBES: published
+ * on /diagnostics every latency_report_period seconds, and printed to stderr
+ * on SIGUSR1
+ */
+void QuadUkfRunner::startLatencyReports(ros::NodeHandle &privateNh)
+{
+  double latencyReportPeriod;
+  privateNh.param("latency_report_period", latencyReportPeriod, 5.0);
+  diagnosticsPub = nh.advertise<diagnostic_msgs::DiagnosticArray>(
+      "/diagnostics", 10);
+  diagnosticsTimer = nh.createWallTimer(
+      ros::WallDuration(latencyReportPeriod),
+      &QuadUkfRunner::publishLatencyDiagnostics, this);
+
+  std::signal(SIGUSR1, requestLatencyReport);
+  latencyReportTimer = nh.createWallTimer(
+      ros::WallDuration(0.5), &QuadUkfRunner::printRequestedLatencyReport);
+}
+
+void QuadUkfRunner::reportIngestStats(const ros::WallTimerEvent &)
+{
+  const QuadUkfNode::IngestStats s = quadNode->getIngestStats();
+  ROS_INFO("imu: %ld received, %ld dropped, depth %ld (max %ld); "
+           "pose: %ld received, %ld dropped, depth %ld (max %ld); "
+           "%ld beliefs not published, %ld logged, %ld not logged",
+           s.imuReceived, s.imuDropped, s.imuQueueDepth, s.maxImuQueueDepth,
+           s.poseReceived, s.poseDropped, s.poseQueueDepth,
+           s.maxPoseQueueDepth, s.beliefsDropped, s.beliefsLogged,
+           s.beliefsNotLogged);
+}
+
+// One diagnostic status per hot path stage, values in microseconds
+void QuadUkfRunner::publishLatencyDiagnostics(const ros::WallTimerEvent &)
+{
+  diagnostic_msgs::DiagnosticArray &msg = diagnosticsMsg;
+  msg.header.stamp = ros::Time::now();
+  msg.status.resize(LatencyProbes::NUM_STAGES);
+  for (int i = 0; i < LatencyProbes::NUM_STAGES; ++i)
+  {
+    const LatencyProbes::Stage stage = LatencyProbes::Stage(i);
+    const LatencyHistogram::Summary s =
+        LatencyProbes::histogram(stage).summarize();
+    diagnostic_msgs::DiagnosticStatus &status = msg.status[i];
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = std::string("kalman_sense/latency/")
+        + LatencyProbes::stageName(stage);
+    status.hardware_id = "kalman_sense";
+    status.message = "latency in us";
+
+    const char *keys[] = {"count", "mean", "p50", "p90", "p99", "p99.9",
+                          "max"};
+    const double values[] = {double(s.count), s.meanNs / 1e3, s.p50Ns / 1e3,
+                             s.p90Ns / 1e3, s.p99Ns / 1e3, s.p999Ns / 1e3,
+                             s.maxNs / 1e3};
+    status.values.resize(7);
+    for (int k = 0; k < 7; ++k)
+    {
+      char value[32];
+      std::snprintf(value, sizeof(value), "%.2f", values[k]);
+      status.values[k].key = keys[k];
+      status.values[k].value = value;
+    }
+  }
+  diagnosticsPub.publish(msg);
+}
+
+void QuadUkfRunner::printRequestedLatencyReport(const ros::WallTimerEvent &)
+{
+  if (latencyReportRequested)
+  {
+    latencyReportRequested = 0;
+    LatencyProbes::writeReport(stderr);
+  }
+}
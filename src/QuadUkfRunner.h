@@ -0,0 +1,65 @@
+#ifndef QUADUKFRUNNER_H_
+#define QUADUKFRUNNER_H_
+
+#include "QuadUkfNode.h"
+
+#include "diagnostic_msgs/DiagnosticArray.h"
+
+/*
+ * Wires a QuadUkfNode to its topics, parameters and report timers. The
+ * standalone node and the nodelet both run the filter through one of these;
+ * the nodelet passes its manager's node handles, so co-located publishers
+ * and subscribers exchange message pointers instead of serialized copies.
+ *
+ * Private parameters:
+ *   pose_rate, pose_with_cov_rate, pose_history_rate   Hz, 0: every belief
+ *   pose_history_decimation     keep every Nth belief in the pose history;
+ *                               a negative pose_history_rate turns it off
+ *   trajectory_log              file to record every belief to, in full
+ *   zero_copy_publish           publish a fresh shared message every time
+ *   square_root_ukf             use the square-root engine
+ *   imu_preintegration_period   seconds; negative: predict per IMU sample
+ *   static_init_window          seconds of still IMU data the initial biases
+ *                               are taken from (default 0.5); negative: none
+ *   gyro_noise_density, accel_noise_density        IMU white noise, as
+ *   gyro_bias_random_walk, accel_bias_random_walk  printed by
+ *                               kalman_imu_noise; each pair is applied only
+ *                               when both are set
+ *   imu_queue_size, pose_queue_size   subscriber queue depths
+ *   latency_report_period       seconds between /diagnostics latency reports
+ */
+class QuadUkfRunner
+{
+public:
+  QuadUkfRunner(ros::NodeHandle nh, ros::NodeHandle privateNh,
+                const bool zeroCopyDefault);
+  ~QuadUkfRunner();
+
+  QuadUkfNode &node();
+
+private:
+  ros::NodeHandle nh;
+  ros::Publisher poseStampedPub;
+  ros::Publisher poseWithCovStampedPub;
+  ros::Publisher poseArrayPub;
+  ros::Publisher diagnosticsPub;
+  diagnostic_msgs::DiagnosticArray diagnosticsMsg;
+
+  // The node owns the filter and publisher threads; it is created after the
+  // publishers and destroyed before them
+  QuadUkfNode *quadNode;
+
+  ros::Subscriber imuSub;
+  ros::Subscriber poseSub;
+  ros::WallTimer statsTimer, diagnosticsTimer, latencyReportTimer;
+
+  static PosePublisher::Options loadPublishOptions(
+      ros::NodeHandle &privateNh, const bool zeroCopyDefault);
+  void configureFilter(ros::NodeHandle &privateNh);
+  void startLatencyReports(ros::NodeHandle &privateNh);
+  void reportIngestStats(const ros::WallTimerEvent &event);
+  void publishLatencyDiagnostics(const ros::WallTimerEvent &event);
+  static void printRequestedLatencyReport(const ros::WallTimerEvent &event);
+};
+
+#endif  // QUADUKFRUNNER_H_
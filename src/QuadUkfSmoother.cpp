@@ -0,0 +1,146 @@
+#include "QuadUkfSmoother.h"
+
+namespace
+{
+
+const char STEP_MAGIC[8] = {'K', 'S', 'R', 'T', 'S', '0', '0', '1'};
+
+}
+
+QuadUkfSmoother::QuadUkfSmoother()
+{
+}
+
+QuadUkfSmoother::~QuadUkfSmoother()
+{
+  close();
+}
+
+bool QuadUkfSmoother::open(const std::string &path)
+{
+  errorMsg.clear();
+  return steps.create(path, STEP_MAGIC, sizeof(Transition))
+      || fail(steps.error());
+}
+
+bool QuadUkfSmoother::openExisting(const std::string &path)
+{
+  errorMsg.clear();
+  return steps.open(path, STEP_MAGIC, sizeof(Transition), true)
+      || fail(steps.error());
+}
+
+// A write error is kept and reported by finish()
+void QuadUkfSmoother::transition(const Transition &t)
+{
+  if (errorMsg.empty() && !steps.append(&t))
+  {
+    fail(steps.error());
+  }
+}
+
+void QuadUkfSmoother::rewind(long count)
+{
+  steps.truncate(count);
+}
+
+/*
+ * Appends the final belief as a transition of zero length onto itself, so
+ * that every belief of the run is the prior of one record.
+ */
+bool QuadUkfSmoother::finish(const QuadUkf::QuadBelief &last)
+{
+  Transition &t = current;
+  t.priorTimeStamp = last.timeStamp;
+  t.timeStamp = last.timeStamp;
+  t.prior = last.state;
+  t.priorCov = last.covariance;
+  t.predicted = last.state;
+  t.predictedCov = last.covariance;
+  t.crossCov = last.covariance;
+  transition(t);
+  return errorMsg.empty();
+}
+
+/*
+ * The backward recursion, one record read and rewritten per step. The
+ * smoothed covariance at k + 1 is around the smoothed state rather than the
+ * predicted one; the difference between the two charts is second order in
+ * the correction and is ignored.
+ */
+bool QuadUkfSmoother::smooth()
+{
+  const long n = steps.size();
+  if (n == 0)
+  {
+    return fail("no transitions to smooth");
+  }
+
+  // The final belief is already smoothed
+  if (!steps.read(n - 1, &next))
+  {
+    return fail(steps.error());
+  }
+  for (long k = n - 2; k >= 0; --k)
+  {
+    if (!steps.read(k, &current))
+    {
+      return fail(steps.error());
+    }
+
+    // G = C P_pred^-1, solved as P_pred G^T = C^T with P_pred symmetric
+    predictedLlt.compute(current.predictedCov);
+    gain = predictedLlt.solve(current.crossCov.transpose()).transpose();
+
+    // next.prior holds the smoothed belief k + 1
+    QuadUkf::computeError(current.predicted, next.prior, innovation);
+    QuadUkf::applyError(current.prior, gain * innovation, current.prior);
+    current.priorCov.noalias() += gain
+        * (next.priorCov - current.predictedCov) * gain.transpose();
+    current.priorCov = 0.5 * (current.priorCov
+        + current.priorCov.transpose()).eval();
+
+    if (!steps.write(k, &current))
+    {
+      return fail(steps.error());
+    }
+    next = current;
+  }
+  return true;
+}
+
+long QuadUkfSmoother::size() const
+{
+  return steps.size();
+}
+
+bool QuadUkfSmoother::belief(const long index, QuadUkf::QuadBelief &out)
+{
+  if (!steps.read(index, &current))
+  {
+    return false;
+  }
+  out.timeStamp = current.priorTimeStamp;
+  out.dt = current.timeStamp - current.priorTimeStamp;
+  out.state = current.prior;
+  out.covariance = current.priorCov;
+  predictedLlt.compute(current.priorCov);
+  out.sqrtCovariance = predictedLlt.matrixL();
+  return true;
+}
+
+bool QuadUkfSmoother::close()
+{
+  return steps.close() || fail(steps.error());
+}
+
+const std::string &QuadUkfSmoother::error() const
+{
+  return errorMsg;
+}
+
+bool QuadUkfSmoother::fail(const std::string &what)
+{
+  errorMsg = what;
+  return false;
+}
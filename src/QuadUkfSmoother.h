@@ -0,0 +1,73 @@
+#ifndef QUADUKFSMOOTHER_H_
+#define QUADUKFSMOOTHER_H_
+
+#include "QuadUkf.h"
+#include "MappedRecordFile.h"
+
+/*
+ * Fixed-interval unscented Rauch-Tung-Striebel smoother over a QuadUkf run.
+ *
+ * Forward pass: set as the filter's transition observer, it streams every
+ * transition (prior, predicted belief and cross-covariance, all produced by
+ * the filter's own process model) into a memory-mapped step file, and
+ * finish() closes the pass with the final filtered belief. Backward pass:
+ * smooth() walks the file from the end, and for each transition k with
+ * smoothed belief k + 1 computes
+ *
+ *   G = C P_pred^-1
+ *   x_s(k) = x(k) [+] G (x_s(k + 1) [-] x_pred(k + 1))
+ *   P_s(k) = P(k) + G (P_s(k + 1) - P_pred(k + 1)) G^T
+ *
+ * with [+] and [-] QuadUkf's error-state composition and difference, and
+ * writes the smoothed belief over the prior in place. Both passes stream
+ * through a bounded window of the file, so memory use does not grow with
+ * the length of the flight.
+ */
+class QuadUkfSmoother : public QuadUkf::TransitionObserver
+{
+public:
+  typedef QuadUkf::Transition Transition;
+
+  QuadUkfSmoother();
+  ~QuadUkfSmoother();
+
+  // Starts a forward pass into a new step file at path
+  bool open(const std::string &path);
+
+  // Opens the step file of a finished forward pass, to smooth or read it
+  bool openExisting(const std::string &path);
+
+  virtual void transition(const Transition &t);
+  virtual void rewind(long count);
+
+  // Ends the forward pass with the filter's final belief
+  bool finish(const QuadUkf::QuadBelief &last);
+
+  // Runs the backward pass. Afterwards belief(i) is the smoothed belief.
+  bool smooth();
+
+  // Beliefs in the step file in time order, the filtered ones before
+  // smooth() and the smoothed ones after it. The dt of a belief is the
+  // length of the transition out of it.
+  long size() const;
+  bool belief(const long index, QuadUkf::QuadBelief &out);
+
+  bool close();
+  const std::string &error() const;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  MappedRecordFile steps;
+  std::string errorMsg;
+
+  // Buffers for the backward pass
+  Transition current, next;
+  QuadUkf::StateMatrix gain;
+  QuadUkf::StateVector innovation;
+  Eigen::LLT<QuadUkf::StateMatrix> predictedLlt;
+
+  bool fail(const std::string &what);
+};
+
+#endif  // QUADUKFSMOOTHER_H_
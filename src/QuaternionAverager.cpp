@@ -0,0 +1,110 @@
+#include "QuaternionAverager.h"
+
+#include <Eigen/Eigenvalues>
+
+namespace
+{
+
+// Relative residual |M v - lambda v| / lambda at which the power iteration
+// stops
+const double POWER_ITERATION_TOLERANCE = 1e-10;
+
+}
+
+QuaternionAverager::QuaternionAverager()
+{
+  reset();
+}
+
+void QuaternionAverager::reset()
+{
+  M = Eigen::Matrix4d::Zero();
+  weightSum = 0;
+  count = 0;
+  lastMean = Eigen::Quaterniond::Identity().coeffs();
+  haveMean = false;
+  lastEigenvalue = 0;
+}
+
+void QuaternionAverager::add(const Eigen::Quaterniond &q, const double weight)
+{
+  const Eigen::Vector4d v = q.coeffs().normalized();
+  M.noalias() += weight * v * v.transpose();
+  weightSum += weight;
+  ++count;
+}
+
+void QuaternionAverager::remove(const Eigen::Quaterniond &q,
+                                const double weight)
+{
+  const Eigen::Vector4d v = q.coeffs().normalized();
+  M.noalias() -= weight * v * v.transpose();
+  weightSum -= weight;
+  --count;
+}
+
+int QuaternionAverager::numSamples() const
+{
+  return count;
+}
+
+double QuaternionAverager::totalWeight() const
+{
+  return weightSum;
+}
+
+const Eigen::Matrix4d &QuaternionAverager::accumulator() const
+{
+  return M;
+}
+
+Eigen::Quaterniond QuaternionAverager::mean()
+{
+  if (count <= 0 || !(weightSum > 0))
+  {
+    lastEigenvalue = 0;
+    return Eigen::Quaterniond(lastMean);
+  }
+
+  // Without a previous mean, start from the column of M with the largest
+  // diagonal, which is the sample direction M weighs most
+  Eigen::Vector4d v = lastMean;
+  if (!haveMean)
+  {
+    int k;
+    M.diagonal().maxCoeff(&k);
+    v = M.col(k).normalized();
+  }
+
+  bool converged = false;
+  double lambda = 0;
+  for (int i = 0; i < MAX_POWER_ITERATIONS && !converged; ++i)
+  {
+    const Eigen::Vector4d Mv = M * v;
+    lambda = v.dot(Mv);
+    converged = lambda > 0 && (Mv - lambda * v).norm()
+        <= POWER_ITERATION_TOLERANCE * lambda;
+    v = Mv.normalized();
+  }
+  if (!converged)
+  {
+    // Eigenvalues come in increasing order
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix4d> solver(M);
+    v = solver.eigenvectors().col(3);
+    lambda = solver.eigenvalues()(3);
+  }
+
+  if (haveMean && v.dot(lastMean) < 0)
+  {
+    v = -v;
+  }
+  lastMean = v;
+  haveMean = true;
+  lastEigenvalue = lambda;
+  return Eigen::Quaterniond(v);
+}
+
+double QuaternionAverager::dispersion() const
+{
+  return weightSum > 0 ? 1 - lastEigenvalue / weightSum : 0;
+}
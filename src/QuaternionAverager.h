@@ -0,0 +1,161 @@
+#ifndef QUATERNIONAVERAGER_H_
+#define QUATERNIONAVERAGER_H_
+
+#include "CircularBuffer.h"
+
+#include <Eigen/Dense>
+
+#include <cmath>
+
+/*
+ * Weighted average of unit quaternions (Markley et al., "Averaging
+ * Quaternions"): the unit eigenvector of M = sum w_i q_i q_i^T with the
+ * largest eigenvalue, which minimizes the weighted sum of squared chordal
+ * distances between attitudes and does not depend on the sign of any q_i.
+ * Only the symmetric 4x4 accumulator M is kept, so samples are added, and
+ * removed again, in constant time and memory.
+ *
+ * mean() refines the previous mean by power iteration on M, which
+ * converges in a few steps when the samples agree and the mean moves
+ * little between calls, and falls back to a full symmetric eigensolve when
+ * it does not. Its sign follows the previous mean.
+ */
+class QuaternionAverager
+{
+public:
+  QuaternionAverager();
+
+  void reset();
+
+  void add(const Eigen::Quaterniond &q, const double weight = 1);
+
+  // Takes back a sample added earlier with the same weight. Rounding errors
+  // of long add/remove sequences accumulate in M; SlidingQuaternionAverager
+  // rebuilds it from its window now and then.
+  void remove(const Eigen::Quaterniond &q, const double weight = 1);
+
+  int numSamples() const;
+  double totalWeight() const;
+  const Eigen::Matrix4d &accumulator() const;
+
+  // Average of the samples, or identity if there are none
+  Eigen::Quaterniond mean();
+
+  // 1 - lambda_max / totalWeight as of the last mean(): zero when all
+  // samples agree, growing with their spread (about the mean squared half
+  // angle between the samples and the mean)
+  double dispersion() const;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  Eigen::Matrix4d M;
+  double weightSum;
+  int count;
+
+  // Previous mean, the starting point of the next power iteration
+  Eigen::Vector4d lastMean;
+  bool haveMean;
+  double lastEigenvalue;
+
+  enum
+  {
+    MAX_POWER_ITERATIONS = 16
+  };
+};
+
+/*
+ * Average of the quaternions of the last window seconds, or of the last
+ * Capacity samples if fewer. Samples leaving the window are removed from
+ * the accumulator, which is rebuilt from the window every Capacity removals
+ * to bound rounding drift, so the amortized cost per sample stays constant.
+ */
+template<int Capacity>
+class SlidingQuaternionAverager
+{
+public:
+  explicit SlidingQuaternionAverager(const double window = HUGE_VAL) :
+      windowLength(window), removals(0)
+  {
+  }
+
+  void setWindow(const double window)
+  {
+    windowLength = window;
+  }
+
+  void reset()
+  {
+    samples.clear();
+    averager.reset();
+    removals = 0;
+  }
+
+  // Time stamps must not decrease
+  void add(const double timeStamp, const Eigen::Quaterniond &q,
+           const double weight = 1)
+  {
+    while (!samples.empty()
+        && (samples.full()
+            || samples.front().timeStamp < timeStamp - windowLength))
+    {
+      averager.remove(samples.front().q, samples.front().weight);
+      samples.popFront();
+      ++removals;
+    }
+    if (removals >= Capacity)
+    {
+      rebuild();
+    }
+
+    Sample &s = samples.pushBack();
+    s.timeStamp = timeStamp;
+    s.q = q;
+    s.weight = weight;
+    averager.add(q, weight);
+  }
+
+  int numSamples() const
+  {
+    return samples.size();
+  }
+
+  Eigen::Quaterniond mean()
+  {
+    return averager.mean();
+  }
+
+  double dispersion() const
+  {
+    return averager.dispersion();
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  struct Sample
+  {
+    double timeStamp;
+    Eigen::Quaterniond q;
+    double weight;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  double windowLength;
+  CircularBuffer<Sample, Capacity> samples;
+  QuaternionAverager averager;
+  int removals;
+
+  void rebuild()
+  {
+    averager.reset();
+    for (int i = 0; i < samples.size(); ++i)
+    {
+      averager.add(samples[i].q, samples[i].weight);
+    }
+    removals = 0;
+  }
+};
+
+#endif  // QUATERNIONAVERAGER_H_
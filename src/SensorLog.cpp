@@ -0,0 +1,225 @@
+#include "SensorLog.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+
+const char LOG_MAGIC[8] = {'K', 'S', 'L', 'O', 'G', '0', '0', '1'};
+const size_t IO_BUFFER_SIZE = 1 << 20;
+
+}
+
+SensorLogReader::SensorLogReader() :
+    file(0), binary(false), lineNumber(0), buffer(0)
+{
+}
+
+SensorLogReader::~SensorLogReader()
+{
+  close();
+}
+
+bool SensorLogReader::open(const std::string &path)
+{
+  close();
+  errorMsg.clear();
+  lineNumber = 0;
+
+  file = std::fopen(path.c_str(), "rb");
+  if (!file)
+  {
+    errorMsg = "cannot open " + path;
+    return false;
+  }
+  buffer = new char[IO_BUFFER_SIZE];
+  std::setvbuf(file, buffer, _IOFBF, IO_BUFFER_SIZE);
+
+  char magic[sizeof(LOG_MAGIC)];
+  binary = std::fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+      && std::memcmp(magic, LOG_MAGIC, sizeof(magic)) == 0;
+  if (!binary)
+  {
+    std::rewind(file);
+  }
+  return true;
+}
+
+void SensorLogReader::close()
+{
+  if (file)
+  {
+    std::fclose(file);
+    file = 0;
+  }
+  delete[] buffer;
+  buffer = 0;
+}
+
+bool SensorLogReader::next(SensorRecord &rec)
+{
+  if (!file)
+  {
+    return false;
+  }
+
+  if (binary)
+  {
+    const size_t n = std::fread(&rec, sizeof(rec), 1, file);
+    if (n == 1 && (rec.type < SensorRecord::IMU
+        || rec.type > SensorRecord::POSITION))
+    {
+      errorMsg = "unknown record type in binary log";
+      return false;
+    }
+    return n == 1;
+  }
+
+  while (std::fgets(line, sizeof(line), file))
+  {
+    ++lineNumber;
+    const char *c = line;
+    while (*c == ' ' || *c == '\t')
+    {
+      ++c;
+    }
+    if (*c == '#' || *c == '\n' || *c == '\r' || *c == '\0')
+    {
+      continue;
+    }
+    return parseCsvLine(rec);
+  }
+  return false;
+}
+
+bool SensorLogReader::isBinary() const
+{
+  return binary;
+}
+
+const std::string &SensorLogReader::error() const
+{
+  return errorMsg;
+}
+
+bool SensorLogReader::parseCsvLine(SensorRecord &rec)
+{
+  char *c = line;
+  while (*c == ' ' || *c == '\t')
+  {
+    ++c;
+  }
+
+  int numValues;
+  if (std::strncmp(c, "imu,", 4) == 0)
+  {
+    rec.type = SensorRecord::IMU;
+    numValues = 6;
+    c += 4;
+  }
+  else if (std::strncmp(c, "pose,", 5) == 0)
+  {
+    rec.type = SensorRecord::POSE;
+    numValues = 7;
+    c += 5;
+  }
+  else if (std::strncmp(c, "alt,", 4) == 0)
+  {
+    rec.type = SensorRecord::ALTITUDE;
+    numValues = 1;
+    c += 4;
+  }
+  else if (std::strncmp(c, "flow,", 5) == 0)
+  {
+    rec.type = SensorRecord::FLOW;
+    numValues = 2;
+    c += 5;
+  }
+  else if (std::strncmp(c, "gps,", 4) == 0)
+  {
+    rec.type = SensorRecord::POSITION;
+    numValues = 3;
+    c += 4;
+  }
+  else
+  {
+    errorMsg = "line " + std::to_string(lineNumber)
+        + ": expected an imu, pose, alt, flow or gps record";
+    return false;
+  }
+  rec.reserved = 0;
+
+  // Time stamp followed by the record's values, comma separated
+  for (int i = -1; i < numValues; ++i)
+  {
+    char *end;
+    const double v = std::strtod(c, &end);
+    if (end == c)
+    {
+      errorMsg = "line " + std::to_string(lineNumber) + ": too few fields";
+      return false;
+    }
+    if (i < 0)
+    {
+      rec.timeStamp = v;
+    }
+    else
+    {
+      rec.values[i] = v;
+    }
+    c = end;
+    while (*c == ' ' || *c == '\t')
+    {
+      ++c;
+    }
+    if (*c == ',')
+    {
+      ++c;
+    }
+  }
+  for (int i = numValues; i < 7; ++i)
+  {
+    rec.values[i] = 0;
+  }
+  return true;
+}
+
+SensorLogWriter::SensorLogWriter() :
+    file(0), buffer(0)
+{
+}
+
+SensorLogWriter::~SensorLogWriter()
+{
+  close();
+}
+
+bool SensorLogWriter::open(const std::string &path)
+{
+  close();
+  file = std::fopen(path.c_str(), "wb");
+  if (!file)
+  {
+    return false;
+  }
+  buffer = new char[IO_BUFFER_SIZE];
+  std::setvbuf(file, buffer, _IOFBF, IO_BUFFER_SIZE);
+  return std::fwrite(LOG_MAGIC, sizeof(LOG_MAGIC), 1, file) == 1;
+}
+
+bool SensorLogWriter::write(const SensorRecord &rec)
+{
+  return file && std::fwrite(&rec, sizeof(rec), 1, file) == 1;
+}
+
+void SensorLogWriter::close()
+{
+  if (file)
+  {
+    std::fclose(file);
+    file = 0;
+  }
+  delete[] buffer;
+  buffer = 0;
+}
@@ -0,0 +1,85 @@
+#ifndef SENSORLOG_H_
+#define SENSORLOG_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/*
+ * One timestamped sensor record of a flight log. Values are stored exactly
+ * as the sensor published them:
+ *   IMU:      angular velocity x y z, linear acceleration x y z
+ *   POSE:     position x y z, orientation x y z w
+ *   ALTITUDE: height above the origin
+ *   FLOW:     horizontal body velocity x y from optical flow
+ *   POSITION: position fix x y z in filter axes
+ * Values a sensor did not deliver are NaN.
+ */
+struct SensorRecord
+{
+  enum Type
+  {
+    IMU = 0, POSE = 1, ALTITUDE = 2, FLOW = 3, POSITION = 4
+  };
+
+  int32_t type;
+  int32_t reserved;
+  double timeStamp;
+  double values[7];
+};
+
+/*
+ * Sequential reader for sensor logs in either of two formats, detected from
+ * the first bytes of the file:
+ *
+ *   CSV:    one record per line, "imu,t,wx,wy,wz,ax,ay,az",
+ *           "pose,t,px,py,pz,qx,qy,qz,qw", "alt,t,h", "flow,t,vx,vy" or
+ *           "gps,t,x,y,z", where a value may be "nan". Blank lines and lines
+ *           starting with '#' are skipped.
+ *   Binary: the 8-byte magic "KSLOG001" followed by packed SensorRecords in
+ *           native byte order.
+ */
+class SensorLogReader
+{
+public:
+  SensorLogReader();
+  ~SensorLogReader();
+
+  bool open(const std::string &path);
+  void close();
+
+  // Reads the next record. Returns false at end of file or on a malformed
+  // record, in which case error() is non-empty.
+  bool next(SensorRecord &rec);
+
+  bool isBinary() const;
+  const std::string &error() const;
+
+private:
+  std::FILE *file;
+  bool binary;
+  long lineNumber;
+  std::string errorMsg;
+  char line[1024];
+  char *buffer;
+
+  bool parseCsvLine(SensorRecord &rec);
+};
+
+// Writer for the binary log format read by SensorLogReader
+class SensorLogWriter
+{
+public:
+  SensorLogWriter();
+  ~SensorLogWriter();
+
+  bool open(const std::string &path);
+  bool write(const SensorRecord &rec);
+  void close();
+
+private:
+  std::FILE *file;
+  char *buffer;
+};
+
+#endif  // SENSORLOG_H_
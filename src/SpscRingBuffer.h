@@ -0,0 +1,74 @@
+#ifndef SPSCRINGBUFFER_H_
+#define SPSCRINGBUFFER_H_
+
+#include <atomic>
+#include <cstddef>
+
+/*
+ * Bounded lock-free queue for exactly one producer thread and one consumer
+ * thread. Capacity must be a power of two. push() and pop() are wait-free
+ * and never allocate; a full queue rejects the element instead of blocking.
+ */
+template<typename T, size_t Capacity>
+class SpscRingBuffer
+{
+public:
+  SpscRingBuffer() :
+      head(0), tail(0)
+  {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscRingBuffer capacity must be a power of two");
+  }
+
+  // Producer side. Returns false if the queue is full.
+  bool push(const T &item)
+  {
+    const size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == Capacity)
+    {
+      return false;
+    }
+    buffer[t & (Capacity - 1)] = item;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns the oldest element without removing it, or null
+  // if the queue is empty.
+  const T *front() const
+  {
+    const size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire))
+    {
+      return 0;
+    }
+    return &buffer[h & (Capacity - 1)];
+  }
+
+  // Consumer side. Removes the element returned by front().
+  void pop()
+  {
+    head.store(head.load(std::memory_order_relaxed) + 1,
+               std::memory_order_release);
+  }
+
+  // Number of queued elements. Exact on either side; approximate elsewhere.
+  size_t size() const
+  {
+    return tail.load(std::memory_order_acquire)
+        - head.load(std::memory_order_acquire);
+  }
+
+  static size_t capacity()
+  {
+    return Capacity;
+  }
+
+private:
+  // Producer and consumer indexes live on separate cache lines
+  alignas(64) std::atomic<size_t> head;
+  alignas(64) std::atomic<size_t> tail;
+  alignas(64) T buffer[Capacity];
+};
+
+#endif  // SPSCRINGBUFFER_H_
@@ -0,0 +1,257 @@
+#include "TrajectoryLog.h"
+
+#include <chrono>
+
+namespace
+{
+
+const char TRAJECTORY_MAGIC[8] = {'K', 'S', 'T', 'R', 'J', '0', '0', '2'};
+
+// Longest time the header of a growing log lags its records
+const std::chrono::seconds SYNC_PERIOD(1);
+
+}
+
+void TrajectoryRecord::fromBelief(const QuadUkf::QuadBelief &b)
+{
+  timeStamp = b.timeStamp;
+  dt = b.dt;
+  Eigen::Map<Eigen::Matrix<double, STATE_SIZE, 1> > x(state);
+  x.segment<3>(0) = b.state.position;
+  x.segment<4>(3) = b.state.quaternion.coeffs();
+  x.segment<3>(7) = b.state.velocity;
+  x.segment<3>(10) = b.state.angular_velocity;
+  x.segment<3>(13) = b.state.acceleration;
+  x.segment<3>(16) = b.state.gyro_bias;
+  x.segment<3>(19) = b.state.accel_bias;
+
+  double *c = covariance;
+  for (int i = 0; i < ERROR_SIZE; ++i)
+  {
+    for (int j = i; j < ERROR_SIZE; ++j)
+    {
+      *c++ = b.covariance(i, j);
+    }
+  }
+}
+
+void TrajectoryRecord::toBelief(QuadUkf::QuadBelief &b) const
+{
+  b.timeStamp = timeStamp;
+  b.dt = dt;
+  Eigen::Map<const Eigen::Matrix<double, STATE_SIZE, 1> > x(state);
+  b.state.position = x.segment<3>(0);
+  b.state.quaternion.coeffs() = x.segment<4>(3);
+  b.state.velocity = x.segment<3>(7);
+  b.state.angular_velocity = x.segment<3>(10);
+  b.state.acceleration = x.segment<3>(13);
+  b.state.gyro_bias = x.segment<3>(16);
+  b.state.accel_bias = x.segment<3>(19);
+
+  const double *c = covariance;
+  for (int i = 0; i < ERROR_SIZE; ++i)
+  {
+    for (int j = i; j < ERROR_SIZE; ++j)
+    {
+      b.covariance(i, j) = b.covariance(j, i) = *c++;
+    }
+  }
+}
+
+TrajectoryLogWriter::TrajectoryLogWriter() :
+    written(0), dropped(0), running(false), failed(false)
+{
+}
+
+TrajectoryLogWriter::~TrajectoryLogWriter()
+{
+  close();
+}
+
+bool TrajectoryLogWriter::open(const std::string &path)
+{
+  close();
+  errorMsg.clear();
+  written = 0;
+  dropped = 0;
+  failed = false;
+  if (!file.create(path, TRAJECTORY_MAGIC, sizeof(TrajectoryRecord)))
+  {
+    errorMsg = file.error();
+    return false;
+  }
+  running = true;
+  writerThread = std::thread(&TrajectoryLogWriter::runWriter, this);
+  return true;
+}
+
+bool TrajectoryLogWriter::close()
+{
+  if (!writerThread.joinable())
+  {
+    return errorMsg.empty();
+  }
+  running = false;
+  writerThread.join();
+  if (!file.close() && errorMsg.empty())
+  {
+    errorMsg = file.error();
+  }
+  return errorMsg.empty();
+}
+
+bool TrajectoryLogWriter::isOpen() const
+{
+  return writerThread.joinable();
+}
+
+bool TrajectoryLogWriter::post(const QuadUkf::QuadBelief &b, const bool wait)
+{
+  packed.fromBelief(b);
+  while (!queue.push(packed))
+  {
+    if (!wait || failed.load(std::memory_order_relaxed))
+    {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+long TrajectoryLogWriter::writtenBeliefs() const
+{
+  return written.load(std::memory_order_relaxed);
+}
+
+long TrajectoryLogWriter::droppedBeliefs() const
+{
+  return dropped.load(std::memory_order_relaxed);
+}
+
+const std::string &TrajectoryLogWriter::error() const
+{
+  return errorMsg;
+}
+
+/*
+ * Writer thread main loop, with the same spin-then-sleep back-off as the
+ * filter and publisher threads. After a write error it keeps draining the
+ * queue, counting what it drains as dropped, so the producer never blocks
+ * on a dead log.
+ */
+void TrajectoryLogWriter::runWriter()
+{
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point lastSync = Clock::now();
+  int idlePolls = 0;
+  while (running.load(std::memory_order_relaxed) || queue.front())
+  {
+    if (writeQueued())
+    {
+      idlePolls = 0;
+    }
+    else if (++idlePolls < 100)
+    {
+      std::this_thread::yield();
+    }
+    else
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+
+    const Clock::time_point now = Clock::now();
+    if (now - lastSync >= SYNC_PERIOD && !failed)
+    {
+      lastSync = now;
+      file.sync();
+    }
+  }
+}
+
+// Appends every queued record; returns false if there were none
+bool TrajectoryLogWriter::writeQueued()
+{
+  const TrajectoryRecord *rec = queue.front();
+  if (!rec)
+  {
+    return false;
+  }
+  for (; rec; rec = queue.front())
+  {
+    if (failed.load(std::memory_order_relaxed))
+    {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    else if (file.append(rec))
+    {
+      written.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+      errorMsg = file.error();
+      failed = true;
+      dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    queue.pop();
+  }
+  return true;
+}
+
+bool TrajectoryLogReader::open(const std::string &path)
+{
+  return file.open(path, TRAJECTORY_MAGIC, sizeof(TrajectoryRecord), false);
+}
+
+void TrajectoryLogReader::close()
+{
+  file.close();
+}
+
+long TrajectoryLogReader::size() const
+{
+  return file.size();
+}
+
+bool TrajectoryLogReader::read(const long index, TrajectoryRecord &out)
+{
+  return file.read(index, &out);
+}
+
+bool TrajectoryLogReader::read(const long index, QuadUkf::QuadBelief &b)
+{
+  if (!file.read(index, &rec))
+  {
+    return false;
+  }
+  rec.toBelief(b);
+  return true;
+}
+
+long TrajectoryLogReader::find(const double timeStamp)
+{
+  long lo = 0, hi = size();
+  while (lo < hi)
+  {
+    const long mid = lo + (hi - lo) / 2;
+    if (!file.read(mid, &rec))
+    {
+      return size();
+    }
+    if (rec.timeStamp < timeStamp)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+const std::string &TrajectoryLogReader::error() const
+{
+  return file.error();
+}
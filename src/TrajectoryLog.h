@@ -0,0 +1,114 @@
+#ifndef TRAJECTORYLOG_H_
+#define TRAJECTORYLOG_H_
+
+#include "QuadUkf.h"
+#include "MappedRecordFile.h"
+#include "SpscRingBuffer.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+/*
+ * One filter belief as stored in a trajectory log. The layout is plain
+ * doubles in native byte order, independent of Eigen's:
+ *   state:      position x y z, quaternion x y z w, velocity x y z,
+ *               angular velocity x y z, acceleration x y z,
+ *               gyro bias x y z, accelerometer bias x y z
+ *   covariance: upper triangle of the 21x21 error covariance, row by row
+ */
+struct TrajectoryRecord
+{
+  enum
+  {
+    STATE_SIZE = 22,
+    ERROR_SIZE = 21,
+    COVARIANCE_SIZE = ERROR_SIZE * (ERROR_SIZE + 1) / 2
+  };
+
+  double timeStamp;
+  double dt;
+  double state[STATE_SIZE];
+  double covariance[COVARIANCE_SIZE];
+
+  void fromBelief(const QuadUkf::QuadBelief &b);
+
+  // Fills everything but the belief's sqrtCovariance
+  void toBelief(QuadUkf::QuadBelief &b) const;
+};
+
+/*
+ * Append-only binary log of every belief of a run, with state, velocity and
+ * full covariance, for analysis after the fact. post() packs the belief
+ * onto a bounded lock-free queue and returns; a writer thread appends the
+ * queued records to a MappedRecordFile and syncs its header about once a
+ * second, so a log cut short by a crash still reads back up to the last
+ * sync. Like the publisher, it drops beliefs rather than stall the filter
+ * when the disk falls a whole queue behind.
+ */
+class TrajectoryLogWriter
+{
+public:
+  enum
+  {
+    QUEUE_SIZE = 1024
+  };
+
+  TrajectoryLogWriter();
+  ~TrajectoryLogWriter();
+
+  // Creates the log at path and starts the writer thread
+  bool open(const std::string &path);
+
+  // Drains the queue, stops the writer and finishes the file
+  bool close();
+
+  bool isOpen() const;
+
+  // Producer side, from a single thread. Returns false and drops the belief
+  // if the queue is full, unless wait is set, in which case it waits for
+  // room; offline tools that must keep every belief wait.
+  bool post(const QuadUkf::QuadBelief &b, const bool wait = false);
+
+  long writtenBeliefs() const;
+  long droppedBeliefs() const;
+
+  // Set once the writer has failed; valid after close()
+  const std::string &error() const;
+
+private:
+  MappedRecordFile file;
+  SpscRingBuffer<TrajectoryRecord, QUEUE_SIZE> queue;
+  TrajectoryRecord packed;
+  std::atomic<long> written, dropped;
+  std::atomic<bool> running, failed;
+  std::thread writerThread;
+  std::string errorMsg;
+
+  void runWriter();
+  bool writeQueued();
+};
+
+// Random access to a trajectory log, through the same bounded mapping
+class TrajectoryLogReader
+{
+public:
+  bool open(const std::string &path);
+  void close();
+
+  long size() const;
+  bool read(const long index, TrajectoryRecord &rec);
+  bool read(const long index, QuadUkf::QuadBelief &b);
+
+  // Index of the first belief at or after timeStamp, or size() if none.
+  // Time stamps never decrease along a log.
+  long find(const double timeStamp);
+
+  const std::string &error() const;
+
+private:
+  MappedRecordFile file;
+  TrajectoryRecord rec;
+};
+
+#endif  // TRAJECTORYLOG_H_
@@ -1,84 +1,1207 @@
 #ifndef UNSCENTEDKF_H_
 #define UNSCENTEDKF_H_
 
+#include "LatencyProbes.h"
+
 #include <Eigen/Dense>
 
+#include <cmath>
+
+/*
+ * Unscented Kalman filter over a state of NStates and a measurement of
+ * NSensors elements. Both dimensions are compile-time constants so every
+ * buffer used by predictState() and correctState() lives on the stack; pass
+ * Eigen::Dynamic for either dimension to size the filter at run time instead.
+ */
+template<typename Scalar, int NStates, int NSensors>
 class UnscentedKf
 {
 public:
-  UnscentedKf();
+  // Number of points in the symmetric 2n + 1 sigma point set, the largest
+  // of the sets below. Sigma point matrices hold up to NSigma columns and are
+  // sized to the selected set at run time.
+  enum
+  {
+    NSigma = (NStates == Eigen::Dynamic) ? Eigen::Dynamic : 2 * NStates + 1
+  };
+
+  // Rows of the stacked [deviations, noise factor]^T matrices that the
+  // square-root engine triangularizes with a QR decomposition
+  enum
+  {
+    NStateCompound = (NStates == Eigen::Dynamic) ? Eigen::Dynamic : 3 * NStates,
+    NSensorCompound =
+        (NStates == Eigen::Dynamic || NSensors == Eigen::Dynamic) ?
+            Eigen::Dynamic : 2 * NStates + NSensors
+  };
+
+  /*
+   * STANDARD_UKF propagates the covariance P and refactorizes it on every
+   * step. SQUARE_ROOT_UKF propagates its lower Cholesky factor S (P = S S^T)
+   * through QR decompositions and rank-1 updates, so P never has to be
+   * refactorized and stays positive definite by construction.
+   */
+  enum Engine
+  {
+    STANDARD_UKF, SQUARE_ROOT_UKF
+  };
+
+  /*
+   * Sigma point sets, all scaled by ALPHA and matching the mean and
+   * covariance of the belief. SYMMETRIC_SIGMA_POINTS is the 2n + 1 point
+   * set. The simplex sets use n + 2 points, so every step propagates and
+   * accumulates roughly half as many: SPHERICAL_SIMPLEX_SIGMA_POINTS spreads
+   * them evenly on a sphere with equal weights, MINIMAL_SKEW_SIGMA_POINTS
+   * also matches the third moment, but its weights halve and its spread
+   * grows by sqrt(2) per state, so it is only well conditioned for small n.
+   */
+  enum SigmaPointSet
+  {
+    SYMMETRIC_SIGMA_POINTS, SPHERICAL_SIMPLEX_SIGMA_POINTS,
+    MINIMAL_SKEW_SIGMA_POINTS
+  };
+
+  typedef Eigen::Matrix<Scalar, NStates, 1> StateVector;
+  typedef Eigen::Matrix<Scalar, NStates, NStates> StateMatrix;
+  typedef Eigen::Matrix<Scalar, NSensors, 1> SensorVector;
+  typedef Eigen::Matrix<Scalar, NSensors, NSensors> SensorMatrix;
+  typedef Eigen::Matrix<Scalar, NStates, NSensors> CrossCovMatrix;
+  typedef Eigen::Matrix<Scalar, NStates, Eigen::Dynamic,
+      (NStates == 1) ? Eigen::RowMajor : Eigen::ColMajor, NStates, NSigma>
+      StateSigmaMatrix;
+  typedef Eigen::Matrix<Scalar, NSensors, Eigen::Dynamic,
+      (NSensors == 1) ? Eigen::RowMajor : Eigen::ColMajor, NSensors, NSigma>
+      SensorSigmaMatrix;
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1, Eigen::ColMajor, NSigma, 1>
+      WeightVector;
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, NStates, Eigen::ColMajor,
+      NStateCompound, NStates> StateCompoundMatrix;
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, NSensors, Eigen::ColMajor,
+      NSensorCompound, NSensors> SensorCompoundMatrix;
+  typedef Eigen::Matrix<Scalar, NSensors, NStates> ObservationMatrix;
+  typedef Eigen::Matrix<int, NSensors, 1> SelectionVector;
+
+  // Measurements of any size up to NSensors for correctLinearState(), kept
+  // in fixed storage so that they never allocate
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1, Eigen::ColMajor, NSensors,
+      1> PartialSensorVector;
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic,
+      Eigen::ColMajor, NSensors, NSensors> PartialSensorMatrix;
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, NStates, Eigen::ColMajor,
+      NSensors, NStates> PartialObservationMatrix;
+  typedef Eigen::Matrix<Scalar, NStates, Eigen::Dynamic, Eigen::ColMajor,
+      NStates, NSensors> PartialCrossCovMatrix;
+
+  // Views used by the model functions so that sigma point columns can be
+  // read and written in place.
+  typedef Eigen::Ref<const StateVector> ConstStateRef;
+  typedef Eigen::Ref<StateVector> StateRef;
+  typedef Eigen::Ref<SensorVector> SensorRef;
+
+  UnscentedKf(int nStates = (NStates > 0) ? NStates : 1,
+              int nSensors = (NSensors > 0) ? NSensors : 1);
   virtual ~UnscentedKf() = 0;
 
+  /*
+   * sqrtCovariance is the lower Cholesky factor of covariance. Only the
+   * square-root engine reads it, and it keeps both members up to date.
+   */
   struct Belief
   {
-    Eigen::VectorXd state;
-    Eigen::MatrixXd covariance;
+    StateVector state;
+    StateMatrix covariance;
+    StateMatrix sqrtCovariance;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
   };
 
   int numStates;
   int numSensors;
   void setWeightsAndCoeffs();
 
-  UnscentedKf::Belief predictState(Eigen::VectorXd x, Eigen::MatrixXd P,
-                                   Eigen::MatrixXd Q, double dt);
-  UnscentedKf::Belief correctState(Eigen::VectorXd x, Eigen::MatrixXd P,
-                                   Eigen::VectorXd z, Eigen::MatrixXd R);
+  void setEngine(Engine e);
+  Engine getEngine() const;
+
+  // Selecting a set recomputes the weights and resizes the workspace
+  void setSigmaPointSet(SigmaPointSet set);
+  SigmaPointSet getSigmaPointSet() const;
+  int numSigmaPoints() const;
+
+  // Number of square-root corrections whose Cholesky downdate lost
+  // definiteness and fell back to refactorizing the covariance
+  long getFactorizationFallbacks() const;
+
+  /*
+   * Both steps write into a caller-owned belief, which may alias the inputs.
+   * All intermediate buffers come from the filter's workspace. The Belief
+   * overloads run the selected engine; the (x, P) overloads always run the
+   * standard one.
+   */
+  void predictState(const Belief &in, const StateMatrix &Q, const Scalar dt,
+                    Belief &out);
+  void correctState(const Belief &in, const SensorVector &z,
+                    const SensorMatrix &R, Belief &out);
+  void predictState(const StateVector &x, const StateMatrix &P,
+                    const StateMatrix &Q, const Scalar dt, Belief &out);
+  void correctState(const StateVector &x, const StateMatrix &P,
+                    const SensorVector &z, const SensorMatrix &R, Belief &out);
+
+  /*
+   * Closed-form correction with a linear measurement z = H x + v, v ~ N(0, R),
+   * of any number of rows up to NSensors, independent of the observation
+   * model that correctState() uses. Models with several sensors, or sensors
+   * that only deliver some of their components, pass each measurement with
+   * just the rows they have, so the cost follows the measurement's size.
+   * With sequential set, z and H are whitened by the factor of R and the rows
+   * are applied one at a time as scalar updates, so no innovation covariance
+   * is factorized; the result is the same up to rounding. Runs the selected
+   * engine and returns the normalized innovation squared.
+   */
+  Scalar correctLinearState(const Belief &in, const PartialSensorVector &z,
+                            const PartialObservationMatrix &H,
+                            const PartialSensorMatrix &R,
+                            const bool sequential, Belief &out);
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+protected:
+  /*
+   * Scratch buffers reused by every predict and correct step. They are sized
+   * once by setWeightsAndCoeffs() so the steady-state filter loop never
+   * allocates.
+   */
+  struct Workspace
+  {
+    Eigen::LLT<StateMatrix> covarianceLlt;
+    StateMatrix sqrtCovariance;
+    StateSigmaMatrix sigmaPoints;
+    StateSigmaMatrix propagatedPoints;
+    StateSigmaMatrix stateDeviations;
+    StateSigmaMatrix weightedDeviations;
+    SensorSigmaMatrix sensorPoints;
+    SensorSigmaMatrix sensorDeviations;
+    SensorVector sensorMean;
+    SensorVector innovation;
+    SensorMatrix sensorCovariance;
+    CrossCovMatrix crossCovariance;
+    CrossCovMatrix gain;
+    Eigen::LLT<SensorMatrix> innovationLlt;
+    SensorMatrix sqrtSensorCovariance;
+    CrossCovMatrix gainTimesSqrt;
+
+    // Square-root engine buffers. The noise factors are cached and only
+    // recomputed when Q or R change. The compound matrices are triangularized
+    // in place.
+    Eigen::LLT<SensorMatrix> sensorNoiseLlt;
+    StateCompoundMatrix stateCompound;
+    SensorCompoundMatrix sensorCompound;
+    StateMatrix processNoise, sqrtProcessNoise;
+    SensorMatrix sensorNoise, sqrtSensorNoise;
+    StateVector stateUpdate;
+    SensorVector sensorUpdate;
+
+    // correctLinearState() buffers, sized to each measurement
+    PartialSensorVector partialInnovation;
+    PartialSensorMatrix partialCovariance;
+    Eigen::LLT<PartialSensorMatrix> partialLlt;
+    PartialCrossCovMatrix partialGainTimesSqrt;
+    PartialObservationMatrix whitenedObservation;
+
+    void resize(int nStates, int nSensors, int nSigma);
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  } workspace;
+
+  // Building blocks of the predict and correct steps, exposed to derived
+  // models and to the kernel benchmarks
+  void computeSigmaPoints(const StateVector &x, const StateMatrix &P,
+                          const Scalar scalingCoeff,
+                          StateSigmaMatrix &sigmaPts);
+  void unscentedStateTransform(const StateSigmaMatrix &sigmaPts,
+                               const StateMatrix &noiseCov, const Scalar dt,
+                               StateVector &vec, StateMatrix &cov);
+  void unscentedSensorTransform(const StateSigmaMatrix &sigmaPts,
+                                const SensorMatrix &noiseCov,
+                                SensorVector &vec, SensorMatrix &cov);
+  template<typename Devs, typename Cov>
+  void computeCovariance(const Devs &devs, const Cov &noiseCov,
+                         Cov &cov) const;
+  void computeGain();
+  template<typename Cov, typename Factor>
+  static void subtractOuterProduct(Cov &cov, const Factor &W);
+
+  /*
+   * Cross-covariance sum_i w_i (X_i - x) (Y_i - y)^T between the state x
+   * that went into the latest prediction and the predicted state y, from
+   * the sigma points X_i and propagated deviations Y_i - y that prediction
+   * left in the workspace. The filter does not need it; smoothers do.
+   */
+  void predictionCrossCovariance(const StateVector &x, StateMatrix &C);
+
+  /*
+   * Declares that observationFunc() is linear, z = H x, or a selection of
+   * state elements, z(i) = x(indices(i)). Both engines then correct with the
+   * closed-form Kalman update on the blocks of P that H touches instead of
+   * the unscented transform, which is exact for a linear model anyway.
+   * setNonlinearObservation() restores the sigma point correction.
+   */
+  void setLinearObservation(const ObservationMatrix &H);
+  void setSelectionObservation(const SelectionVector &indices);
+  void setNonlinearObservation();
 
 private:
-  Eigen::VectorXd meanWeights, covarianceWeights;
+  enum ObservationModel
+  {
+    NONLINEAR_OBSERVATION, LINEAR_OBSERVATION, SELECTION_OBSERVATION
+  };
+
+  WeightVector meanWeights, covarianceWeights;
+
+  // Square roots of the covariance weights of the points other than the
+  // center, which are non-negative in every set, and whether they are all
+  // equal
+  WeightVector sqrtOuterWeights;
+  bool equalOuterWeights = true;
 
   // Tunable parameters
-  const double ALPHA = 0.75;
-  const double BETA = 2;
-  const double KAPPA = 0;
+  const Scalar ALPHA = 0.75;
+  const Scalar BETA = 2;
+  const Scalar KAPPA = 0;
+
+  // Weight of the center point of the unscaled simplex sets
+  const Scalar SIMPLEX_CENTER_WEIGHT = 0;
 
   // These values are updated by setWeights()
-  double lambda = 0;
-  double sigmaPointScalingCoeff = 0;
+  Scalar lambda = 0;
+  Scalar sigmaPointScalingCoeff = 0;
+
+  // Offsets of the simplex sets' points from the mean in units of the
+  // covariance factor, with the center point's zero column first
+  StateSigmaMatrix sigmaPointOffsets;
+
+  SigmaPointSet sigmaPointSet = SYMMETRIC_SIGMA_POINTS;
+  Engine engine = STANDARD_UKF;
+  long factorizationFallbacks = 0;
+
+  ObservationModel observationModel = NONLINEAR_OBSERVATION;
+  ObservationMatrix observationMatrix;
+  SelectionVector selectedStates;
+
+  virtual void processFunc(const ConstStateRef &x, const Scalar dt,
+                           StateRef out) = 0;
+  virtual void observationFunc(const ConstStateRef &x, SensorRef out) = 0;
+
+  /*
+   * Batch model interface, called once per step with the whole sigma point
+   * matrix. The defaults fall back to processFunc()/observationFunc() column
+   * by column; models override them to propagate every point in one pass.
+   */
+  virtual void processBatch(const StateSigmaMatrix &sigmaPts, const Scalar dt,
+                            StateSigmaMatrix &out);
+  virtual void observationBatch(const StateSigmaMatrix &sigmaPts,
+                                SensorSigmaMatrix &out);
+
+  void sampleStateSpace(const StateSigmaMatrix &sigmaPts, const Scalar dt,
+                        StateSigmaMatrix &sigmas, StateVector &vec);
+
+  void sampleSensorSpace(const StateSigmaMatrix &sigmaPts,
+                         SensorSigmaMatrix &sigmas, SensorVector &vec);
+
+  template<typename Vec, typename Sigmas>
+  void computeDeviations(const Vec &vec, const Sigmas &sigmaPts,
+                         Sigmas &devs) const;
+  void spreadSigmaPoints(const StateVector &x, const StateMatrix &sqrtP,
+                         const Scalar scalingCoeff,
+                         StateSigmaMatrix &sigmaPts) const;
+  void setSimplexOffsets();
+
+  void predictSqrtState(const StateVector &x, const StateMatrix &S,
+                        const StateMatrix &Q, const Scalar dt, Belief &out);
+  void correctSqrtState(const StateVector &x, const StateMatrix &S,
+                        const SensorVector &z, const SensorMatrix &R,
+                        Belief &out);
+  void computeLinearGain(const StateVector &x, const StateMatrix &P,
+                         const SensorMatrix &R);
+  template<typename Factor>
+  void downdateSqrtCovariance(const StateMatrix &S, const Factor &W,
+                              Belief &out);
+  Scalar correctSequentialState(const Belief &in,
+                                const PartialSensorVector &z,
+                                const PartialObservationMatrix &H,
+                                const PartialSensorMatrix &R, Belief &out);
+  template<typename Devs, typename Noise, typename Compound, typename Factor,
+      typename Vec>
+  bool computeSqrtCovariance(const Devs &devs, const Noise &sqrtNoise,
+                             Compound &compound, Factor &S,
+                             Vec &scratch) const;
+  template<typename Compound, typename Vec>
+  static void triangularize(Compound &A, Vec &scratch);
+  template<typename Factor, typename Vec>
+  static bool choleskyRankOneUpdate(Factor &S, Vec &v, const Scalar sign);
+};
+
+template<typename Scalar, int NStates, int NSensors>
+UnscentedKf<Scalar, NStates, NSensors>::UnscentedKf(int nStates,
+                                                    int nSensors) :
+    numStates(nStates), numSensors(nSensors)
+{
+  this->setWeightsAndCoeffs();
+}
+
+template<typename Scalar, int NStates, int NSensors>
+UnscentedKf<Scalar, NStates, NSensors>::~UnscentedKf()
+{
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::predictState(const StateVector &x,
+                                                          const StateMatrix &P,
+                                                          const StateMatrix &Q,
+                                                          const Scalar dt,
+                                                          Belief &out)
+{
+  // Compute sigma points around current estimated state
+  computeSigmaPoints(x, P, sigmaPointScalingCoeff, workspace.sigmaPoints);
 
-  virtual Eigen::VectorXd processFunc(Eigen::VectorXd x, double dt) = 0;
-  virtual Eigen::VectorXd observationFunc(Eigen::VectorXd z) = 0;
+  // Perform unscented transform on current estimated state to predict next
+  // state and covariance
+  unscentedStateTransform(workspace.sigmaPoints, Q, dt, out.state,
+                          out.covariance);
+}
 
-  struct Transform
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::correctState(const StateVector &x,
+                                                          const StateMatrix &P,
+                                                          const SensorVector &z,
+                                                          const SensorMatrix &R,
+                                                          Belief &out)
+{
+  Workspace &ws = workspace;
+  if (observationModel != NONLINEAR_OBSERVATION)
   {
-    Eigen::VectorXd vector;
-    Eigen::MatrixXd sigmaPoints;
-    Eigen::MatrixXd covariance;
-    Eigen::MatrixXd deviations;
-  };
+    LATENCY_SCOPE(GAIN_UPDATE);
+    computeLinearGain(x, P, R);
+    ws.innovation = z - ws.sensorMean;
+    out.state = x;
+    out.state.noalias() += ws.gain * ws.innovation;
+    out.covariance = P;
+    subtractOuterProduct(out.covariance, ws.gainTimesSqrt);
+    return;
+  }
+
+  computeSigmaPoints(x, P, sigmaPointScalingCoeff, ws.sigmaPoints);
+
+  // Predicted measurement vector and sensor-to-sensor covariance
+  unscentedSensorTransform(ws.sigmaPoints, R, ws.sensorMean,
+                           ws.sensorCovariance);
 
-  struct SigmaPointSet
+  // Compute state-to-sensor cross-covariance
+  LATENCY_SCOPE(GAIN_UPDATE);
+  computeDeviations(x, ws.sigmaPoints, ws.stateDeviations);
+  ws.weightedDeviations.noalias() = ws.stateDeviations
+      * covarianceWeights.asDiagonal();
+  ws.crossCovariance.noalias() = ws.weightedDeviations
+      * ws.sensorDeviations.transpose();
+
+  // Compute Kalman gain
+  ws.innovationLlt.compute(ws.sensorCovariance);
+  ws.sqrtSensorCovariance = ws.innovationLlt.matrixL();
+  computeGain();
+
+  // Update state vector
+  ws.innovation = z - ws.sensorMean;
+  out.state = x;
+  out.state.noalias() += ws.gain * ws.innovation;
+
+  // Update state covariance
+  out.covariance = P;
+  subtractOuterProduct(out.covariance, ws.gainTimesSqrt);
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::predictState(const Belief &in,
+                                                          const StateMatrix &Q,
+                                                          const Scalar dt,
+                                                          Belief &out)
+{
+  if (engine == SQUARE_ROOT_UKF)
   {
-    Eigen::VectorXd vector;
-    Eigen::MatrixXd sigmaPoints;
-  };
+    predictSqrtState(in.state, in.sqrtCovariance, Q, dt, out);
+  }
+  else
+  {
+    predictState(in.state, in.covariance, Q, dt, out);
+  }
+}
 
-  Transform unscentedStateTransform(const Eigen::MatrixXd sigmaPts,
-                                    const Eigen::VectorXd meanWts,
-                                    const Eigen::VectorXd covWts,
-                                    const Eigen::MatrixXd measNoiseCov,
-                                    const double dt);
-  SigmaPointSet sampleStateSpace(const Eigen::MatrixXd sigmaPts,
-                                 const Eigen::VectorXd meanWts,
-                                 const double dt);
-
-  Transform unscentedSensorTransform(const Eigen::MatrixXd sigmaPts,
-                                     const Eigen::VectorXd meanWts,
-                                     const Eigen::VectorXd covWts,
-                                     const Eigen::MatrixXd noiseCov);
-  SigmaPointSet sampleSensorSpace(const Eigen::MatrixXd sigmaPts,
-                                  const Eigen::VectorXd meanWts);
-
-  Eigen::MatrixXd computeCovariance(const Eigen::MatrixXd devs,
-                                    const Eigen::VectorXd covWts,
-                                    const Eigen::MatrixXd noiseCov) const;
-  Eigen::MatrixXd computeDeviations(
-      const UnscentedKf::SigmaPointSet sigmaPts) const;
-  Eigen::MatrixXd computeSigmaPoints(const Eigen::VectorXd x,
-                                     const Eigen::MatrixXd P,
-                                     const double scalingCoeff) const;
-  Eigen::MatrixXd fillMatrixWithVector(const Eigen::VectorXd vec,
-                                       const int numCols) const;
-};
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::correctState(const Belief &in,
+                                                          const SensorVector &z,
+                                                          const SensorMatrix &R,
+                                                          Belief &out)
+{
+  if (engine == SQUARE_ROOT_UKF && observationModel != NONLINEAR_OBSERVATION)
+  {
+    // The square-root engine keeps P up to date, so the gain comes from P and
+    // only the factor update needs S
+    LATENCY_SCOPE(GAIN_UPDATE);
+    Workspace &ws = workspace;
+    computeLinearGain(in.state, in.covariance, R);
+    ws.innovation = z - ws.sensorMean;
+    downdateSqrtCovariance(in.sqrtCovariance, ws.gainTimesSqrt, out);
+    out.state = in.state;
+    out.state.noalias() += ws.gain * ws.innovation;
+  }
+  else if (engine == SQUARE_ROOT_UKF)
+  {
+    correctSqrtState(in.state, in.sqrtCovariance, z, R, out);
+  }
+  else
+  {
+    correctState(in.state, in.covariance, z, R, out);
+  }
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::predictSqrtState(
+    const StateVector &x, const StateMatrix &S, const StateMatrix &Q,
+    const Scalar dt, Belief &out)
+{
+  Workspace &ws = workspace;
+  if (!(Q == ws.processNoise))
+  {
+    ws.processNoise = Q;
+    ws.covarianceLlt.compute(Q);
+    ws.sqrtProcessNoise = ws.covarianceLlt.matrixL();
+  }
+
+  {
+    LATENCY_SCOPE(SIGMA_POINTS);
+    spreadSigmaPoints(x, S, sigmaPointScalingCoeff, ws.sigmaPoints);
+  }
+  LATENCY_SCOPE(PROCESS);
+  sampleStateSpace(ws.sigmaPoints, dt, ws.propagatedPoints, out.state);
+  computeDeviations(out.state, ws.propagatedPoints, ws.stateDeviations);
+  if (computeSqrtCovariance(ws.stateDeviations, ws.sqrtProcessNoise,
+                            ws.stateCompound, out.sqrtCovariance,
+                            ws.stateUpdate))
+  {
+    out.covariance.noalias() = out.sqrtCovariance.template triangularView<
+        Eigen::Lower>() * out.sqrtCovariance.transpose();
+  }
+  else
+  {
+    ++factorizationFallbacks;
+    computeCovariance(ws.stateDeviations, Q, out.covariance);
+    ws.covarianceLlt.compute(out.covariance);
+    out.sqrtCovariance = ws.covarianceLlt.matrixL();
+  }
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::correctSqrtState(
+    const StateVector &x, const StateMatrix &S, const SensorVector &z,
+    const SensorMatrix &R, Belief &out)
+{
+  Workspace &ws = workspace;
+  if (!(R == ws.sensorNoise))
+  {
+    ws.sensorNoise = R;
+    ws.sensorNoiseLlt.compute(R);
+    ws.sqrtSensorNoise = ws.sensorNoiseLlt.matrixL();
+  }
+
+  // Predicted measurement and the factor of its covariance
+  {
+    LATENCY_SCOPE(SIGMA_POINTS);
+    spreadSigmaPoints(x, S, sigmaPointScalingCoeff, ws.sigmaPoints);
+  }
+  {
+    LATENCY_SCOPE(SENSOR_TRANSFORM);
+    sampleSensorSpace(ws.sigmaPoints, ws.sensorPoints, ws.sensorMean);
+    computeDeviations(ws.sensorMean, ws.sensorPoints, ws.sensorDeviations);
+    if (!computeSqrtCovariance(ws.sensorDeviations, ws.sqrtSensorNoise,
+                               ws.sensorCompound, ws.sqrtSensorCovariance,
+                               ws.sensorUpdate))
+    {
+      ++factorizationFallbacks;
+      computeCovariance(ws.sensorDeviations, R, ws.sensorCovariance);
+      ws.sensorNoiseLlt.compute(ws.sensorCovariance);
+      ws.sqrtSensorCovariance = ws.sensorNoiseLlt.matrixL();
+    }
+  }
+
+  // State-to-sensor cross-covariance
+  LATENCY_SCOPE(GAIN_UPDATE);
+  computeDeviations(x, ws.sigmaPoints, ws.stateDeviations);
+  ws.weightedDeviations.noalias() = ws.stateDeviations
+      * covarianceWeights.asDiagonal();
+  ws.crossCovariance.noalias() = ws.weightedDeviations
+      * ws.sensorDeviations.transpose();
+
+  computeGain();
+  ws.innovation = z - ws.sensorMean;
+
+  downdateSqrtCovariance(S, ws.gainTimesSqrt, out);
+
+  out.state = x;
+  out.state.noalias() += ws.gain * ws.innovation;
+}
+
+template<typename Scalar, int NStates, int NSensors>
+Scalar UnscentedKf<Scalar, NStates, NSensors>::correctLinearState(
+    const Belief &in, const PartialSensorVector &z,
+    const PartialObservationMatrix &H, const PartialSensorMatrix &R,
+    const bool sequential, Belief &out)
+{
+  if (sequential)
+  {
+    return correctSequentialState(in, z, H, R, out);
+  }
+
+  LATENCY_SCOPE(GAIN_UPDATE);
+  Workspace &ws = workspace;
+
+  // With P H^T = P_xz and H P H^T + R = L L^T, the correction is
+  // x + (P_xz L^-T)(L^-1 (z - H x)) and P - (P_xz L^-T)(P_xz L^-T)^T
+  ws.partialInnovation = z;
+  ws.partialInnovation.noalias() -= H * in.state;
+  ws.partialGainTimesSqrt.noalias() = in.covariance * H.transpose();
+  ws.partialCovariance = R;
+  ws.partialCovariance.noalias() += H * ws.partialGainTimesSqrt;
+  ws.partialLlt.compute(ws.partialCovariance);
+  ws.partialLlt.matrixU().template solveInPlace<Eigen::OnTheRight>(
+      ws.partialGainTimesSqrt);
+  ws.partialLlt.matrixL().solveInPlace(ws.partialInnovation);
+
+  if (engine == SQUARE_ROOT_UKF)
+  {
+    downdateSqrtCovariance(in.sqrtCovariance, ws.partialGainTimesSqrt, out);
+  }
+  else
+  {
+    out.covariance = in.covariance;
+    subtractOuterProduct(out.covariance, ws.partialGainTimesSqrt);
+  }
+  out.state = in.state;
+  out.state.noalias() += ws.partialGainTimesSqrt * ws.partialInnovation;
+  return ws.partialInnovation.squaredNorm();
+}
+
+/*
+ * correctLinearState() one row at a time. Whitening by the factor of R makes
+ * the rows independent with unit noise, so each is a scalar update
+ *   s = h P h^T + 1, x += P h^T (z_i - h x) / s, P -= P h^T h P / s,
+ * and the normalized innovation squared is the sum of the scalar ones. The
+ * square-root engine also applies every update to the factor as a rank-1
+ * downdate, and refactorizes P once if one of them loses definiteness.
+ */
+template<typename Scalar, int NStates, int NSensors>
+Scalar UnscentedKf<Scalar, NStates, NSensors>::correctSequentialState(
+    const Belief &in, const PartialSensorVector &z,
+    const PartialObservationMatrix &H, const PartialSensorMatrix &R,
+    Belief &out)
+{
+  LATENCY_SCOPE(GAIN_UPDATE);
+  Workspace &ws = workspace;
+  ws.partialLlt.compute(R);
+  ws.whitenedObservation = H;
+  ws.partialLlt.matrixL().solveInPlace(ws.whitenedObservation);
+  ws.partialInnovation = z;
+  ws.partialLlt.matrixL().solveInPlace(ws.partialInnovation);
+
+  const bool sqrtEngine = engine == SQUARE_ROOT_UKF;
+  bool definite = sqrtEngine;
+  if (sqrtEngine)
+  {
+    ws.sqrtCovariance = in.sqrtCovariance;
+  }
+  out.state = in.state;
+  out.covariance = in.covariance;
+
+  // Only the lower triangle of P is updated until all rows are in
+  Scalar nis = 0;
+  for (int i = 0; i < ws.whitenedObservation.rows(); ++i)
+  {
+    ws.stateUpdate.noalias() = out.covariance.template selfadjointView<
+        Eigen::Lower>() * ws.whitenedObservation.row(i).transpose();
+    const Scalar s = ws.whitenedObservation.row(i).dot(ws.stateUpdate) + 1;
+    const Scalar innovation = ws.partialInnovation(i)
+        - ws.whitenedObservation.row(i).dot(out.state);
+    nis += innovation * innovation / s;
+    out.state += (innovation / s) * ws.stateUpdate;
+    out.covariance.template selfadjointView<Eigen::Lower>().rankUpdate(
+        ws.stateUpdate, -1 / s);
+    if (definite)
+    {
+      ws.stateUpdate /= std::sqrt(s);
+      definite = choleskyRankOneUpdate(ws.sqrtCovariance, ws.stateUpdate, -1);
+    }
+  }
+
+  if (definite)
+  {
+    out.covariance.noalias() = ws.sqrtCovariance.template triangularView<
+        Eigen::Lower>() * ws.sqrtCovariance.transpose();
+    out.sqrtCovariance = ws.sqrtCovariance;
+  }
+  else
+  {
+    out.covariance.template triangularView<Eigen::StrictlyUpper>() =
+        out.covariance.transpose();
+    if (sqrtEngine)
+    {
+      ++factorizationFallbacks;
+      ws.covarianceLlt.compute(out.covariance);
+      out.sqrtCovariance = ws.covarianceLlt.matrixL();
+    }
+  }
+  return nis;
+}
+
+/*
+ * Innovation statistics and gain of a linear measurement, written to the
+ * workspace: sensorMean = H x, crossCovariance = P H^T, sensorCovariance =
+ * H P H^T + R, its lower factor sqrtSensorCovariance and the gain. A
+ * selection reads the rows and columns of P directly.
+ */
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::computeLinearGain(
+    const StateVector &x, const StateMatrix &P, const SensorMatrix &R)
+{
+  Workspace &ws = workspace;
+  if (observationModel == SELECTION_OBSERVATION)
+  {
+    for (int j = 0; j < numSensors; ++j)
+    {
+      ws.sensorMean(j) = x(selectedStates(j));
+      ws.crossCovariance.col(j) = P.col(selectedStates(j));
+    }
+    for (int i = 0; i < numSensors; ++i)
+    {
+      ws.sensorCovariance.row(i) = ws.crossCovariance.row(selectedStates(i));
+    }
+    ws.sensorCovariance += R;
+  }
+  else
+  {
+    ws.sensorMean.noalias() = observationMatrix * x;
+    ws.crossCovariance.noalias() = P * observationMatrix.transpose();
+    ws.sensorCovariance = R;
+    ws.sensorCovariance.noalias() += observationMatrix * ws.crossCovariance;
+  }
+
+  ws.innovationLlt.compute(ws.sensorCovariance);
+  ws.sqrtSensorCovariance = ws.innovationLlt.matrixL();
+  computeGain();
+}
+
+/*
+ * Kalman gain K = P_xz P_zz^-1 from crossCovariance and the lower factor L
+ * of P_zz in sqrtSensorCovariance, by triangular solves rather than an
+ * explicit inverse. Also leaves gainTimesSqrt = K L = P_xz L^-T, so that the
+ * covariance reduction K P_xz^T is the symmetric product of gainTimesSqrt
+ * with itself.
+ */
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::computeGain()
+{
+  Workspace &ws = workspace;
+  ws.gainTimesSqrt = ws.crossCovariance;
+  ws.sqrtSensorCovariance.transpose().template triangularView<Eigen::Upper>()
+      .template solveInPlace<Eigen::OnTheRight>(ws.gainTimesSqrt);
+  ws.gain = ws.gainTimesSqrt;
+  ws.sqrtSensorCovariance.template triangularView<Eigen::Lower>()
+      .template solveInPlace<Eigen::OnTheRight>(ws.gain);
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::predictionCrossCovariance(
+    const StateVector &x, StateMatrix &C)
+{
+  Workspace &ws = workspace;
+  ws.weightedDeviations.noalias() = (ws.sigmaPoints.colwise() - x)
+      * covarianceWeights.asDiagonal();
+  C.noalias() = ws.weightedDeviations * ws.stateDeviations.transpose();
+}
+
+// cov -= W W^T, accumulated in the lower triangle and mirrored so that the
+// result is exactly symmetric
+template<typename Scalar, int NStates, int NSensors>
+template<typename Cov, typename Factor>
+void UnscentedKf<Scalar, NStates, NSensors>::subtractOuterProduct(
+    Cov &cov, const Factor &W)
+{
+  cov.template selfadjointView<Eigen::Lower>().rankUpdate(W, -1);
+  cov.template triangularView<Eigen::StrictlyUpper>() = cov.transpose();
+}
+
+/*
+ * Writes the corrected covariance S S^T - W W^T and its factor to out, given
+ * the prior factor S and W = K S_z, the gain times the innovation factor.
+ */
+template<typename Scalar, int NStates, int NSensors>
+template<typename Factor>
+void UnscentedKf<Scalar, NStates, NSensors>::downdateSqrtCovariance(
+    const StateMatrix &S, const Factor &W, Belief &out)
+{
+  Workspace &ws = workspace;
+
+  // One rank-1 downdate per column of W. The downdate runs on a copy so that
+  // S is still intact if it has to be abandoned.
+  ws.sqrtCovariance = S;
+  bool definite = true;
+  for (int j = 0; j < W.cols() && definite; ++j)
+  {
+    ws.stateUpdate = W.col(j);
+    definite = choleskyRankOneUpdate(ws.sqrtCovariance, ws.stateUpdate, -1);
+  }
+
+  if (definite)
+  {
+    out.covariance.noalias() = ws.sqrtCovariance.template triangularView<
+        Eigen::Lower>() * ws.sqrtCovariance.transpose();
+  }
+  else
+  {
+    // Rounding pushed the downdate out of the positive definite cone, so
+    // form the covariance explicitly and refactorize it once.
+    ++factorizationFallbacks;
+    out.covariance.noalias() = S.template triangularView<Eigen::Lower>()
+        * S.transpose();
+    subtractOuterProduct(out.covariance, W);
+    ws.covarianceLlt.compute(out.covariance);
+    ws.sqrtCovariance = ws.covarianceLlt.matrixL();
+  }
+  out.sqrtCovariance = ws.sqrtCovariance;
+}
+
+/*
+ * Computes the lower Cholesky factor of
+ *   sum_i w_i devs_i devs_i^T + sqrtNoise sqrtNoise^T
+ * by triangularizing the stacked matrix of the weighted deviations and the
+ * noise factor, then folding in the center point with a rank-1
+ * update or downdate depending on the sign of its weight. Returns false if
+ * that downdate fails.
+ */
+template<typename Scalar, int NStates, int NSensors>
+template<typename Devs, typename Noise, typename Compound, typename Factor,
+    typename Vec>
+bool UnscentedKf<Scalar, NStates, NSensors>::computeSqrtCovariance(
+    const Devs &devs, const Noise &sqrtNoise, Compound &compound, Factor &S,
+    Vec &scratch) const
+{
+  const int n = devs.rows();
+  const int numOuterPts = devs.cols() - 1;
+  compound.resize(numOuterPts + n, n);
+  compound.topRows(numOuterPts).noalias() = sqrtOuterWeights.asDiagonal()
+      * devs.rightCols(numOuterPts).transpose();
+  compound.bottomRows(n) = sqrtNoise.transpose();
+
+  triangularize(compound, scratch);
+  S = compound.topRows(n).template triangularView<Eigen::Upper>()
+      .transpose();
+
+  // R from the QR decomposition is only unique up to the sign of its rows
+  for (int i = 0; i < n; ++i)
+  {
+    if (S(i, i) < 0)
+    {
+      S.col(i) = -S.col(i);
+    }
+  }
+
+  const Scalar centerWeight = covarianceWeights(0);
+  scratch = std::sqrt(std::abs(centerWeight)) * devs.col(0);
+  return choleskyRankOneUpdate(S, scratch, centerWeight < 0 ? -1 : 1);
+}
+
+/*
+ * Overwrites A with the R factor of its QR decomposition A = Q R, in its
+ * upper triangle, by one Householder reflection per column; Q is not formed.
+ * This is HouseholderQR's unblocked path, which is all it runs for up to 48
+ * columns. Its blocked path beyond that allocates, while this only needs
+ * scratch for A.cols() elements.
+ */
+template<typename Scalar, int NStates, int NSensors>
+template<typename Compound, typename Vec>
+void UnscentedKf<Scalar, NStates, NSensors>::triangularize(Compound &A,
+                                                           Vec &scratch)
+{
+  const int rows = A.rows(), cols = A.cols();
+  for (int k = 0; k < cols; ++k)
+  {
+    const int remainingRows = rows - k;
+    Scalar tau, beta;
+    A.col(k).tail(remainingRows).makeHouseholderInPlace(tau, beta);
+    A(k, k) = beta;
+    A.bottomRightCorner(remainingRows, cols - k - 1)
+        .applyHouseholderOnTheLeft(A.col(k).tail(remainingRows - 1), tau,
+                                   scratch.data());
+  }
+}
+
+/*
+ * Replaces the lower Cholesky factor S of A with that of A + sign * v v^T in
+ * O(n^2). Returns false if a downdate would make A indefinite, in which case
+ * S is left partially updated. v is used as scratch space.
+ */
+template<typename Scalar, int NStates, int NSensors>
+template<typename Factor, typename Vec>
+bool UnscentedKf<Scalar, NStates, NSensors>::choleskyRankOneUpdate(
+    Factor &S, Vec &v, const Scalar sign)
+{
+  const int n = S.rows();
+  for (int k = 0; k < n; ++k)
+  {
+    const Scalar diagSq = S(k, k) * S(k, k) + sign * v(k) * v(k);
+    if (!(diagSq > 0))
+    {
+      return false;
+    }
+    const Scalar r = std::sqrt(diagSq);
+    const Scalar c = r / S(k, k);
+    const Scalar s = v(k) / S(k, k);
+    S(k, k) = r;
+
+    const int m = n - k - 1;
+    if (m > 0)
+    {
+      S.col(k).tail(m) = (S.col(k).tail(m) + sign * s * v.tail(m)) / c;
+      v.tail(m) = c * v.tail(m) - s * S.col(k).tail(m);
+    }
+  }
+  return true;
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::unscentedStateTransform(
+    const StateSigmaMatrix &sigmaPts, const StateMatrix &noiseCov,
+    const Scalar dt, StateVector &vec, StateMatrix &cov)
+{
+  LATENCY_SCOPE(PROCESS);
+  sampleStateSpace(sigmaPts, dt, workspace.propagatedPoints, vec);
+  computeDeviations(vec, workspace.propagatedPoints,
+                    workspace.stateDeviations);
+  computeCovariance(workspace.stateDeviations, noiseCov, cov);
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::unscentedSensorTransform(
+    const StateSigmaMatrix &sigmaPts, const SensorMatrix &noiseCov,
+    SensorVector &vec, SensorMatrix &cov)
+{
+  LATENCY_SCOPE(SENSOR_TRANSFORM);
+  sampleSensorSpace(sigmaPts, workspace.sensorPoints, vec);
+  computeDeviations(vec, workspace.sensorPoints, workspace.sensorDeviations);
+
+  computeCovariance(workspace.sensorDeviations, noiseCov, cov);
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::computeSigmaPoints(
+    const StateVector &x, const StateMatrix &P, const Scalar scalingCoeff,
+    StateSigmaMatrix &sigmaPts)
+{
+  // Compute lower Cholesky factor of the given covariance matrix P
+  LATENCY_SCOPE(SIGMA_POINTS);
+  workspace.covarianceLlt.compute(P);
+  workspace.sqrtCovariance = workspace.covarianceLlt.matrixL();
+  spreadSigmaPoints(x, workspace.sqrtCovariance, scalingCoeff, sigmaPts);
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::spreadSigmaPoints(
+    const StateVector &x, const StateMatrix &sqrtP, const Scalar scalingCoeff,
+    StateSigmaMatrix &sigmaPts) const
+{
+  sigmaPts.resize(numStates, meanWeights.rows());
+  if (sigmaPointSet == SYMMETRIC_SIGMA_POINTS)
+  {
+    // Populate sigma point matrix as [x, x + A, x - A] with A = c * sqrt(P)
+    sigmaPts.col(0) = x;
+    sigmaPts.middleCols(1, numStates) = (scalingCoeff * sqrtP).colwise() + x;
+    sigmaPts.rightCols(numStates) = (-scalingCoeff * sqrtP).colwise() + x;
+    return;
+  }
+
+  // The simplex sets are already scaled, so scalingCoeff does not apply
+  sigmaPts.noalias() = sqrtP.template triangularView<Eigen::Lower>()
+      * sigmaPointOffsets;
+  sigmaPts.colwise() += x;
+}
+
+template<typename Scalar, int NStates, int NSensors>
+template<typename Vec, typename Sigmas>
+void UnscentedKf<Scalar, NStates, NSensors>::computeDeviations(
+    const Vec &vec, const Sigmas &sigmaPts, Sigmas &devs) const
+{
+  devs = sigmaPts.colwise() - vec;
+}
+
+template<typename Scalar, int NStates, int NSensors>
+template<typename Devs, typename Cov>
+void UnscentedKf<Scalar, NStates, NSensors>::computeCovariance(
+    const Devs &deviations, const Cov &noiseCov, Cov &cov) const
+{
+  // Symmetric rank-k updates of the lower triangle only: one for the outer
+  // points if they share a weight, else one per point, and one for the
+  // center point, whose weight may be negative. The upper triangle is
+  // mirrored from it.
+  const int numOuterPts = deviations.cols() - 1;
+  cov = noiseCov;
+  if (equalOuterWeights)
+  {
+    cov.template selfadjointView<Eigen::Lower>().rankUpdate(
+        deviations.rightCols(numOuterPts), covarianceWeights(1));
+  }
+  else
+  {
+    for (int i = 1; i <= numOuterPts; ++i)
+    {
+      cov.template selfadjointView<Eigen::Lower>().rankUpdate(
+          deviations.col(i), covarianceWeights(i));
+    }
+  }
+  cov.template selfadjointView<Eigen::Lower>().rankUpdate(
+      deviations.col(0), covarianceWeights(0));
+  cov.template triangularView<Eigen::StrictlyUpper>() = cov.transpose();
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::sampleStateSpace(
+    const StateSigmaMatrix &sigmaPts, const Scalar dt,
+    StateSigmaMatrix &sigmas, StateVector &vec)
+{
+  processBatch(sigmaPts, dt, sigmas);
+  vec.noalias() = sigmas * meanWeights;
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::sampleSensorSpace(
+    const StateSigmaMatrix &sigmaPts, SensorSigmaMatrix &sigmas,
+    SensorVector &vec)
+{
+  observationBatch(sigmaPts, sigmas);
+  vec.noalias() = sigmas * meanWeights;
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::processBatch(
+    const StateSigmaMatrix &sigmaPts, const Scalar dt, StateSigmaMatrix &out)
+{
+  const int numCols = sigmaPts.cols();
+  for (int i = 0; i < numCols; ++i)
+  {
+    processFunc(sigmaPts.col(i), dt, out.col(i));
+  }
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::observationBatch(
+    const StateSigmaMatrix &sigmaPts, SensorSigmaMatrix &out)
+{
+  const int numCols = sigmaPts.cols();
+  for (int i = 0; i < numCols; ++i)
+  {
+    observationFunc(sigmaPts.col(i), out.col(i));
+  }
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::Workspace::resize(int nStates,
+                                                               int nSensors,
+                                                               int nSigma)
+{
+  if (NStates == Eigen::Dynamic)
+  {
+    covarianceLlt = Eigen::LLT<StateMatrix>(nStates);
+  }
+  if (NSensors == Eigen::Dynamic)
+  {
+    innovationLlt = Eigen::LLT<SensorMatrix>(nSensors);
+  }
+  sqrtCovariance.resize(nStates, nStates);
+  sigmaPoints.resize(nStates, nSigma);
+  propagatedPoints.resize(nStates, nSigma);
+  stateDeviations.resize(nStates, nSigma);
+  weightedDeviations.resize(nStates, nSigma);
+  sensorPoints.resize(nSensors, nSigma);
+  sensorDeviations.resize(nSensors, nSigma);
+  sensorMean.resize(nSensors);
+  innovation.resize(nSensors);
+  sensorCovariance.resize(nSensors, nSensors);
+  crossCovariance.resize(nStates, nSensors);
+  gain.resize(nStates, nSensors);
+
+  const int numOuterPts = nSigma - 1;
+  if (NSensors == Eigen::Dynamic)
+  {
+    sensorNoiseLlt = Eigen::LLT<SensorMatrix>(nSensors);
+  }
+  stateCompound.resize(numOuterPts + nStates, nStates);
+  sensorCompound.resize(numOuterPts + nSensors, nSensors);
+  processNoise = StateMatrix::Zero(nStates, nStates);
+  sqrtProcessNoise = StateMatrix::Zero(nStates, nStates);
+  sensorNoise = SensorMatrix::Zero(nSensors, nSensors);
+  sqrtSensorNoise = SensorMatrix::Zero(nSensors, nSensors);
+  sqrtSensorCovariance.resize(nSensors, nSensors);
+  gainTimesSqrt.resize(nStates, nSensors);
+  stateUpdate.resize(nStates);
+  sensorUpdate.resize(nSensors);
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::setEngine(Engine e)
+{
+  engine = e;
+}
+
+template<typename Scalar, int NStates, int NSensors>
+typename UnscentedKf<Scalar, NStates, NSensors>::Engine UnscentedKf<Scalar,
+    NStates, NSensors>::getEngine() const
+{
+  return engine;
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::setSigmaPointSet(
+    SigmaPointSet set)
+{
+  sigmaPointSet = set;
+  setWeightsAndCoeffs();
+}
+
+template<typename Scalar, int NStates, int NSensors>
+typename UnscentedKf<Scalar, NStates, NSensors>::SigmaPointSet UnscentedKf<
+    Scalar, NStates, NSensors>::getSigmaPointSet() const
+{
+  return sigmaPointSet;
+}
+
+template<typename Scalar, int NStates, int NSensors>
+int UnscentedKf<Scalar, NStates, NSensors>::numSigmaPoints() const
+{
+  return meanWeights.rows();
+}
+
+template<typename Scalar, int NStates, int NSensors>
+long UnscentedKf<Scalar, NStates, NSensors>::getFactorizationFallbacks() const
+{
+  return factorizationFallbacks;
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::setLinearObservation(
+    const ObservationMatrix &H)
+{
+  eigen_assert(H.rows() == numSensors && H.cols() == numStates);
+  observationMatrix = H;
+  observationModel = LINEAR_OBSERVATION;
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::setSelectionObservation(
+    const SelectionVector &indices)
+{
+  eigen_assert(indices.rows() == numSensors);
+  selectedStates = indices;
+  observationModel = SELECTION_OBSERVATION;
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::setNonlinearObservation()
+{
+  observationModel = NONLINEAR_OBSERVATION;
+}
+
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::setWeightsAndCoeffs()
+{
+  eigen_assert(NStates == Eigen::Dynamic || numStates == NStates);
+  eigen_assert(NSensors == Eigen::Dynamic || numSensors == NSensors);
+
+  lambda = (std::pow(ALPHA, 2) * (numStates + KAPPA)) - numStates;
+  sigmaPointScalingCoeff = std::sqrt(numStates + lambda);
+
+  // Set up mean weights
+  if (sigmaPointSet == SYMMETRIC_SIGMA_POINTS)
+  {
+    meanWeights = WeightVector::Zero(2 * numStates + 1);
+    meanWeights(0) = lambda / (numStates + lambda);
+    for (int i = 1; i < meanWeights.rows(); ++i)
+    {
+      meanWeights(i) = 1 / (2 * (numStates + lambda));
+    }
+  }
+  else
+  {
+    // Scale the unit simplex towards its center by ALPHA, as the symmetric
+    // set is through lambda
+    setSimplexOffsets();
+    const Scalar alphaSq = ALPHA * ALPHA;
+    sigmaPointOffsets *= ALPHA;
+    meanWeights /= alphaSq;
+    meanWeights(0) += 1 - 1 / alphaSq;
+  }
+
+  // Set up covariance weights
+  covarianceWeights = meanWeights;
+  covarianceWeights(0) += (1 - std::pow(ALPHA, 2) + BETA);
+
+  const int numOuterPts = meanWeights.rows() - 1;
+  sqrtOuterWeights = covarianceWeights.tail(numOuterPts).cwiseSqrt();
+  equalOuterWeights = (covarianceWeights.tail(numOuterPts).array()
+      == covarianceWeights(1)).all();
+
+  workspace.resize(numStates, numSensors, meanWeights.rows());
+}
+
+/*
+ * Builds the unit simplex set's offsets in sigmaPointOffsets and its weights
+ * in meanWeights (Julier, "The spherical simplex unscented transformation", 2003, and
+ * Julier and Uhlmann, "Reduced sigma point filters", 2002). Both sets grow
+ * one state at a time: the points so far get a new coordinate -a_j and one
+ * new point is added at +b_j on the new axis alone, with a_j and b_j chosen
+ * so that the weighted mean stays zero and the new variance is one.
+ */
+template<typename Scalar, int NStates, int NSensors>
+void UnscentedKf<Scalar, NStates, NSensors>::setSimplexOffsets()
+{
+  const int n = numStates;
+  const Scalar w0 = SIMPLEX_CENTER_WEIGHT;
+  WeightVector &weights = meanWeights;
+  weights = WeightVector::Zero(n + 2);
+  sigmaPointOffsets = StateSigmaMatrix::Zero(n, n + 2);
+  weights(0) = w0;
+
+  if (sigmaPointSet == SPHERICAL_SIMPLEX_SIGMA_POINTS)
+  {
+    const Scalar w = (1 - w0) / (n + 1);
+    weights.tail(n + 1).setConstant(w);
+    for (int j = 1; j <= n; ++j)
+    {
+      const Scalar a = 1 / std::sqrt(j * (j + 1) * w);
+      sigmaPointOffsets.row(j - 1).segment(1, j).setConstant(-a);
+      sigmaPointOffsets(j - 1, j + 1) = j * a;
+    }
+  }
+  else
+  {
+    // W_1 = W_2 = (1 - W_0) / 2^n, and W_i = 2^(i - 2) W_1 after that, so
+    // the points before point j + 1 weigh as much as it does
+    weights(1) = (1 - w0) / std::pow(Scalar(2), n);
+    for (int i = 2; i <= n + 1; ++i)
+    {
+      weights(i) = std::pow(Scalar(2), i - 2) * weights(1);
+    }
+    for (int j = 1; j <= n; ++j)
+    {
+      const Scalar a = 1 / std::sqrt(2 * weights(j + 1));
+      sigmaPointOffsets.row(j - 1).segment(1, j).setConstant(-a);
+      sigmaPointOffsets(j - 1, j + 1) = a;
+    }
+  }
+}
 
 #endif  // UNSCENTEDKF_H_
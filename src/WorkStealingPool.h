@@ -0,0 +1,119 @@
+#ifndef WORKSTEALINGPOOL_H_
+#define WORKSTEALINGPOOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Runs a fixed set of independent tasks over numThreads threads. Task
+ * indices are dealt out up front in contiguous ranges, one deque per worker.
+ * Each worker takes tasks from the back of its own deque and, once that is
+ * empty, steals from the front of the others', so uneven task lengths (logs
+ * of very different durations) even out without a shared queue on the fast
+ * path. Tasks do not spawn tasks, so a worker is done as soon as every deque
+ * is empty.
+ */
+class WorkStealingPool
+{
+public:
+  explicit WorkStealingPool(int numThreads) :
+      numThreads(std::max(numThreads, 1)), numSteals(0)
+  {
+  }
+
+  // Calls task(i, worker) for every i in [0, numTasks) and returns when all
+  // have finished. worker identifies the calling thread in [0, numThreads).
+  template<typename Task>
+  void run(int numTasks, Task task)
+  {
+    const int numWorkers = std::max(std::min(numThreads, numTasks), 1);
+    std::vector<WorkerQueue> queues(numWorkers);
+    for (int w = 0; w < numWorkers; ++w)
+    {
+      const int begin = long(numTasks) * w / numWorkers;
+      const int end = long(numTasks) * (w + 1) / numWorkers;
+      for (int i = begin; i < end; ++i)
+      {
+        queues[w].tasks.push_back(i);
+      }
+    }
+
+    auto work = [this, &queues, &task, numWorkers](int w)
+    {
+      int i;
+      while (popOwn(queues[w], i) || steal(queues, w, i))
+      {
+        task(i, w);
+      }
+    };
+
+    std::vector<std::thread> workers;
+    for (int w = 1; w < numWorkers; ++w)
+    {
+      workers.push_back(std::thread(work, w));
+    }
+    work(0);
+    for (size_t w = 0; w < workers.size(); ++w)
+    {
+      workers[w].join();
+    }
+  }
+
+  int threads() const
+  {
+    return numThreads;
+  }
+
+  // Tasks taken from another worker's deque, over every run so far
+  long steals() const
+  {
+    return numSteals.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct WorkerQueue
+  {
+    std::mutex lock;
+    std::deque<int> tasks;
+  };
+
+  const int numThreads;
+  std::atomic<long> numSteals;
+
+  static bool popOwn(WorkerQueue &q, int &task)
+  {
+    std::lock_guard<std::mutex> guard(q.lock);
+    if (q.tasks.empty())
+    {
+      return false;
+    }
+    task = q.tasks.back();
+    q.tasks.pop_back();
+    return true;
+  }
+
+  // Takes the oldest task of the first non-empty deque after thief's
+  bool steal(std::vector<WorkerQueue> &queues, const int thief, int &task)
+  {
+    const int n = queues.size();
+    for (int k = 1; k < n; ++k)
+    {
+      WorkerQueue &victim = queues[(thief + k) % n];
+      std::lock_guard<std::mutex> guard(victim.lock);
+      if (!victim.tasks.empty())
+      {
+        task = victim.tasks.front();
+        victim.tasks.pop_front();
+        numSteals.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+#endif  // WORKSTEALINGPOOL_H_
@@ -0,0 +1,590 @@
+#include "QuadUkf.h"
+#include "SensorLog.h"
+#include "WorkStealingPool.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Replays many recorded flights through QuadUkf under a grid of noise and
+ * filter settings, every (log, configuration) pair as one task on a
+ * work-stealing thread pool. Without ground truth, each run is scored on its
+ * pose innovations: RMS position and attitude residuals of the prediction
+ * against each pose, and the normalized innovation squared (NIS), whose mean
+ * should be close to the number of measured components for a well tuned
+ * filter. One CSV line per run is written, followed by a summary per
+ * configuration averaged over all logs.
+ *
+ * The float and mixed precision filters are scored against the double
+ * precision run of the same log and settings, when the sweep includes it,
+ * by the RMS position and attitude differences of their beliefs after each
+ * pose; with records_per_s that is the accuracy against throughput of each
+ * precision.
+ */
+
+namespace
+{
+
+// 95% quantile of the chi-squared distribution with QuadUkf::numSensors = 9
+// degrees of freedom
+const double NIS_BOUND_95 = 16.919;
+
+enum Precision
+{
+  DOUBLE_PRECISION, FLOAT_PRECISION, MIXED_PRECISION
+};
+
+struct Config
+{
+  double qScale;
+  double rScale;
+  QuadUkf::Engine engine;
+  QuadUkf::SigmaPointSet sigmaPointSet;
+  double preintegrationPeriod;  // negative: one prediction per IMU sample
+  Precision precision;
+};
+
+struct RunResult
+{
+  bool ok;
+  std::string error;
+  long numImu, numPose;
+  double elapsed;
+  double positionRms, attitudeRmsDeg, velocityRms;
+  double meanNis, nisWithinBound;
+  double finalCovarianceTrace;
+  long sqrtFallbacks, lateSamples, discardedSamples;
+
+  // Belief position and quaternion (x y z w) after each pose
+  std::vector<double> track;
+  double positionDev, attitudeDevDeg;  // NaN without a double run
+};
+
+const char *engineNames[] = {"standard", "sqrt"};
+const char *sigmaPointSetNames[] = {"symmetric", "simplex", "skew"};
+const char *precisionNames[] = {"double", "float", "mixed"};
+
+void printUsage(const char *prog)
+{
+  std::fprintf(stderr,
+      "usage: %s LOGS [options]\n"
+      "  LOGS is a directory of logs or a manifest file listing one log\n"
+      "  path per line (relative to the manifest; '#' starts a comment).\n"
+      "  Every option below takes a comma-separated list; the runs cover\n"
+      "  every combination.\n"
+      "  --q SCALES            process noise Q = SCALE * I on the motion\n"
+      "                        states (default 0.01)\n"
+      "  --r SCALES            sensor noise R = SCALE * I (default 0.01)\n"
+      "  --engine NAMES        standard, sqrt (default standard)\n"
+      "  --sigma-points NAMES  symmetric, simplex, skew (default symmetric)\n"
+      "  --preintegrate SECS   IMU preintegration period, -1 for none\n"
+      "                        (default -1)\n"
+      "  --precision NAMES     double, float, mixed (double precision\n"
+      "                        with float sigma point propagation)\n"
+      "                        (default double)\n"
+      "  --threads N           worker threads (default: all cores)\n"
+      "  --report FILE         write the per-run CSV to FILE, not stdout\n",
+      prog);
+}
+
+bool parseNumbers(const char *arg, std::vector<double> &out)
+{
+  out.clear();
+  std::string list(arg);
+  size_t start = 0;
+  while (start <= list.size())
+  {
+    const size_t end = std::min(list.find(',', start), list.size());
+    const std::string item = list.substr(start, end - start);
+    char *parsed;
+    const double value = std::strtod(item.c_str(), &parsed);
+    if (item.empty() || *parsed != '\0')
+    {
+      return false;
+    }
+    out.push_back(value);
+    start = end + 1;
+  }
+  return true;
+}
+
+// Maps each comma-separated name to its index in names
+bool parseNames(const char *arg, const char **names, const int numNames,
+                std::vector<int> &out)
+{
+  out.clear();
+  std::string list(arg);
+  size_t start = 0;
+  while (start <= list.size())
+  {
+    const size_t end = std::min(list.find(',', start), list.size());
+    const std::string item = list.substr(start, end - start);
+    int index = -1;
+    for (int i = 0; i < numNames; ++i)
+    {
+      if (item == names[i])
+      {
+        index = i;
+      }
+    }
+    if (index < 0)
+    {
+      return false;
+    }
+    out.push_back(index);
+    start = end + 1;
+  }
+  return true;
+}
+
+// Lists the regular files of a directory, except hidden ones, in name order
+bool listDirectory(const std::string &dir, std::vector<std::string> &logs)
+{
+  DIR *d = opendir(dir.c_str());
+  if (!d)
+  {
+    return false;
+  }
+  while (dirent *entry = readdir(d))
+  {
+    if (entry->d_name[0] == '.')
+    {
+      continue;
+    }
+    const std::string path = dir + "/" + entry->d_name;
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+    {
+      logs.push_back(path);
+    }
+  }
+  closedir(d);
+  std::sort(logs.begin(), logs.end());
+  return true;
+}
+
+bool readManifest(const std::string &manifest, std::vector<std::string> &logs)
+{
+  std::FILE *f = std::fopen(manifest.c_str(), "r");
+  if (!f)
+  {
+    return false;
+  }
+  const size_t slash = manifest.rfind('/');
+  const std::string base = (slash == std::string::npos) ? "" :
+      manifest.substr(0, slash + 1);
+  char line[4096];
+  while (std::fgets(line, sizeof(line), f))
+  {
+    std::string path(line);
+    path = path.substr(0, path.find('#'));
+    const size_t first = path.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos)
+    {
+      continue;
+    }
+    path = path.substr(first, path.find_last_not_of(" \t\r\n") - first + 1);
+    logs.push_back(path[0] == '/' ? path : base + path);
+  }
+  std::fclose(f);
+  return true;
+}
+
+template<typename Filter>
+RunResult runFilter(const std::string &logPath, const Config &config)
+{
+  RunResult r = RunResult();
+  SensorLogReader reader;
+  if (!reader.open(logPath))
+  {
+    r.error = reader.error();
+    return r;
+  }
+
+  // The filter starts at the first record's time stamp
+  SensorRecord rec;
+  const bool haveFirst = reader.next(rec);
+  Filter *ukf = new Filter(haveFirst ? rec.timeStamp : 0);
+  ukf->setEngine(typename Filter::Engine(config.engine));
+  ukf->setSigmaPointSet(typename Filter::SigmaPointSet(config.sigmaPointSet));
+  if (config.preintegrationPeriod >= 0)
+  {
+    ukf->setImuPreintegration(true, config.preintegrationPeriod);
+  }
+  ukf->setProcessCovariance(Filter::scaledProcessCovariance(config.qScale));
+  for (int s = Filter::POSE_SENSOR; s <= Filter::POSITION_SENSOR; ++s)
+  {
+    const int n = ukf->getSensorInnovation(s).residual.rows();
+    ukf->setSensorCovariance(s, config.rScale
+        * Filter::PartialSensorMatrix::Identity(n, n));
+  }
+
+  typename Filter::ImuSample imu;
+  typename Filter::PoseSample pose;
+  typename Filter::SensorSample sample;
+  double positionSq = 0, attitudeSq = 0, velocitySq = 0, nisSum = 0;
+  long numWithinBound = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (bool ok = haveFirst; ok; ok = reader.next(rec))
+  {
+    if (rec.type == SensorRecord::IMU)
+    {
+      imu.timeStamp = rec.timeStamp;
+      imu.angularVelocity << rec.values[0], rec.values[1], rec.values[2];
+      imu.linearAcceleration << rec.values[3], rec.values[4], rec.values[5];
+      ukf->imuUpdate(imu);
+      ++r.numImu;
+      continue;
+    }
+    if (rec.type != SensorRecord::POSE)
+    {
+      // Altitude, flow and position records feed the built-in sensors
+      sample.timeStamp = rec.timeStamp;
+      sample.sensor = rec.type == SensorRecord::ALTITUDE ?
+          Filter::ALTIMETER_SENSOR : rec.type == SensorRecord::FLOW ?
+          Filter::OPTICAL_FLOW_SENSOR : Filter::POSITION_SENSOR;
+      sample.values.template head<3>() << rec.values[0], rec.values[1],
+          rec.values[2];
+      ukf->sensorUpdate(sample);
+      continue;
+    }
+
+    pose.timeStamp = rec.timeStamp;
+    pose.position << rec.values[0], rec.values[1], rec.values[2];
+    pose.orientation.coeffs() << rec.values[3], rec.values[4], rec.values[5],
+        rec.values[6];
+    ukf->poseUpdate(pose);
+    ++r.numPose;
+
+    const typename Filter::PoseInnovation &inn = ukf->getPoseInnovation();
+    positionSq += inn.residual.template head<3>().squaredNorm();
+    attitudeSq += inn.residual.template segment<3>(3).squaredNorm();
+    velocitySq += inn.residual.template tail<3>().squaredNorm();
+    nisSum += inn.nis;
+    numWithinBound += (inn.nis <= NIS_BOUND_95);
+
+    const typename Filter::QuadState &x = ukf->getBelief().state;
+    for (int i = 0; i < 3; ++i)
+    {
+      r.track.push_back(x.position(i));
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+      r.track.push_back(x.quaternion.coeffs()(i));
+    }
+  }
+  r.elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  if (!reader.error().empty())
+  {
+    r.error = reader.error();
+  }
+  else
+  {
+    r.ok = true;
+    const double n = std::max(r.numPose, 1L);
+    r.positionRms = std::sqrt(positionSq / n);
+    r.attitudeRmsDeg = std::sqrt(attitudeSq / n) * 180 / M_PI;
+    r.velocityRms = std::sqrt(velocitySq / n);
+    r.meanNis = nisSum / n;
+    r.nisWithinBound = numWithinBound / n;
+    r.finalCovarianceTrace = ukf->getBelief().covariance.trace();
+    r.sqrtFallbacks = ukf->getFactorizationFallbacks();
+    const typename Filter::HistoryStats h = ukf->getHistoryStats();
+    r.lateSamples = h.outOfSequence;
+    r.discardedSamples = h.discarded;
+  }
+  delete ukf;
+  return r;
+}
+
+RunResult runLog(const std::string &logPath, const Config &config)
+{
+  if (config.precision == FLOAT_PRECISION)
+  {
+    return runFilter<QuadUkfFloat>(logPath, config);
+  }
+  if (config.precision == MIXED_PRECISION)
+  {
+    return runFilter<QuadUkfMixed>(logPath, config);
+  }
+  return runFilter<QuadUkf>(logPath, config);
+}
+
+// Whether two configurations differ in precision only
+bool sameSettings(const Config &a, const Config &b)
+{
+  return a.qScale == b.qScale && a.rScale == b.rScale && a.engine == b.engine
+      && a.sigmaPointSet == b.sigmaPointSet
+      && a.preintegrationPeriod == b.preintegrationPeriod;
+}
+
+// Sets the RMS position and attitude differences of a run's beliefs from
+// those of the double precision run of the same log and settings
+void compareTracks(const RunResult &reference, RunResult &r)
+{
+  const int n = std::min(r.track.size(), reference.track.size()) / 7;
+  double positionSq = 0, attitudeSq = 0;
+  for (int k = 0; k < n; ++k)
+  {
+    const double *a = &r.track[7 * k];
+    const double *b = &reference.track[7 * k];
+    for (int i = 0; i < 3; ++i)
+    {
+      positionSq += (a[i] - b[i]) * (a[i] - b[i]);
+    }
+    const double angle = Eigen::Map<const Eigen::Quaterniond>(a + 3)
+        .angularDistance(Eigen::Map<const Eigen::Quaterniond>(b + 3));
+    attitudeSq += angle * angle;
+  }
+  const double k = std::max(n, 1);
+  r.positionDev = std::sqrt(positionSq / k);
+  r.attitudeDevDeg = std::sqrt(attitudeSq / k) * 180 / M_PI;
+}
+
+void printConfig(std::FILE *out, const Config &c)
+{
+  std::fprintf(out, "%g,%g,%s,%s,%g,%s", c.qScale, c.rScale,
+               engineNames[c.engine], sigmaPointSetNames[c.sigmaPointSet],
+               c.preintegrationPeriod, precisionNames[c.precision]);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  const std::string logsPath = argv[1];
+  std::vector<double> qScales(1, 0.01), rScales(1, 0.01);
+  std::vector<double> preintegrationPeriods(1, -1);
+  std::vector<int> engines(1, QuadUkf::STANDARD_UKF);
+  std::vector<int> sigmaPointSets(1, QuadUkf::SYMMETRIC_SIGMA_POINTS);
+  std::vector<int> precisions(1, DOUBLE_PRECISION);
+  int numThreads = std::thread::hardware_concurrency();
+  std::string reportPath;
+  for (int i = 2; i < argc; ++i)
+  {
+    // Every option takes a value
+    if (i + 1 >= argc)
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+    const char *option = argv[i];
+    const char *value = argv[++i];
+    bool ok = true;
+    if (std::strcmp(option, "--q") == 0)
+    {
+      ok = parseNumbers(value, qScales);
+    }
+    else if (std::strcmp(option, "--r") == 0)
+    {
+      ok = parseNumbers(value, rScales);
+    }
+    else if (std::strcmp(option, "--engine") == 0)
+    {
+      ok = parseNames(value, engineNames, 2, engines);
+    }
+    else if (std::strcmp(option, "--sigma-points") == 0)
+    {
+      ok = parseNames(value, sigmaPointSetNames, 3, sigmaPointSets);
+    }
+    else if (std::strcmp(option, "--preintegrate") == 0)
+    {
+      ok = parseNumbers(value, preintegrationPeriods);
+    }
+    else if (std::strcmp(option, "--precision") == 0)
+    {
+      ok = parseNames(value, precisionNames, 3, precisions);
+    }
+    else if (std::strcmp(option, "--threads") == 0)
+    {
+      numThreads = std::atoi(value);
+    }
+    else if (std::strcmp(option, "--report") == 0)
+    {
+      reportPath = value;
+    }
+    else
+    {
+      ok = false;
+    }
+    if (!ok)
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<std::string> logs;
+  struct stat st;
+  const bool isDir = stat(logsPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+  if (!(isDir ? listDirectory(logsPath, logs) : readManifest(logsPath, logs)))
+  {
+    std::fprintf(stderr, "cannot read %s\n", logsPath.c_str());
+    return 1;
+  }
+  if (logs.empty())
+  {
+    std::fprintf(stderr, "no logs in %s\n", logsPath.c_str());
+    return 1;
+  }
+
+  // Every combination of the settings, the last one varying fastest
+  const int numConfigs = qScales.size() * rScales.size() * engines.size()
+      * sigmaPointSets.size() * preintegrationPeriods.size()
+      * precisions.size();
+  std::vector<Config> configs(numConfigs);
+  for (int k = 0; k < numConfigs; ++k)
+  {
+    Config &c = configs[k];
+    int rest = k;
+    c.precision = Precision(precisions[rest % precisions.size()]);
+    rest /= precisions.size();
+    c.preintegrationPeriod = preintegrationPeriods[rest
+        % preintegrationPeriods.size()];
+    rest /= preintegrationPeriods.size();
+    c.sigmaPointSet = QuadUkf::SigmaPointSet(sigmaPointSets[rest
+        % sigmaPointSets.size()]);
+    rest /= sigmaPointSets.size();
+    c.engine = QuadUkf::Engine(engines[rest % engines.size()]);
+    rest /= engines.size();
+    c.rScale = rScales[rest % rScales.size()];
+    rest /= rScales.size();
+    c.qScale = qScales[rest];
+  }
+
+  // Task i runs configuration i / numLogs on log i % numLogs
+  const int numLogs = logs.size();
+  const int numRuns = configs.size() * numLogs;
+  std::vector<RunResult> results(numRuns);
+  WorkStealingPool pool(numThreads);
+  const auto start = std::chrono::steady_clock::now();
+  pool.run(numRuns, [&](int i, int)
+  {
+    results[i] = runLog(logs[i % numLogs], configs[i / numLogs]);
+  });
+  const double wallTime = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  // Score every run against the double precision run of its log and
+  // settings, if there is one
+  for (int c = 0; c < numConfigs; ++c)
+  {
+    int d = 0;
+    while (d < numConfigs && !(configs[d].precision == DOUBLE_PRECISION
+        && sameSettings(configs[d], configs[c])))
+    {
+      ++d;
+    }
+    for (int l = 0; l < numLogs; ++l)
+    {
+      RunResult &r = results[c * numLogs + l];
+      r.positionDev = r.attitudeDevDeg =
+          std::numeric_limits<double>::quiet_NaN();
+      if (d < numConfigs && r.ok && results[d * numLogs + l].ok)
+      {
+        compareTracks(results[d * numLogs + l], r);
+      }
+    }
+  }
+
+  std::FILE *report = stdout;
+  if (!reportPath.empty())
+  {
+    report = std::fopen(reportPath.c_str(), "w");
+    if (!report)
+    {
+      std::fprintf(stderr, "cannot open %s\n", reportPath.c_str());
+      return 1;
+    }
+  }
+  std::fprintf(report, "log,q,r,engine,sigma_points,preintegrate,precision,"
+               "records,records_per_s,position_rms,attitude_rms_deg,"
+               "velocity_rms,mean_nis,nis_within_95,final_cov_trace,"
+               "sqrt_fallbacks,late_samples,discarded_samples,position_dev,"
+               "attitude_dev_deg\n");
+  long totalRecords = 0, numFailed = 0;
+  for (int i = 0; i < numRuns; ++i)
+  {
+    const RunResult &r = results[i];
+    if (!r.ok)
+    {
+      ++numFailed;
+      std::fprintf(stderr, "%s: %s\n", logs[i % numLogs].c_str(),
+                   r.error.c_str());
+      continue;
+    }
+    const long records = r.numImu + r.numPose;
+    totalRecords += records;
+    std::fprintf(report, "%s,", logs[i % numLogs].c_str());
+    printConfig(report, configs[i / numLogs]);
+    std::fprintf(report, ",%ld,%.0f,%.6g,%.6g,%.6g,%.6g,%.4f,%.6g,%ld,%ld,"
+                 "%ld,%.3g,%.3g\n", records,
+                 r.elapsed > 0 ? records / r.elapsed : 0.0, r.positionRms,
+                 r.attitudeRmsDeg, r.velocityRms, r.meanNis,
+                 r.nisWithinBound, r.finalCovarianceTrace, r.sqrtFallbacks,
+                 r.lateSamples, r.discardedSamples, r.positionDev,
+                 r.attitudeDevDeg);
+  }
+  if (report != stdout)
+  {
+    std::fclose(report);
+  }
+
+  // Per configuration, averaged over the logs that replayed cleanly
+  std::fprintf(stderr, "\nq,r,engine,sigma_points,preintegrate,precision,"
+               "logs,position_rms,attitude_rms_deg,mean_nis,nis_within_95,"
+               "records_per_s,position_dev,attitude_dev_deg\n");
+  for (size_t c = 0; c < configs.size(); ++c)
+  {
+    int n = 0;
+    long records = 0;
+    double position = 0, attitude = 0, nis = 0, within = 0, elapsed = 0;
+    double positionDev = 0, attitudeDev = 0;
+    for (int l = 0; l < numLogs; ++l)
+    {
+      const RunResult &r = results[c * numLogs + l];
+      if (r.ok)
+      {
+        ++n;
+        position += r.positionRms;
+        attitude += r.attitudeRmsDeg;
+        nis += r.meanNis;
+        within += r.nisWithinBound;
+        records += r.numImu + r.numPose;
+        elapsed += r.elapsed;
+        positionDev += r.positionDev;
+        attitudeDev += r.attitudeDevDeg;
+      }
+    }
+    printConfig(stderr, configs[c]);
+    const double k = std::max(n, 1);
+    std::fprintf(stderr, ",%d,%.6g,%.6g,%.6g,%.4f,%.0f,%.3g,%.3g\n", n,
+                 position / k, attitude / k, nis / k, within / k,
+                 elapsed > 0 ? records / elapsed : 0.0, positionDev / k,
+                 attitudeDev / k);
+  }
+  std::fprintf(stderr, "\n%d runs (%ld failed) on %d threads in %.3f s: "
+               "%.0f records/s overall, %ld tasks stolen\n", numRuns,
+               numFailed, std::min(pool.threads(), numRuns), wallTime,
+               wallTime > 0 ? totalRecords / wallTime : 0.0, pool.steals());
+  return numFailed ? 1 : 0;
+}
@@ -0,0 +1,394 @@
+#include "AllanVariance.h"
+#include "SensorLog.h"
+#include "WorkStealingPool.h"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Characterizes the noise of an IMU from a log recorded at rest. The log is
+ * streamed in blocks, so memory is bounded by the longest averaging time
+ * rather than the length of the log, and each block is read while the
+ * previous one is analyzed. Every axis keeps Welford statistics and an
+ * overlapping Allan deviation curve; the curves of all six axes are
+ * accumulated on a work-stealing pool, one task per axis and range of
+ * averaging times.
+ *
+ * From each curve it reads the white noise density N (the -1/2 slope
+ * region, sigma = N / sqrt(tau)) and the bias instability (the flat floor,
+ * sigma_min / 0.664), and fits the bias random walk K (the +1/2 slope
+ * region, sigma = K sqrt(tau / 3)). It prints them with the filter
+ * parameters they set. Biases are reported in the IMU's own axes.
+ */
+
+namespace
+{
+
+enum
+{
+  NUM_AXES = 6,
+  BLOCK_SIZE = 1 << 16
+};
+
+const char *axisNames[NUM_AXES] = {"gyro x", "gyro y", "gyro z", "accel x",
+                                   "accel y", "accel z"};
+
+// Fewest non-overlapping clusters a point of the curve must span to be used
+// in the fits; below that its error exceeds about 25%
+const double MIN_CLUSTERS = 9;
+
+// sigma_min / B for flicker (bias instability) noise
+const double BIAS_INSTABILITY_FACTOR = 0.664;
+
+struct Block
+{
+  std::vector<double> timeStamps;
+  std::vector<double> axes[NUM_AXES];
+  std::string error;
+};
+
+struct NoiseParameters
+{
+  double noiseDensity;
+  double biasInstability;
+  double randomWalk;
+  bool randomWalkIsBound;  // no random walk in the fit; K is an upper bound
+};
+
+void printUsage(const char *prog)
+{
+  std::fprintf(stderr,
+      "usage: %s LOG [options]\n"
+      "  LOG is a sensor log (CSV or binary) recorded with the IMU at rest;\n"
+      "  pose records are ignored.\n"
+      "  --max-tau SEC          longest averaging time (default 1000)\n"
+      "  --points-per-decade N  averaging times per decade (default 10)\n"
+      "  --curve FILE           write the Allan deviation curves as CSV\n"
+      "  --threads N            worker threads (default: all cores)\n",
+      prog);
+}
+
+// Reads up to BLOCK_SIZE IMU samples; an empty block ends the log
+void readBlock(SensorLogReader &reader, Block &block)
+{
+  block.timeStamps.clear();
+  for (int a = 0; a < NUM_AXES; ++a)
+  {
+    block.axes[a].clear();
+  }
+  SensorRecord rec;
+  while (block.timeStamps.size() < BLOCK_SIZE && reader.next(rec))
+  {
+    if (rec.type != SensorRecord::IMU)
+    {
+      continue;
+    }
+    block.timeStamps.push_back(rec.timeStamp);
+    for (int a = 0; a < NUM_AXES; ++a)
+    {
+      block.axes[a].push_back(rec.values[a]);
+    }
+  }
+  block.error = reader.error();
+}
+
+// Cluster sizes spaced evenly in log(tau) from one sample to maxCluster
+std::vector<long> clusterSizes(const long maxCluster, const int perDecade)
+{
+  std::vector<long> sizes;
+  const double step = std::pow(10.0, 1.0 / perDecade);
+  for (double m = 1; m <= maxCluster; m *= step)
+  {
+    const long size = std::lround(m);
+    if (sizes.empty() || size > sizes.back())
+    {
+      sizes.push_back(size);
+    }
+  }
+  return sizes;
+}
+
+/*
+ * Reads the noise terms off one Allan deviation curve. The white noise is
+ * taken at the point whose slope to the next is closest to -1/2. The random
+ * walk only dominates the last few, noisiest points, so it comes from a fit
+ * of avar = N^2 / tau + C + K^2 tau / 3 to the whole curve instead, weighted
+ * for equal relative error.
+ */
+NoiseParameters fitNoise(const std::vector<double> &taus,
+                         const std::vector<double> &adevs)
+{
+  NoiseParameters p = {0, 0, 0, true};
+  const int n = taus.size();
+  if (n == 0)
+  {
+    return p;
+  }
+  p.biasInstability = *std::min_element(adevs.begin(), adevs.end())
+      / BIAS_INSTABILITY_FACTOR;
+
+  int white = 0;
+  double whiteError = HUGE_VAL;
+  for (int i = 0; i + 1 < n; ++i)
+  {
+    const double slope = std::log(adevs[i + 1] / adevs[i])
+        / std::log(taus[i + 1] / taus[i]);
+    if (std::abs(slope + 0.5) < whiteError)
+    {
+      whiteError = std::abs(slope + 0.5);
+      white = i;
+    }
+  }
+  p.noiseDensity = adevs[white] * std::sqrt(taus[white]);
+
+  Eigen::Matrix3d normal = Eigen::Matrix3d::Zero();
+  Eigen::Vector3d rhs = Eigen::Vector3d::Zero();
+  for (int i = 0; i < n; ++i)
+  {
+    const double avar = adevs[i] * adevs[i];
+    const Eigen::Vector3d basis(1 / taus[i], 1, taus[i] / 3);
+    normal.noalias() += basis * basis.transpose() / (avar * avar);
+    rhs += basis / avar;
+  }
+  const Eigen::Vector3d coeffs = normal.ldlt().solve(rhs);
+
+  // Without a random walk term it is at most what would reach the last
+  // point
+  p.randomWalkIsBound = !(coeffs(2) > 0);
+  p.randomWalk = p.randomWalkIsBound ?
+      adevs[n - 1] * std::sqrt(3 / taus[n - 1]) : std::sqrt(coeffs(2));
+  return p;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  const std::string logPath = argv[1];
+  double maxTau = 1000;
+  int perDecade = 10;
+  std::string curvePath;
+  int numThreads = std::thread::hardware_concurrency();
+  for (int i = 2; i < argc; ++i)
+  {
+    const bool hasValue = i + 1 < argc;
+    if (std::strcmp(argv[i], "--max-tau") == 0 && hasValue)
+    {
+      maxTau = std::atof(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "--points-per-decade") == 0 && hasValue)
+    {
+      perDecade = std::max(std::atoi(argv[++i]), 1);
+    }
+    else if (std::strcmp(argv[i], "--curve") == 0 && hasValue)
+    {
+      curvePath = argv[++i];
+    }
+    else if (std::strcmp(argv[i], "--threads") == 0 && hasValue)
+    {
+      numThreads = std::atoi(argv[++i]);
+    }
+    else
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  SensorLogReader reader;
+  if (!reader.open(logPath))
+  {
+    std::fprintf(stderr, "%s\n", reader.error().c_str());
+    return 1;
+  }
+
+  // The sample period of the first block sizes the clusters
+  Block blocks[2];
+  readBlock(reader, blocks[0]);
+  const std::vector<double> &t0 = blocks[0].timeStamps;
+  if (t0.size() < 2)
+  {
+    std::fprintf(stderr, "%s\n", blocks[0].error.empty() ?
+                 "fewer than two IMU samples" : blocks[0].error.c_str());
+    return 1;
+  }
+  const double firstPeriod = (t0.back() - t0.front()) / (t0.size() - 1);
+  const std::vector<long> sizes = clusterSizes(
+      std::max(std::lround(maxTau / firstPeriod), 1L), perDecade);
+  AllanVariance curves[NUM_AXES];
+  for (int a = 0; a < NUM_AXES; ++a)
+  {
+    curves[a].configure(sizes, BLOCK_SIZE);
+  }
+
+  // Tasks split each axis's clusters into equal ranges, enough of them to
+  // keep every thread busy
+  WorkStealingPool pool(numThreads);
+  const int numClusters = sizes.size();
+  const int rangesPerAxis = std::min(numClusters,
+      std::max(1, (2 * pool.threads() + NUM_AXES - 1) / NUM_AXES));
+
+  const double firstTimeStamp = t0.front();
+  double lastTimeStamp = firstTimeStamp;
+  long numGaps = 0;
+  double maxGap = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int cur = 0; !blocks[cur].timeStamps.empty(); cur = 1 - cur)
+  {
+    Block &block = blocks[cur];
+    if (!block.error.empty())
+    {
+      std::fprintf(stderr, "%s\n", block.error.c_str());
+      return 1;
+    }
+    std::thread next(readBlock, std::ref(reader), std::ref(blocks[1 - cur]));
+
+    // Allan deviation assumes uniform sampling; count the dropouts
+    const int n = block.timeStamps.size();
+    for (int i = 0; i < n; ++i)
+    {
+      const double dt = block.timeStamps[i] - lastTimeStamp;
+      if (dt > 1.5 * firstPeriod)
+      {
+        ++numGaps;
+        maxGap = std::max(maxGap, dt);
+      }
+      lastTimeStamp = block.timeStamps[i];
+    }
+
+    pool.run(NUM_AXES, [&](int a, int)
+    {
+      curves[a].addBlock(block.axes[a].data(), n);
+    });
+    pool.run(NUM_AXES * rangesPerAxis, [&](int task, int)
+    {
+      const int a = task / rangesPerAxis, r = task % rangesPerAxis;
+      curves[a].accumulate(numClusters * r / rangesPerAxis,
+                           numClusters * (r + 1) / rangesPerAxis);
+    });
+    for (int a = 0; a < NUM_AXES; ++a)
+    {
+      curves[a].endBlock();
+    }
+    next.join();
+  }
+  const double elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  const long numSamples = curves[0].numSamples();
+  const double duration = lastTimeStamp - firstTimeStamp;
+  const double period = duration / (numSamples - 1);
+  std::printf("samples:     %ld over %.1f s at %.1f Hz, %ld gaps (longest "
+              "%.3f s)\n", numSamples, duration, 1 / period, numGaps, maxGap);
+  std::printf("elapsed:     %.3f s (%.0f samples/s) on %d threads\n",
+              elapsed, elapsed > 0 ? numSamples / elapsed : 0.0,
+              std::min(pool.threads(), NUM_AXES * rangesPerAxis));
+
+  std::FILE *curve = 0;
+  if (!curvePath.empty())
+  {
+    curve = std::fopen(curvePath.c_str(), "w");
+    if (!curve)
+    {
+      std::fprintf(stderr, "cannot open %s\n", curvePath.c_str());
+      return 1;
+    }
+    std::fprintf(curve, "tau,terms,gx,gy,gz,ax,ay,az\n");
+  }
+
+  // Points that span enough clusters for the fits
+  NoiseParameters params[NUM_AXES];
+  std::vector<double> taus, adevs[NUM_AXES];
+  for (int c = 0; c < numClusters; ++c)
+  {
+    const long m = sizes[c];
+    if (curves[0].numTerms(c) == 0)
+    {
+      break;
+    }
+    if (curve)
+    {
+      std::fprintf(curve, "%.6g,%ld", m * period, curves[0].numTerms(c));
+      for (int a = 0; a < NUM_AXES; ++a)
+      {
+        std::fprintf(curve, ",%.6g", std::sqrt(curves[a].variance(c)));
+      }
+      std::fprintf(curve, "\n");
+    }
+    if (numSamples >= MIN_CLUSTERS * m)
+    {
+      taus.push_back(m * period);
+      for (int a = 0; a < NUM_AXES; ++a)
+      {
+        adevs[a].push_back(std::sqrt(curves[a].variance(c)));
+      }
+    }
+  }
+  if (curve && std::fclose(curve) != 0)
+  {
+    std::fprintf(stderr, "cannot write %s\n", curvePath.c_str());
+    return 1;
+  }
+  if (!taus.empty())
+  {
+    std::printf("tau:         %.3g to %.3g s\n", taus.front(), taus.back());
+  }
+
+  std::printf("\naxis     mean          std           noise_density "
+              "bias_instab   random_walk\n");
+  for (int a = 0; a < NUM_AXES; ++a)
+  {
+    params[a] = fitNoise(taus, adevs[a]);
+    std::printf("%-8s %-13.6g %-13.6g %-13.6g %-13.6g %s%.6g\n",
+                axisNames[a], curves[a].mean(),
+                std::sqrt(curves[a].sampleVariance()), params[a].noiseDensity,
+                params[a].biasInstability,
+                params[a].randomWalkIsBound ? "<" : "", params[a].randomWalk);
+  }
+  std::printf("units: rad/s, m/s^2; densities per sqrt(Hz); random walks "
+              "per s per sqrt(Hz)\n"
+              "'<': no random walk region within --max-tau, upper bound\n");
+
+  // The filter takes one value per sensor; the worst axis is the safe one
+  double density[2] = {0, 0}, walk[2] = {0, 0};
+  for (int a = 0; a < NUM_AXES; ++a)
+  {
+    const int s = a / 3;
+    density[s] = std::max(density[s], params[a].noiseDensity);
+    walk[s] = std::max(walk[s], params[a].randomWalk);
+  }
+  std::printf("\n# QuadUkfRunner parameters (QuadUkf::setImuNoiseDensities, "
+              "setImuBiasRandomWalks)\n"
+              "gyro_noise_density: %.6g\n"
+              "accel_noise_density: %.6g\n"
+              "gyro_bias_random_walk: %.6g\n"
+              "accel_bias_random_walk: %.6g\n", density[0], density[1],
+              walk[0], walk[1]);
+  std::printf("\n# Sensor noise floor of the per-sample process noise Q "
+              "(dt = %.6g s)\n"
+              "attitude:          %.6g rad^2\n"
+              "velocity:          %.6g (m/s)^2\n"
+              "angular velocity:  %.6g (rad/s)^2\n"
+              "acceleration:      %.6g (m/s^2)^2\n", period,
+              density[0] * density[0] * period,
+              density[1] * density[1] * period,
+              density[0] * density[0] / period,
+              density[1] * density[1] / period);
+  return 0;
+}
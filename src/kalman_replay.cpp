@@ -0,0 +1,289 @@
+#include "QuadUkf.h"
+#include "LatencyProbes.h"
+#include "SensorLog.h"
+#include "TrajectoryLog.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+/*
+ * Streams a recorded sensor log through QuadUkf as fast as possible, for
+ * offline tuning of the process and sensor noise.
+ */
+
+void printUsage(const char *prog)
+{
+  std::fprintf(stderr,
+      "usage: %s LOG [options]\n"
+      "  --square-root       use the square-root UKF engine\n"
+      "  --sigma-points SET  symmetric (default), simplex or skew\n"
+      "  --preintegrate SEC  preintegrate IMU samples, predicting at every\n"
+      "                      pose and every SEC seconds (0: poses only)\n"
+      "  --static-init SEC   take the initial IMU biases from the first SEC\n"
+      "                      seconds in which the vehicle holds still\n"
+      "  --q SCALE           process noise Q = SCALE * I on the motion\n"
+      "                      states (default 0.01)\n"
+      "  --r SCALE           sensor noise R = SCALE * I (default 0.01)\n"
+      "  --sequential        apply each measurement's components one at a\n"
+      "                      time\n"
+      "  --trajectory FILE   write the belief after every record as CSV\n"
+      "  --belief-log FILE   write the belief after every record to a\n"
+      "                      binary trajectory log\n"
+      "  --convert FILE      also write the log in binary format to FILE\n",
+      prog);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  const std::string logPath = argv[1];
+  bool useSquareRootUkf = false;
+  bool sequentialUpdates = false;
+  QuadUkf::SigmaPointSet sigmaPointSet = QuadUkf::SYMMETRIC_SIGMA_POINTS;
+  double preintegrationPeriod = -1;
+  double staticInitWindow = -1;
+  double qScale = 0.01, rScale = 0.01;
+  std::string trajectoryPath, beliefLogPath, convertPath;
+  for (int i = 2; i < argc; ++i)
+  {
+    const bool hasValue = i + 1 < argc;
+    if (std::strcmp(argv[i], "--square-root") == 0)
+    {
+      useSquareRootUkf = true;
+    }
+    else if (std::strcmp(argv[i], "--sequential") == 0)
+    {
+      sequentialUpdates = true;
+    }
+    else if (std::strcmp(argv[i], "--sigma-points") == 0 && hasValue)
+    {
+      const char *name = argv[++i];
+      if (std::strcmp(name, "symmetric") == 0)
+      {
+        sigmaPointSet = QuadUkf::SYMMETRIC_SIGMA_POINTS;
+      }
+      else if (std::strcmp(name, "simplex") == 0)
+      {
+        sigmaPointSet = QuadUkf::SPHERICAL_SIMPLEX_SIGMA_POINTS;
+      }
+      else if (std::strcmp(name, "skew") == 0)
+      {
+        sigmaPointSet = QuadUkf::MINIMAL_SKEW_SIGMA_POINTS;
+      }
+      else
+      {
+        printUsage(argv[0]);
+        return 1;
+      }
+    }
+    else if (std::strcmp(argv[i], "--preintegrate") == 0 && hasValue)
+    {
+      preintegrationPeriod = std::atof(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "--static-init") == 0 && hasValue)
+    {
+      staticInitWindow = std::atof(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "--q") == 0 && hasValue)
+    {
+      qScale = std::atof(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "--r") == 0 && hasValue)
+    {
+      rScale = std::atof(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "--trajectory") == 0 && hasValue)
+    {
+      trajectoryPath = argv[++i];
+    }
+    else if (std::strcmp(argv[i], "--belief-log") == 0 && hasValue)
+    {
+      beliefLogPath = argv[++i];
+    }
+    else if (std::strcmp(argv[i], "--convert") == 0 && hasValue)
+    {
+      convertPath = argv[++i];
+    }
+    else
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  SensorLogReader reader;
+  if (!reader.open(logPath))
+  {
+    std::fprintf(stderr, "%s\n", reader.error().c_str());
+    return 1;
+  }
+  SensorLogWriter writer;
+  if (!convertPath.empty() && !writer.open(convertPath))
+  {
+    std::fprintf(stderr, "cannot open %s\n", convertPath.c_str());
+    return 1;
+  }
+  std::FILE *trajectory = 0;
+  if (!trajectoryPath.empty())
+  {
+    trajectory = std::fopen(trajectoryPath.c_str(), "w");
+    if (!trajectory)
+    {
+      std::fprintf(stderr, "cannot open %s\n", trajectoryPath.c_str());
+      return 1;
+    }
+    std::fprintf(trajectory, "t,px,py,pz,qx,qy,qz,qw,vx,vy,vz\n");
+  }
+  TrajectoryLogWriter beliefLog;
+  if (!beliefLogPath.empty() && !beliefLog.open(beliefLogPath))
+  {
+    std::fprintf(stderr, "%s\n", beliefLog.error().c_str());
+    return 1;
+  }
+
+  // The filter starts at the first record's time stamp
+  SensorRecord rec;
+  const bool haveFirst = reader.next(rec);
+  QuadUkf ukf(haveFirst ? rec.timeStamp : 0);
+  if (useSquareRootUkf)
+  {
+    ukf.setEngine(QuadUkf::SQUARE_ROOT_UKF);
+  }
+  ukf.setSigmaPointSet(sigmaPointSet);
+  if (preintegrationPeriod >= 0)
+  {
+    ukf.setImuPreintegration(true, preintegrationPeriod);
+  }
+  if (staticInitWindow >= 0)
+  {
+    ukf.setStaticInitialization(true, staticInitWindow);
+  }
+  ukf.setProcessCovariance(QuadUkf::scaledProcessCovariance(qScale));
+  for (int s = QuadUkf::POSE_SENSOR; s <= QuadUkf::POSITION_SENSOR; ++s)
+  {
+    const int n = ukf.getSensorInnovation(s).residual.rows();
+    ukf.setSensorCovariance(s, rScale
+        * QuadUkf::PartialSensorMatrix::Identity(n, n));
+  }
+  ukf.setSequentialUpdates(sequentialUpdates);
+
+  QuadUkf::ImuSample imu;
+  QuadUkf::PoseSample pose;
+  QuadUkf::SensorSample sample;
+  long numImu = 0, numPose = 0, numOther = 0;
+  double lastWritten = -1;
+  const auto start = std::chrono::steady_clock::now();
+  for (bool ok = haveFirst; ok; ok = reader.next(rec))
+  {
+    if (!convertPath.empty())
+    {
+      writer.write(rec);
+    }
+
+    if (rec.type == SensorRecord::IMU)
+    {
+      imu.timeStamp = rec.timeStamp;
+      imu.angularVelocity << rec.values[0], rec.values[1], rec.values[2];
+      imu.linearAcceleration << rec.values[3], rec.values[4], rec.values[5];
+      ukf.imuUpdate(imu);
+      ++numImu;
+    }
+    else if (rec.type == SensorRecord::POSE)
+    {
+      pose.timeStamp = rec.timeStamp;
+      pose.position << rec.values[0], rec.values[1], rec.values[2];
+      pose.orientation.coeffs() << rec.values[3], rec.values[4],
+          rec.values[5], rec.values[6];
+      ukf.poseUpdate(pose);
+      ++numPose;
+    }
+    else
+    {
+      // Altitude, flow and position records feed the built-in sensors
+      sample.timeStamp = rec.timeStamp;
+      sample.sensor = rec.type == SensorRecord::ALTITUDE ?
+          QuadUkf::ALTIMETER_SENSOR : rec.type == SensorRecord::FLOW ?
+          QuadUkf::OPTICAL_FLOW_SENSOR : QuadUkf::POSITION_SENSOR;
+      sample.values.head<3>() << rec.values[0], rec.values[1],
+          rec.values[2];
+      ukf.sensorUpdate(sample);
+      ++numOther;
+    }
+
+    // The belief does not advance while IMU samples are being preintegrated
+    const bool newBelief = preintegrationPeriod < 0
+        || ukf.getBelief().timeStamp != lastWritten;
+    lastWritten = ukf.getBelief().timeStamp;
+    if (newBelief && beliefLog.isOpen())
+    {
+      beliefLog.post(ukf.getBelief(), true);
+    }
+    if (newBelief && trajectory)
+    {
+      const QuadUkf::QuadBelief &b = ukf.getBelief();
+      std::fprintf(trajectory, "%.9f,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,"
+                   "%.9g,%.9g,%.9g\n", b.timeStamp, b.state.position(0),
+                   b.state.position(1), b.state.position(2),
+                   b.state.quaternion.x(), b.state.quaternion.y(),
+                   b.state.quaternion.z(), b.state.quaternion.w(),
+                   b.state.velocity(0), b.state.velocity(1),
+                   b.state.velocity(2));
+    }
+  }
+  const double elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  if (trajectory)
+  {
+    std::fclose(trajectory);
+  }
+  writer.close();
+  if (beliefLog.isOpen() && !beliefLog.close())
+  {
+    std::fprintf(stderr, "%s\n", beliefLog.error().c_str());
+    return 1;
+  }
+  if (!reader.error().empty())
+  {
+    std::fprintf(stderr, "%s: %s\n", logPath.c_str(), reader.error().c_str());
+    return 1;
+  }
+
+  const long numRecords = numImu + numPose + numOther;
+  const QuadUkf::QuadBelief &b = ukf.getBelief();
+  std::printf("records:     %ld (%ld imu, %ld pose, %ld other)\n",
+              numRecords, numImu, numPose, numOther);
+  std::printf("sigma points: %d\n", ukf.numSigmaPoints());
+  std::printf("elapsed:     %.3f s (%.0f records/s)\n", elapsed,
+              elapsed > 0 ? numRecords / elapsed : 0.0);
+  std::printf("final time:  %.6f\n", b.timeStamp);
+  std::printf("position:    %g %g %g\n", b.state.position(0),
+              b.state.position(1), b.state.position(2));
+  std::printf("orientation: %g %g %g %g (x y z w)\n", b.state.quaternion.x(),
+              b.state.quaternion.y(), b.state.quaternion.z(),
+              b.state.quaternion.w());
+  const QuadUkf::HistoryStats h = ukf.getHistoryStats();
+  std::printf("late samples: %ld fused, %ld discarded, %ld steps replayed "
+              "(max %d per sample, %ld bytes of history)\n", h.outOfSequence,
+              h.discarded, h.replayedSamples, h.maxReplayDepth,
+              h.historyBytes);
+  if (useSquareRootUkf)
+  {
+    std::printf("sqrt fallbacks: %ld\n",
+                ukf.getFactorizationFallbacks());
+  }
+  if (LatencyProbes::enabled())
+  {
+    LatencyProbes::writeReport(stdout);
+  }
+
+  return 0;
+}
@@ -0,0 +1,263 @@
+#include "QuadUkf.h"
+#include "QuadUkfSmoother.h"
+#include "SensorLog.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+/*
+ * Post-flight trajectory reconstruction: runs a recorded IMU/pose log
+ * through QuadUkf, streaming its transitions to a step file on disk, then
+ * smooths the whole trajectory with QuadUkfSmoother and writes it as CSV.
+ */
+
+void printUsage(const char *prog)
+{
+  std::fprintf(stderr,
+      "usage: %s LOG OUTPUT [options]\n"
+      "  --steps FILE        step file of the forward pass\n"
+      "                      (default: OUTPUT.steps, removed when done)\n"
+      "  --keep-steps        keep the step file\n"
+      "  --filtered FILE     also write the filtered trajectory as CSV\n"
+      "  --square-root       use the square-root UKF engine\n"
+      "  --sigma-points SET  symmetric (default), simplex or skew\n"
+      "  --preintegrate SEC  preintegrate IMU samples, predicting at every\n"
+      "                      pose and every SEC seconds (0: poses only)\n"
+      "  --q SCALE           process noise Q = SCALE * I on the motion\n"
+      "                      states (default 0.01)\n"
+      "  --r SCALE           sensor noise R = SCALE * I (default 0.01)\n",
+      prog);
+}
+
+// Writes the beliefs in the step file, with position standard deviations
+bool writeTrajectory(QuadUkfSmoother &smoother, const std::string &path)
+{
+  std::FILE *out = std::fopen(path.c_str(), "w");
+  if (!out)
+  {
+    std::fprintf(stderr, "cannot open %s\n", path.c_str());
+    return false;
+  }
+  std::fprintf(out, "t,px,py,pz,qx,qy,qz,qw,vx,vy,vz,sx,sy,sz\n");
+  QuadUkf::QuadBelief b;
+  for (long i = 0; i < smoother.size() && smoother.belief(i, b); ++i)
+  {
+    std::fprintf(out, "%.9f,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,"
+                 "%.9g,%.6g,%.6g,%.6g\n", b.timeStamp, b.state.position(0),
+                 b.state.position(1), b.state.position(2),
+                 b.state.quaternion.x(), b.state.quaternion.y(),
+                 b.state.quaternion.z(), b.state.quaternion.w(),
+                 b.state.velocity(0), b.state.velocity(1),
+                 b.state.velocity(2), std::sqrt(b.covariance(0, 0)),
+                 std::sqrt(b.covariance(1, 1)),
+                 std::sqrt(b.covariance(2, 2)));
+  }
+  return std::fclose(out) == 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  const std::string logPath = argv[1];
+  const std::string outputPath = argv[2];
+  std::string stepsPath = outputPath + ".steps", filteredPath;
+  bool keepSteps = false;
+  bool useSquareRootUkf = false;
+  QuadUkf::SigmaPointSet sigmaPointSet = QuadUkf::SYMMETRIC_SIGMA_POINTS;
+  double preintegrationPeriod = -1;
+  double qScale = 0.01, rScale = 0.01;
+  for (int i = 3; i < argc; ++i)
+  {
+    const bool hasValue = i + 1 < argc;
+    if (std::strcmp(argv[i], "--steps") == 0 && hasValue)
+    {
+      stepsPath = argv[++i];
+    }
+    else if (std::strcmp(argv[i], "--keep-steps") == 0)
+    {
+      keepSteps = true;
+    }
+    else if (std::strcmp(argv[i], "--filtered") == 0 && hasValue)
+    {
+      filteredPath = argv[++i];
+    }
+    else if (std::strcmp(argv[i], "--square-root") == 0)
+    {
+      useSquareRootUkf = true;
+    }
+    else if (std::strcmp(argv[i], "--sigma-points") == 0 && hasValue)
+    {
+      const char *name = argv[++i];
+      if (std::strcmp(name, "symmetric") == 0)
+      {
+        sigmaPointSet = QuadUkf::SYMMETRIC_SIGMA_POINTS;
+      }
+      else if (std::strcmp(name, "simplex") == 0)
+      {
+        sigmaPointSet = QuadUkf::SPHERICAL_SIMPLEX_SIGMA_POINTS;
+      }
+      else if (std::strcmp(name, "skew") == 0)
+      {
+        sigmaPointSet = QuadUkf::MINIMAL_SKEW_SIGMA_POINTS;
+      }
+      else
+      {
+        printUsage(argv[0]);
+        return 1;
+      }
+    }
+    else if (std::strcmp(argv[i], "--preintegrate") == 0 && hasValue)
+    {
+      preintegrationPeriod = std::atof(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "--q") == 0 && hasValue)
+    {
+      qScale = std::atof(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "--r") == 0 && hasValue)
+    {
+      rScale = std::atof(argv[++i]);
+    }
+    else
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  SensorLogReader reader;
+  if (!reader.open(logPath))
+  {
+    std::fprintf(stderr, "%s\n", reader.error().c_str());
+    return 1;
+  }
+  QuadUkfSmoother smoother;
+  if (!smoother.open(stepsPath))
+  {
+    std::fprintf(stderr, "%s\n", smoother.error().c_str());
+    return 1;
+  }
+
+  // Forward pass. The filter starts at the first record's time stamp.
+  SensorRecord rec;
+  const bool haveFirst = reader.next(rec);
+  QuadUkf ukf(haveFirst ? rec.timeStamp : 0);
+  if (useSquareRootUkf)
+  {
+    ukf.setEngine(QuadUkf::SQUARE_ROOT_UKF);
+  }
+  ukf.setSigmaPointSet(sigmaPointSet);
+  if (preintegrationPeriod >= 0)
+  {
+    ukf.setImuPreintegration(true, preintegrationPeriod);
+  }
+  ukf.setProcessCovariance(QuadUkf::scaledProcessCovariance(qScale));
+  for (int s = QuadUkf::POSE_SENSOR; s <= QuadUkf::POSITION_SENSOR; ++s)
+  {
+    const int n = ukf.getSensorInnovation(s).residual.rows();
+    ukf.setSensorCovariance(s, rScale
+        * QuadUkf::PartialSensorMatrix::Identity(n, n));
+  }
+  ukf.setTransitionObserver(&smoother);
+
+  QuadUkf::ImuSample imu;
+  QuadUkf::PoseSample pose;
+  QuadUkf::SensorSample sample;
+  long numRecords = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (bool ok = haveFirst; ok; ok = reader.next(rec))
+  {
+    if (rec.type == SensorRecord::IMU)
+    {
+      imu.timeStamp = rec.timeStamp;
+      imu.angularVelocity << rec.values[0], rec.values[1], rec.values[2];
+      imu.linearAcceleration << rec.values[3], rec.values[4], rec.values[5];
+      ukf.imuUpdate(imu);
+    }
+    else if (rec.type == SensorRecord::POSE)
+    {
+      pose.timeStamp = rec.timeStamp;
+      pose.position << rec.values[0], rec.values[1], rec.values[2];
+      pose.orientation.coeffs() << rec.values[3], rec.values[4],
+          rec.values[5], rec.values[6];
+      ukf.poseUpdate(pose);
+    }
+    else
+    {
+      // Altitude, flow and position records feed the built-in sensors
+      sample.timeStamp = rec.timeStamp;
+      sample.sensor = rec.type == SensorRecord::ALTITUDE ?
+          QuadUkf::ALTIMETER_SENSOR : rec.type == SensorRecord::FLOW ?
+          QuadUkf::OPTICAL_FLOW_SENSOR : QuadUkf::POSITION_SENSOR;
+      sample.values.head<3>() << rec.values[0], rec.values[1],
+          rec.values[2];
+      ukf.sensorUpdate(sample);
+    }
+    ++numRecords;
+  }
+  if (!reader.error().empty())
+  {
+    std::fprintf(stderr, "%s: %s\n", logPath.c_str(), reader.error().c_str());
+    return 1;
+  }
+  ukf.setTransitionObserver(0);
+  if (!smoother.finish(ukf.getBelief()))
+  {
+    std::fprintf(stderr, "%s\n", smoother.error().c_str());
+    return 1;
+  }
+  const auto forwardEnd = std::chrono::steady_clock::now();
+
+  if (!filteredPath.empty() && !writeTrajectory(smoother, filteredPath))
+  {
+    return 1;
+  }
+
+  // Backward pass
+  const auto backwardStart = std::chrono::steady_clock::now();
+  if (!smoother.smooth())
+  {
+    std::fprintf(stderr, "%s\n", smoother.error().c_str());
+    return 1;
+  }
+  const auto backwardEnd = std::chrono::steady_clock::now();
+
+  if (!writeTrajectory(smoother, outputPath))
+  {
+    return 1;
+  }
+  const long numBeliefs = smoother.size();
+  if (!smoother.close())
+  {
+    std::fprintf(stderr, "%s\n", smoother.error().c_str());
+    return 1;
+  }
+  if (!keepSteps)
+  {
+    std::remove(stepsPath.c_str());
+  }
+
+  const double forwardSec = std::chrono::duration<double>(
+      forwardEnd - start).count();
+  const double backwardSec = std::chrono::duration<double>(
+      backwardEnd - backwardStart).count();
+  const double stepMb = numBeliefs * double(sizeof(QuadUkf::Transition))
+      / (1 << 20);
+  std::printf("records:     %ld\n", numRecords);
+  std::printf("beliefs:     %ld (%.1f MB of steps)\n", numBeliefs, stepMb);
+  std::printf("forward:     %.3f s (%.0f records/s)\n", forwardSec,
+              forwardSec > 0 ? numRecords / forwardSec : 0.0);
+  std::printf("backward:    %.3f s (%.0f beliefs/s, %.0f MB/s)\n",
+              backwardSec, backwardSec > 0 ? numBeliefs / backwardSec : 0.0,
+              backwardSec > 0 ? 2 * stepMb / backwardSec : 0.0);
+  return 0;
+}
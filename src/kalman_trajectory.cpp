@@ -0,0 +1,187 @@
+#include "TrajectoryLog.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+/*
+ * Reads a binary trajectory log written by the node (trajectory_log) or by
+ * kalman_replay --belief-log. Prints a summary, and converts the log, or a
+ * time range of it, to CSV.
+ */
+
+void printUsage(const char *prog)
+{
+  std::fprintf(stderr,
+      "usage: %s LOG [options]\n"
+      "  --csv FILE          write the beliefs as CSV: time, the full\n"
+      "                      state and the covariance\n"
+      "  --covariance KIND   diag (default): standard deviations of the 21\n"
+      "                      error states; full: the upper triangle of the\n"
+      "                      covariance, row by row; none\n"
+      "  --from T, --to T    only beliefs with time stamps in [T, T]\n",
+      prog);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  enum CovarianceOutput
+  {
+    NO_COVARIANCE, DIAGONAL_COVARIANCE, FULL_COVARIANCE
+  };
+
+  const std::string logPath = argv[1];
+  std::string csvPath;
+  CovarianceOutput covarianceOutput = DIAGONAL_COVARIANCE;
+  double from = -HUGE_VAL, to = HUGE_VAL;
+  for (int i = 2; i < argc; ++i)
+  {
+    const bool hasValue = i + 1 < argc;
+    if (std::strcmp(argv[i], "--csv") == 0 && hasValue)
+    {
+      csvPath = argv[++i];
+    }
+    else if (std::strcmp(argv[i], "--covariance") == 0 && hasValue)
+    {
+      const char *kind = argv[++i];
+      if (std::strcmp(kind, "diag") == 0)
+      {
+        covarianceOutput = DIAGONAL_COVARIANCE;
+      }
+      else if (std::strcmp(kind, "full") == 0)
+      {
+        covarianceOutput = FULL_COVARIANCE;
+      }
+      else if (std::strcmp(kind, "none") == 0)
+      {
+        covarianceOutput = NO_COVARIANCE;
+      }
+      else
+      {
+        printUsage(argv[0]);
+        return 1;
+      }
+    }
+    else if (std::strcmp(argv[i], "--from") == 0 && hasValue)
+    {
+      from = std::atof(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "--to") == 0 && hasValue)
+    {
+      to = std::atof(argv[++i]);
+    }
+    else
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  const int ERROR_SIZE = TrajectoryRecord::ERROR_SIZE;
+  TrajectoryLogReader log;
+  if (!log.open(logPath))
+  {
+    std::fprintf(stderr, "%s\n", log.error().c_str());
+    return 1;
+  }
+  const long n = log.size();
+  TrajectoryRecord first, last;
+  if (n > 0 && !(log.read(0, first) && log.read(n - 1, last)))
+  {
+    std::fprintf(stderr, "%s\n", log.error().c_str());
+    return 1;
+  }
+  const double span = n > 0 ? last.timeStamp - first.timeStamp : 0;
+  std::printf("beliefs:     %ld (%.1f MB)\n", n,
+              n * double(sizeof(TrajectoryRecord)) / (1 << 20));
+  if (n > 0)
+  {
+    std::printf("time:        %.6f to %.6f (%.3f s, %.1f Hz)\n",
+                first.timeStamp, last.timeStamp, span,
+                span > 0 ? (n - 1) / span : 0.0);
+  }
+  if (csvPath.empty())
+  {
+    return 0;
+  }
+
+  std::FILE *csv = std::fopen(csvPath.c_str(), "w");
+  if (!csv)
+  {
+    std::fprintf(stderr, "cannot open %s\n", csvPath.c_str());
+    return 1;
+  }
+  std::fprintf(csv, "t,dt,px,py,pz,qx,qy,qz,qw,vx,vy,vz,wx,wy,wz,ax,ay,az,"
+               "bgx,bgy,bgz,bax,bay,baz");
+  if (covarianceOutput == DIAGONAL_COVARIANCE)
+  {
+    for (int i = 0; i < ERROR_SIZE; ++i)
+    {
+      std::fprintf(csv, ",s%d", i);
+    }
+  }
+  else if (covarianceOutput == FULL_COVARIANCE)
+  {
+    for (int i = 0; i < ERROR_SIZE; ++i)
+    {
+      for (int j = i; j < ERROR_SIZE; ++j)
+      {
+        std::fprintf(csv, ",c%d_%d", i, j);
+      }
+    }
+  }
+  std::fprintf(csv, "\n");
+
+  // Diagonal entries of the packed upper triangle
+  int diagonal[ERROR_SIZE];
+  for (int i = 0, k = 0; i < ERROR_SIZE; k += ERROR_SIZE - i, ++i)
+  {
+    diagonal[i] = k;
+  }
+
+  TrajectoryRecord rec;
+  long written = 0;
+  for (long i = log.find(from); i < n && log.read(i, rec); ++i)
+  {
+    if (rec.timeStamp > to)
+    {
+      break;
+    }
+    std::fprintf(csv, "%.9f,%.6g", rec.timeStamp, rec.dt);
+    for (int k = 0; k < TrajectoryRecord::STATE_SIZE; ++k)
+    {
+      std::fprintf(csv, ",%.9g", rec.state[k]);
+    }
+    if (covarianceOutput == DIAGONAL_COVARIANCE)
+    {
+      for (int k = 0; k < ERROR_SIZE; ++k)
+      {
+        std::fprintf(csv, ",%.6g", std::sqrt(rec.covariance[diagonal[k]]));
+      }
+    }
+    else if (covarianceOutput == FULL_COVARIANCE)
+    {
+      for (int k = 0; k < TrajectoryRecord::COVARIANCE_SIZE; ++k)
+      {
+        std::fprintf(csv, ",%.9g", rec.covariance[k]);
+      }
+    }
+    std::fprintf(csv, "\n");
+    ++written;
+  }
+  if (std::fclose(csv) != 0)
+  {
+    std::fprintf(stderr, "cannot write %s\n", csvPath.c_str());
+    return 1;
+  }
+  std::printf("written:     %ld to %s\n", written, csvPath.c_str());
+  return 0;
+}
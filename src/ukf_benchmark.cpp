@@ -0,0 +1,540 @@
+#include "QuadUkf.h"
+#include "AllocationCounter.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Microbenchmarks of the UKF kernels over a sweep of state and sensor
+ * dimensions, in fixed-size and dynamic builds. Every result is one CSV line
+ * (or JSON object with --json) holding ns/op, cycles/op and allocations/op,
+ * plus the kernel's floating point operation count where it is known
+ * analytically (0 otherwise).
+ *
+ * With --accuracy it instead replays a synthetic flight through QuadUkf with
+ * every sigma point set and engine, and reports the cost per step next to
+ * the deviation from the symmetric standard filter.
+ */
+
+static unsigned long long readCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/*
+ * Test model of n states and m sensors: every state is driven by a sine of
+ * its neighbor and the first m states are observed directly.
+ */
+template<int NStates, int NSensors>
+class BenchmarkModel : public UnscentedKf<double, NStates, NSensors>
+{
+public:
+  typedef UnscentedKf<double, NStates, NSensors> Base;
+  using typename Base::ConstStateRef;
+  using typename Base::StateRef;
+  using typename Base::SensorRef;
+
+  BenchmarkModel(int nStates, int nSensors) :
+      Base(nStates, nSensors)
+  {
+  }
+
+  using Base::workspace;
+  using Base::computeSigmaPoints;
+  using Base::unscentedStateTransform;
+  using Base::unscentedSensorTransform;
+  using Base::computeCovariance;
+  using Base::computeGain;
+  using Base::subtractOuterProduct;
+  using Base::setSelectionObservation;
+  using Base::setNonlinearObservation;
+
+  void processFunc(const ConstStateRef &x, const double dt, StateRef out)
+  {
+    const int n = this->numStates;
+    out = x;
+    out.head(n - 1).array() += dt * x.tail(n - 1).array().sin();
+    out(n - 1) += dt * std::sin(x(0));
+  }
+
+  void observationFunc(const ConstStateRef &x, SensorRef out)
+  {
+    out = x.head(this->numSensors);
+  }
+};
+
+struct BenchmarkOptions
+{
+  double minTime;
+  bool json;
+  bool accuracy;
+  std::string filter;
+};
+
+const char *sigmaPointSetNames[] = {"symmetric", "simplex", "skew"};
+
+class BenchmarkReporter
+{
+public:
+  BenchmarkReporter(const BenchmarkOptions &opts) :
+      options(opts), first(true)
+  {
+    if (options.json)
+    {
+      std::printf("[\n");
+    }
+    else
+    {
+      std::printf("kernel,engine,layout,states,sensors,iterations,ns_per_op,"
+                  "cycles_per_op,allocs_per_op,flops_per_op\n");
+    }
+  }
+
+  ~BenchmarkReporter()
+  {
+    if (options.json)
+    {
+      std::printf("\n]\n");
+    }
+  }
+
+  /*
+   * Runs op until minTime has elapsed, after one untimed warm-up call that
+   * lets lazily sized buffers settle, and reports per-call averages.
+   */
+  template<typename Op>
+  void run(const char *kernel, const char *engine, const char *layout,
+           int states, int sensors, Op op, double flops = 0)
+  {
+    char name[256];
+    std::snprintf(name, sizeof(name), "%s/%s/%s/%d/%d", kernel, engine,
+                  layout, states, sensors);
+    if (!options.filter.empty() && !std::strstr(name, options.filter.c_str()))
+    {
+      return;
+    }
+
+    op();
+    long iterations = 0;
+    long batch = 1;
+    double elapsed = 0;
+    unsigned long long cycles = 0;
+    long allocs = 0;
+    while (elapsed < options.minTime)
+    {
+      const long allocsBefore = allocationCount();
+      const unsigned long long cyclesBefore = readCycles();
+      const auto start = std::chrono::steady_clock::now();
+      for (long i = 0; i < batch; ++i)
+      {
+        op();
+      }
+      elapsed += std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count();
+      cycles += readCycles() - cyclesBefore;
+      allocs += allocationCount() - allocsBefore;
+      iterations += batch;
+      batch *= 2;
+    }
+
+    const double nsPerOp = 1e9 * elapsed / iterations;
+    const double cyclesPerOp = double(cycles) / iterations;
+    const double allocsPerOp =
+        (allocationCount() < 0) ? -1 : double(allocs) / iterations;
+    if (options.json)
+    {
+      std::printf("%s  {\"kernel\": \"%s\", \"engine\": \"%s\", "
+                  "\"layout\": \"%s\", \"states\": %d, \"sensors\": %d, "
+                  "\"iterations\": %ld, \"ns_per_op\": %.1f, "
+                  "\"cycles_per_op\": %.0f, \"allocs_per_op\": %.3f, "
+                  "\"flops_per_op\": %.0f}",
+                  first ? "" : ",\n", kernel, engine, layout, states, sensors,
+                  iterations, nsPerOp, cyclesPerOp, allocsPerOp, flops);
+    }
+    else
+    {
+      std::printf("%s,%s,%s,%d,%d,%ld,%.1f,%.0f,%.3f,%.0f\n", kernel, engine,
+                  layout, states, sensors, iterations, nsPerOp, cyclesPerOp,
+                  allocsPerOp, flops);
+    }
+    std::fflush(stdout);
+    first = false;
+  }
+
+private:
+  BenchmarkOptions options;
+  bool first;
+};
+
+template<int NStates, int NSensors>
+void benchmarkModel(BenchmarkReporter &reporter, int n, int m)
+{
+  typedef BenchmarkModel<NStates, NSensors> Model;
+  typedef typename Model::Belief Belief;
+  typedef typename Model::StateMatrix StateMatrix;
+  typedef typename Model::SensorMatrix SensorMatrix;
+  typedef typename Model::SelectionVector SelectionVector;
+  typedef typename Model::CrossCovMatrix CrossCovMatrix;
+  typedef typename Model::WeightVector WeightVector;
+  typedef typename Model::SensorVector SensorVector;
+  typedef typename Model::StateVector StateVector;
+  typedef typename Model::StateSigmaMatrix StateSigmaMatrix;
+  const char *layout = (NStates == Eigen::Dynamic) ? "dynamic" : "fixed";
+  const double dt = 0.005;
+
+  // Large fixed-size models do not fit on the stack, so everything is on the
+  // heap.
+  Model *ukf = new Model(n, m);
+  Belief *in = new Belief;
+  Belief *out = new Belief;
+  in->state = StateVector::LinSpaced(n, 0.1, 1.0);
+  in->covariance = 0.01 * StateMatrix::Identity(n, n);
+  in->sqrtCovariance = 0.1 * StateMatrix::Identity(n, n);
+  *out = *in;
+  const StateMatrix Q = 0.001 * StateMatrix::Identity(n, n);
+  const SensorMatrix R = 0.01 * SensorMatrix::Identity(m, m);
+  const SensorVector z = in->state.head(m) + SensorVector::Constant(m, 0.01);
+  StateSigmaMatrix *sigmaPts = new StateSigmaMatrix(n, 2 * n + 1);
+  const double scalingCoeff = 0.75 * std::sqrt(double(n));
+  ukf->computeSigmaPoints(in->state, in->covariance, scalingCoeff, *sigmaPts);
+
+  reporter.run("sigma_points", "-", layout, n, m, [&]
+  {
+    ukf->computeSigmaPoints(in->state, in->covariance, scalingCoeff,
+        *sigmaPts);
+  });
+  reporter.run("state_transform", "-", layout, n, m, [&]
+  {
+    ukf->unscentedStateTransform(*sigmaPts, Q, dt, out->state,
+        out->covariance);
+  });
+  reporter.run("sensor_transform", "-", layout, n, m, [&]
+  {
+    SensorVector &zPred = ukf->workspace.sensorMean;
+    SensorMatrix &Pzz = ukf->workspace.sensorCovariance;
+    ukf->unscentedSensorTransform(*sigmaPts, R, zPred, Pzz);
+  });
+
+  // Covariance accumulation and gain, each against the dense formulation it
+  // replaced: a full weighted product, and an explicit inverse of P_zz
+  // followed by P - K P_xz^T
+  const int numSigma = 2 * n + 1;
+  ukf->unscentedStateTransform(*sigmaPts, Q, dt, out->state, out->covariance);
+  StateSigmaMatrix &devs = ukf->workspace.stateDeviations;
+  StateSigmaMatrix *weightedDevs = new StateSigmaMatrix(n, numSigma);
+  const WeightVector weights = WeightVector::Constant(numSigma,
+                                                     0.5 / numSigma);
+  reporter.run("covariance_dense", "-", layout, n, m, [&]
+  {
+    weightedDevs->noalias() = devs * weights.asDiagonal();
+    out->covariance = Q;
+    out->covariance.noalias() += *weightedDevs * devs.transpose();
+  }, double(n) * numSigma + 2.0 * n * n * numSigma);
+  reporter.run("covariance", "-", layout, n, m, [&]
+  {
+    ukf->computeCovariance(devs, Q, out->covariance);
+  }, double(n) * (n + 1) * numSigma);
+
+  ukf->workspace.crossCovariance = 0.001 * CrossCovMatrix::Ones(n, m);
+  ukf->workspace.sensorCovariance = R;
+  ukf->workspace.sensorCovariance.noalias() +=
+      0.5 * in->covariance.topLeftCorner(m, m);
+  const SensorMatrix &Pzz = ukf->workspace.sensorCovariance;
+  const CrossCovMatrix &Pxz = ukf->workspace.crossCovariance;
+  Eigen::PartialPivLU<SensorMatrix> *lu =
+      new Eigen::PartialPivLU<SensorMatrix>(m);
+  SensorMatrix *PzzInv = new SensorMatrix(m, m);
+  CrossCovMatrix *K = new CrossCovMatrix(n, m);
+  const double m3 = double(m) * m * m;
+  reporter.run("gain_inverse", "-", layout, n, m, [&]
+  {
+    lu->compute(Pzz);
+    *PzzInv = lu->solve(SensorMatrix::Identity(m, m));
+    K->noalias() = Pxz * *PzzInv;
+    out->covariance = in->covariance;
+    out->covariance.noalias() -= *K * Pxz.transpose();
+  }, 2 * m3 / 3 + 2 * m3 + 2.0 * n * m * m + 2.0 * n * n * m);
+  reporter.run("gain_solve", "-", layout, n, m, [&]
+  {
+    ukf->workspace.innovationLlt.compute(Pzz);
+    ukf->workspace.sqrtSensorCovariance =
+        ukf->workspace.innovationLlt.matrixL();
+    ukf->computeGain();
+    out->covariance = in->covariance;
+    Model::subtractOuterProduct(out->covariance,
+                                ukf->workspace.gainTimesSqrt);
+  }, m3 / 3 + 2.0 * n * m * m + double(n) * (n + 1) * m);
+  delete K;
+  delete PzzInv;
+  delete lu;
+  delete weightedDevs;
+
+  const typename Model::Engine engines[] = {Model::STANDARD_UKF,
+                                            Model::SQUARE_ROOT_UKF};
+  const char *engineNames[] = {"standard", "sqrt"};
+  for (int e = 0; e < 2; ++e)
+  {
+    ukf->setEngine(engines[e]);
+
+    // Full steps for every sigma point set, as "<engine>-<set>" past the
+    // symmetric one
+    for (int p = 0; p < 3; ++p)
+    {
+      ukf->setSigmaPointSet(typename Model::SigmaPointSet(p));
+      const std::string name = (p == 0) ? engineNames[e] :
+          std::string(engineNames[e]) + "-" + sigmaPointSetNames[p];
+      reporter.run("predict", name.c_str(), layout, n, m, [&]
+      {
+        ukf->predictState(*in, Q, dt, *out);
+      });
+      reporter.run("correct", name.c_str(), layout, n, m, [&]
+      {
+        ukf->correctState(*in, z, R, *out);
+      });
+      reporter.run("predict_correct", name.c_str(), layout, n, m, [&]
+      {
+        ukf->predictState(*in, Q, dt, *out);
+        ukf->correctState(*out, z, R, *out);
+      });
+    }
+    ukf->setSigmaPointSet(Model::SYMMETRIC_SIGMA_POINTS);
+
+    // The same measurement declared as a selection of the first m states
+    ukf->setSelectionObservation(SelectionVector::LinSpaced(m, 0, m - 1));
+    reporter.run("correct_linear", engineNames[e], layout, n, m, [&]
+    {
+      ukf->correctState(*in, z, R, *out);
+    });
+    ukf->setNonlinearObservation();
+  }
+
+  delete sigmaPts;
+  delete out;
+  delete in;
+  delete ukf;
+}
+
+/*
+ * Exposes the quad filter's workspace-backed model for the benchmarks
+ */
+class BenchmarkQuadUkf : public QuadUkf
+{
+public:
+  using QuadUkf::workspace;
+};
+
+void benchmarkQuadUkf(BenchmarkReporter &reporter)
+{
+  QuadUkf::ImuSample imu;
+  imu.timeStamp = 0.005;
+  imu.angularVelocity << 0.01, 0.02, -0.01;
+  imu.linearAcceleration << 0.1, -0.1, 9.81;
+  QuadUkf::PoseSample pose;
+  pose.position << 0, 0, 1;
+  pose.orientation.coeffs() << 1, 0, 0, 0;
+
+  // One prediction fills the workspace with realistic sigma points
+  BenchmarkQuadUkf *ukf = new BenchmarkQuadUkf;
+  ukf->imuUpdate(imu);
+  const int n = ukf->numStates, m = ukf->numSensors;
+  const QuadUkf::StateVector x = ukf->workspace.sigmaPoints.col(0);
+  QuadUkf::StateVector *xOut = new QuadUkf::StateVector;
+
+  reporter.run("quad_process_func", "-", "fixed", n, m, [&]
+  {
+    ukf->processFunc(x, 0.005, *xOut);
+  });
+  reporter.run("quad_process_batch", "-", "fixed", n, m, [&]
+  {
+    ukf->processBatch(ukf->workspace.sigmaPoints, 0.005,
+                      ukf->workspace.propagatedPoints);
+  });
+
+  // End to end: one IMU prediction per call and a pose correction on every
+  // tenth, as in flight
+  const QuadUkf::Engine engines[] = {QuadUkf::STANDARD_UKF,
+                                     QuadUkf::SQUARE_ROOT_UKF};
+  const char *engineNames[] = {"standard", "sqrt"};
+  for (int e = 0; e < 2; ++e)
+  {
+    for (int p = 0; p < 3; ++p)
+    {
+      delete ukf;
+      ukf = new BenchmarkQuadUkf;
+      ukf->setEngine(engines[e]);
+      ukf->setSigmaPointSet(QuadUkf::SigmaPointSet(p));
+      const std::string name = (p == 0) ? engineNames[e] :
+          std::string(engineNames[e]) + "-" + sigmaPointSetNames[p];
+      long step = 0;
+      reporter.run("quad_imu_pose", name.c_str(), "fixed", n, m, [&]
+      {
+        ++step;
+        imu.timeStamp = 0.005 * step;
+        ukf->imuUpdate(imu);
+        if (step % 10 == 0)
+        {
+          pose.timeStamp = imu.timeStamp;
+          ukf->poseUpdate(pose);
+        }
+      });
+    }
+  }
+
+  delete xOut;
+  delete ukf;
+}
+
+/*
+ * Flies QuadUkf through 20 s of a synthetic maneuver: IMU samples at 200 Hz
+ * with a slow yaw and a swaying acceleration, and poses at 20 Hz along a
+ * circle. Writes the belief's position and attitude after every step to
+ * positions and attitudes, and returns the mean wall time per step in ns.
+ */
+double flyQuadScenario(QuadUkf &ukf, std::vector<Eigen::Vector3d> &positions,
+                       std::vector<Eigen::Quaterniond> &attitudes)
+{
+  const int numSteps = 4000;
+  const double dt = 0.005;
+  positions.clear();
+  attitudes.clear();
+  QuadUkf::ImuSample imu;
+  QuadUkf::PoseSample pose;
+  double elapsed = 0;
+  for (int step = 1; step <= numSteps; ++step)
+  {
+    const double t = dt * step;
+    imu.timeStamp = t;
+    imu.angularVelocity << 0.05 * std::sin(t), -0.05 * std::cos(t), 0.2;
+    imu.linearAcceleration << 0.5 * std::sin(2 * t), 0.5 * std::cos(2 * t),
+        9.81;
+    const bool poseStep = (step % 10 == 0);
+    if (poseStep)
+    {
+      pose.timeStamp = t;
+      pose.position << std::cos(0.2 * t), std::sin(0.2 * t), 1;
+      const Eigen::AngleAxisd yaw(0.2 * t, Eigen::Vector3d::UnitY());
+      pose.orientation = Eigen::Quaterniond(yaw);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    ukf.imuUpdate(imu);
+    if (poseStep)
+    {
+      ukf.poseUpdate(pose);
+    }
+    elapsed += std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    positions.push_back(ukf.getBelief().state.position);
+    attitudes.push_back(ukf.getBelief().state.quaternion);
+  }
+  return 1e9 * elapsed / numSteps;
+}
+
+/*
+ * Accuracy against cost of every sigma point set on the quad model, as RMS
+ * position and attitude deviation from the symmetric standard filter over
+ * flyQuadScenario()
+ */
+void reportQuadAccuracy()
+{
+  std::printf("sigma_points,engine,points,ns_per_step,position_rms,"
+              "attitude_rms_deg\n");
+  const QuadUkf::Engine engines[] = {QuadUkf::STANDARD_UKF,
+                                     QuadUkf::SQUARE_ROOT_UKF};
+  const char *engineNames[] = {"standard", "sqrt"};
+  std::vector<Eigen::Vector3d> refPositions, positions;
+  std::vector<Eigen::Quaterniond> refAttitudes, attitudes;
+  for (int e = 0; e < 2; ++e)
+  {
+    for (int p = 0; p < 3; ++p)
+    {
+      QuadUkf *ukf = new QuadUkf;
+      ukf->setEngine(engines[e]);
+      ukf->setSigmaPointSet(QuadUkf::SigmaPointSet(p));
+      const double nsPerStep = flyQuadScenario(*ukf, positions, attitudes);
+      if (e == 0 && p == 0)
+      {
+        refPositions = positions;
+        refAttitudes = attitudes;
+      }
+
+      double positionSq = 0, attitudeSq = 0;
+      for (size_t i = 0; i < positions.size(); ++i)
+      {
+        positionSq += (positions[i] - refPositions[i]).squaredNorm();
+        const double angle = refAttitudes[i].angularDistance(attitudes[i]);
+        attitudeSq += angle * angle;
+      }
+      std::printf("%s,%s,%d,%.1f,%.3g,%.3g\n", sigmaPointSetNames[p],
+                  engineNames[e], ukf->numSigmaPoints(), nsPerStep,
+                  std::sqrt(positionSq / positions.size()),
+                  std::sqrt(attitudeSq / attitudes.size()) * 180 / M_PI);
+      std::fflush(stdout);
+      delete ukf;
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  BenchmarkOptions options {0.2, false, false, ""};
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::strcmp(argv[i], "--json") == 0)
+    {
+      options.json = true;
+    }
+    else if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+    {
+      options.minTime = std::atof(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+    {
+      options.filter = argv[++i];
+    }
+    else if (std::strcmp(argv[i], "--accuracy") == 0)
+    {
+      options.accuracy = true;
+    }
+    else
+    {
+      std::fprintf(stderr, "usage: %s [--json] [--min-time SECONDS] "
+                   "[--filter SUBSTRING] [--accuracy]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (options.accuracy)
+  {
+    reportQuadAccuracy();
+    return 0;
+  }
+
+  BenchmarkReporter reporter(options);
+  benchmarkModel<6, 3>(reporter, 6, 3);
+  benchmarkModel<16, 8>(reporter, 16, 8);
+  benchmarkModel<32, 16>(reporter, 32, 16);
+  benchmarkModel<64, 32>(reporter, 64, 32);
+  const int dims[] = {6, 16, 32, 64};
+  for (int i = 0; i < 4; ++i)
+  {
+    benchmarkModel<Eigen::Dynamic, Eigen::Dynamic>(reporter, dims[i],
+                                                   dims[i] / 2);
+  }
+  benchmarkQuadUkf(reporter);
+  return 0;
+}
@@ -0,0 +1,217 @@
+#include "QuadUkf.h"
+#include "AllocationCounter.h"
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+/*
+ * Asserts that the steady-state filter steps of fixed-size filters never
+ * allocate: every predict and correct variant of UnscentedKf over a sweep of
+ * dimensions, and QuadUkf's IMU, pose and sensor updates. Each step runs
+ * once untimed so that lazily sized buffers settle, then a few more times
+ * under the allocation counter.
+ */
+
+/*
+ * Test model of n states and m sensors: every state is driven by a sine of
+ * its neighbor and the first m states are observed directly.
+ */
+template<int NStates, int NSensors>
+class TestModel : public UnscentedKf<double, NStates, NSensors>
+{
+public:
+  typedef UnscentedKf<double, NStates, NSensors> Base;
+  using typename Base::ConstStateRef;
+  using typename Base::StateRef;
+  using typename Base::SensorRef;
+
+  TestModel() :
+      Base(NStates, NSensors)
+  {
+  }
+
+  using Base::setSelectionObservation;
+  using Base::setNonlinearObservation;
+
+  void processFunc(const ConstStateRef &x, const double dt, StateRef out)
+  {
+    const int n = this->numStates;
+    out = x;
+    out.head(n - 1).array() += dt * x.tail(n - 1).array().sin();
+    out(n - 1) += dt * std::sin(x(0));
+  }
+
+  void observationFunc(const ConstStateRef &x, SensorRef out)
+  {
+    out = x.head(this->numSensors);
+  }
+};
+
+static int numFailures = 0;
+
+// Runs op once to warm up, then counts the allocations of a few more calls
+template<typename Op>
+void expectNoAllocations(const std::string &name, Op op)
+{
+  const int NUM_CALLS = 8;
+  op();
+  const long before = allocationCount();
+  for (int i = 0; i < NUM_CALLS; ++i)
+  {
+    op();
+  }
+  const long allocs = allocationCount() - before;
+  const bool pass = allocs == 0;
+  std::printf("%s %s: %.3f allocations per call\n", pass ? "ok  " : "FAIL",
+              name.c_str(), double(allocs) / NUM_CALLS);
+  if (!pass)
+  {
+    ++numFailures;
+  }
+}
+
+const char *engineNames[] = {"standard", "sqrt"};
+const char *sigmaPointSetNames[] = {"symmetric", "simplex", "skew"};
+
+template<int NStates, int NSensors>
+void testModel()
+{
+  typedef TestModel<NStates, NSensors> Model;
+  typedef typename Model::Belief Belief;
+  typedef typename Model::StateVector StateVector;
+  typedef typename Model::StateMatrix StateMatrix;
+  typedef typename Model::SensorVector SensorVector;
+  typedef typename Model::SensorMatrix SensorMatrix;
+  typedef typename Model::SelectionVector SelectionVector;
+  typedef typename Model::PartialSensorVector PartialSensorVector;
+  typedef typename Model::PartialSensorMatrix PartialSensorMatrix;
+  typedef typename Model::PartialObservationMatrix PartialObservationMatrix;
+  const int n = NStates, m = NSensors;
+  const double dt = 0.005;
+
+  // Large fixed-size models do not fit on the stack, so they live on the
+  // heap, allocated before counting starts
+  Model *ukf = new Model;
+  Belief *in = new Belief;
+  Belief *out = new Belief;
+  in->state = StateVector::LinSpaced(n, 0.1, 1.0);
+  in->covariance = 0.01 * StateMatrix::Identity();
+  in->sqrtCovariance = 0.1 * StateMatrix::Identity();
+  *out = *in;
+  StateMatrix *Q = new StateMatrix(0.001 * StateMatrix::Identity());
+  const SensorMatrix R = 0.01 * SensorMatrix::Identity();
+  const SensorVector z = in->state.head(m) + SensorVector::Constant(0.01);
+  const PartialSensorVector zPartial = z.head(m / 2);
+  const PartialObservationMatrix H = PartialObservationMatrix::Identity(m / 2,
+                                                                        n);
+  const PartialSensorMatrix RPartial = R.topLeftCorner(m / 2, m / 2);
+
+  const typename Model::Engine engines[] = {Model::STANDARD_UKF,
+                                            Model::SQUARE_ROOT_UKF};
+  for (int e = 0; e < 2; ++e)
+  {
+    ukf->setEngine(engines[e]);
+    const std::string name = std::to_string(n) + "/" + std::to_string(m)
+        + " " + engineNames[e];
+    for (int p = 0; p < 2; ++p)
+    {
+      ukf->setSigmaPointSet(typename Model::SigmaPointSet(p));
+      const std::string setName = name + "-" + sigmaPointSetNames[p] + " ";
+      expectNoAllocations(setName + "predict", [&]
+      {
+        ukf->predictState(*in, *Q, dt, *out);
+      });
+      expectNoAllocations(setName + "correct", [&]
+      {
+        ukf->correctState(*in, z, R, *out);
+      });
+    }
+    ukf->setSigmaPointSet(Model::SYMMETRIC_SIGMA_POINTS);
+
+    ukf->setSelectionObservation(SelectionVector::LinSpaced(m, 0, m - 1));
+    expectNoAllocations(name + " correct_selection", [&]
+    {
+      ukf->correctState(*in, z, R, *out);
+    });
+    ukf->setNonlinearObservation();
+    expectNoAllocations(name + " correct_linear", [&]
+    {
+      ukf->correctLinearState(*in, zPartial, H, RPartial, false, *out);
+    });
+    expectNoAllocations(name + " correct_sequential", [&]
+    {
+      ukf->correctLinearState(*in, zPartial, H, RPartial, true, *out);
+    });
+  }
+
+  delete Q;
+  delete out;
+  delete in;
+  delete ukf;
+}
+
+/*
+ * QuadUkf end to end: IMU predictions with a pose correction on every tenth,
+ * an altimeter on every fifth, and the same with preintegrated IMU samples
+ */
+void testQuadUkf()
+{
+  const QuadUkf::Engine engines[] = {QuadUkf::STANDARD_UKF,
+                                     QuadUkf::SQUARE_ROOT_UKF};
+  for (int e = 0; e < 2; ++e)
+  {
+    for (int preintegrate = 0; preintegrate < 2; ++preintegrate)
+    {
+      QuadUkf *ukf = new QuadUkf;
+      ukf->setEngine(engines[e]);
+      ukf->setImuPreintegration(preintegrate != 0);
+      QuadUkf::ImuSample imu;
+      imu.angularVelocity << 0.01, 0.02, -0.01;
+      imu.linearAcceleration << 0.1, -0.1, 9.81;
+      QuadUkf::PoseSample pose;
+      pose.position << 0, 0, 1;
+      pose.orientation.coeffs() << 1, 0, 0, 0;
+      QuadUkf::SensorSample altimeter;
+      altimeter.sensor = QuadUkf::ALTIMETER_SENSOR;
+      altimeter.values.setConstant(1);
+
+      long step = 0;
+      const std::string name = std::string("quad ") + engineNames[e]
+          + (preintegrate ? "-preintegrated" : "") + " imu_pose";
+      expectNoAllocations(name, [&]
+      {
+        ++step;
+        imu.timeStamp = 0.005 * step;
+        ukf->imuUpdate(imu);
+        if (step % 5 == 0)
+        {
+          altimeter.timeStamp = imu.timeStamp;
+          ukf->sensorUpdate(altimeter);
+        }
+        if (step % 10 == 0)
+        {
+          pose.timeStamp = imu.timeStamp;
+          ukf->poseUpdate(pose);
+        }
+      });
+      delete ukf;
+    }
+  }
+}
+
+int main()
+{
+  if (allocationCount() < 0)
+  {
+    std::printf("allocations cannot be counted on this platform\n");
+    return 0;
+  }
+
+  testModel<6, 3>();
+  testModel<16, 8>();
+  testModel<32, 16>();
+  testModel<64, 32>();
+  testQuadUkf();
+  return numFailures == 0 ? 0 : 1;
+}